@@ -1,24 +1,39 @@
 #include"async_client.h"
 
-// 读入新订单文件
+// 读入新订单文件, 撤单记录需要服务端分配的订单ID, 交互模式下跳过
 void readNewOrderRequest(const std::string& fileName, std::vector<NewOrderRequest>& requests){
-	std::ifstream fin;
-	fin.open(fileName);
-	int requestNum;
-	fin>>requestNum;
-	std::string type, direction, stockID;
-	uint64_t clientID;
-	uint32_t orderQty;
-	double price;
-	for(int i=0;i<requestNum;i++){
-		fin>>type>>direction>>clientID>>stockID>>orderQty>>price;
-		NewOrderRequest request=MakeNewOrderRequest(type=="LIMIT" ? true: false, 
-							direction=="SELL" ? true: false, 
-							clientID, stockID, orderQty, price);
-		requests.push_back(std::move(request));
+	std::vector<OrderFileRecord> records;
+	loadOrderRecords(fileName, records);
+	std::string time=getTime();
+	for(const auto& record:records){
+		if(record.kind!=RECORD_NEW_ORDER) continue;
+		requests.emplace_back();
+		orderRecordToRequest(record, requests.back());
+		requests.back().set_time(time);
 	}
 }
 
+// 读入报价文件: 首行为报价数, 之后每行为 <股票ID> <买数量> <买价格> <卖数量> <卖价格>, 数量为0表示撤销该侧报价
+int readMassQuoteRequest(const std::string& fileName, MassQuoteRequest& request){
+	std::ifstream fin(fileName);
+	int count=0;
+	if(!(fin>>count)) return 0;
+	for(int i=0;i<count;i++){
+		OPS::QuoteEntry quote;
+		std::string stockID;
+		uint32_t bidQty, askQty;
+		double bidPrice, askPrice;
+		if(!(fin>>stockID>>bidQty>>bidPrice>>askQty>>askPrice)) break;
+		quote.set_stockid(stockID);
+		quote.set_bidqty(bidQty);
+		quote.set_bidprice(bidPrice);
+		quote.set_askqty(askQty);
+		quote.set_askprice(askPrice);
+		*request.add_quotes()=quote;
+	}
+	return request.quotes_size();
+}
+
 // 撤销订单类
 AsyncClientCallPushCancelOrder::AsyncClientCallPushCancelOrder(const CancelOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
 	AbstractAsyncClientCall(){
@@ -41,25 +56,60 @@ void AsyncClientCallPushCancelOrder::Proceed(bool ok){
 
 // 提交订单类
 AsyncClientCallPushNewOrder::AsyncClientCallPushNewOrder(std::vector<NewOrderRequest>&& requests, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
-	AbstractAsyncClientCall(), requests_(requests), counter(0), writing_mode_(true){
+	AbstractAsyncClientCall(), counter(0), writing_mode_(true), requests_(requests), timeSecond_(0){
+	startCall(cq_, stub_);
+}
+
+AsyncClientCallPushNewOrder::AsyncClientCallPushNewOrder(std::shared_ptr<OrderFileReader> orderFile, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(), counter(0), writing_mode_(true), orderFile_(orderFile), timeSecond_(0){
+	startCall(cq_, stub_);
+}
+
+void AsyncClientCallPushNewOrder::startCall(CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_){
+	callStatus=PROCESS;
 	responder_=stub_->PrepareAsyncPushNewOrder(&context, &cq_);
 	responder_->StartCall((void*)this);
-	callStatus=PROCESS;
+}
+
+// 获取下一条待发送的请求, 发送完毕返回nullptr
+const NewOrderRequest* AsyncClientCallPushNewOrder::nextRequest(){
+	if(!orderFile_){
+		return counter<requests_.size()?&requests_[counter]:nullptr;
+	}
+	// 跳过撤单记录
+	while(counter<orderFile_->size()&&orderFile_->at(counter).kind!=RECORD_NEW_ORDER){
+		++counter;
+	}
+	if(counter>=orderFile_->size()){
+		return nullptr;
+	}
+	// 直接从映射内存读取记录, 复用同一个请求对象
+	orderRecordToRequest(orderFile_->at(counter), request_);
+	time_t now=time(nullptr);
+	if(now!=timeSecond_){
+		timeSecond_=now;
+		timeStr_=getTime();
+	}
+	request_.set_time(timeStr_);
+	return &request_;
 }
 
 void AsyncClientCallPushNewOrder::Proceed(bool ok){
 	// sleep(1);
 	if(callStatus==PROCESS){
 		if(writing_mode_){
-			if(counter<requests_.size()){
+			const NewOrderRequest* request=nextRequest();
+			if(request!=nullptr){
 				//std::cout<<"Writing request..."<<std::endl;	
-				//printRequest(requests_[counter]);
-				responder_->Write(requests_[counter], (void*)this);
+				//printRequest(*request);
+				responder_->Write(*request, (void*)this);
 				++counter;				
 			}else{
 				//std::cout<<"Writing done!"<<std::endl;
 				responder_->WritesDone((void*)this);
 				writing_mode_=false;	
+				// 发送完毕释放映射
+				orderFile_.reset();
 			}
 		}else{
 			if(!ok){
@@ -81,39 +131,138 @@ void AsyncClientCallPushNewOrder::Proceed(bool ok){
 }
 
 // 查询订单类
-AsyncClientCallPushQueryOrder::AsyncClientCallPushQueryOrder(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
-	AbstractAsyncClientCall(), reportsCounter(0){
-		responder = stub_->AsyncPushQueryOrder(&context, request, &cq_, (void*)this);
+AsyncClientCallQueryOrders::AsyncClientCallQueryOrders(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+	responder=stub_->PrepareAsyncQueryOrders(&context, request, &cq_);
+	responder->StartCall();
+	responder->Finish(&queryOrderReply_, &status, (void*)this);
+}
+
+void AsyncClientCallQueryOrders::Proceed(bool ok){
+	if(ok&&status.ok()){
+		if(queryOrderReply_.orders_size()==0&&queryOrderReply_.nextcursor()==0) std::cout<<"无订单！"<<std::endl;
+		printReport(queryOrderReply_);
+	}
+	delete this;
+}
+
+// 深度订阅类
+AsyncClientCallSubscribeDepth::AsyncClientCallSubscribeDepth(const DepthRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+		responder = stub_->AsyncSubscribeDepth(&context, request, &cq_, (void*)this);
 		callStatus = PROCESS ;
 }
 
-void AsyncClientCallPushQueryOrder::Proceed(bool ok){
+void AsyncClientCallSubscribeDepth::Proceed(bool ok){
 	if(callStatus == PROCESS){
 		if(!ok){
 			responder->Finish(&status, (void*)this);
 			callStatus = FINISH;
-			if(reportsCounter==0){
-				std::cout<<"无订单！"<<std::endl;
-			}
 			return ;
 		}
-		responder->Read(&queryReport_, (void*)this);
-		if(queryReport_.clientid()>0) {
-			printReport(queryReport_);
-			reportsCounter++;
-		}
+		// 第一次回调为调用建立, 此时还没有读到快照
+		if(depthUpdate_.stockid().size()>0) printReport(depthUpdate_);
+		responder->Read(&depthUpdate_, (void*)this);
 	}
 	else if(callStatus == FINISH){
 			delete this;
 	}
 }
 
+// 改单类
+AsyncClientCallAmendOrder::AsyncClientCallAmendOrder(const AmendOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+	responder=stub_->PrepareAsyncAmendOrder(&context, request, &cq_);
+	responder->StartCall();
+	responder->Finish(&report_, &status, (void*)this);
+}
+
+void AsyncClientCallAmendOrder::Proceed(bool ok){
+	if(ok&&status.ok()) printReport(report_);
+	delete this;
+}
+
+// 批量撤单类
+AsyncClientCallMassCancel::AsyncClientCallMassCancel(const MassCancelRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+	responder=stub_->PrepareAsyncMassCancel(&context, request, &cq_);
+	responder->StartCall();
+	responder->Finish(&massCancelReply_, &status, (void*)this);
+}
+
+void AsyncClientCallMassCancel::Proceed(bool ok){
+	if(ok&&status.ok()) printReport(massCancelReply_);
+	delete this;
+}
+
+// 集合竞价类
+AsyncClientCallAuction::AsyncClientCallAuction(const AuctionRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+	responder=stub_->PrepareAsyncAuction(&context, request, &cq_);
+	responder->StartCall();
+	responder->Finish(&auctionReply_, &status, (void*)this);
+}
+
+void AsyncClientCallAuction::Proceed(bool ok){
+	if(ok&&status.ok()) printReport(auctionReply_);
+	delete this;
+}
+
+// 批量报价类
+AsyncClientCallMassQuote::AsyncClientCallMassQuote(const MassQuoteRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+	responder=stub_->PrepareAsyncMassQuote(&context, request, &cq_);
+	responder->StartCall();
+	responder->Finish(&massQuoteReply_, &status, (void*)this);
+}
+
+void AsyncClientCallMassQuote::Proceed(bool ok){
+	if(ok&&status.ok()) printReport(massQuoteReply_);
+	delete this;
+}
+
+// 统计查询类
+AsyncClientCallGetStats::AsyncClientCallGetStats(const StatsRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+	responder=stub_->PrepareAsyncGetStats(&context, request, &cq_);
+	responder->StartCall();
+	responder->Finish(&statsReport_, &status, (void*)this);
+}
+
+void AsyncClientCallGetStats::Proceed(bool ok){
+	if(ok&&status.ok()) printReport(statsReport_);
+	delete this;
+}
+
+// 追踪导出类
+AsyncClientCallDumpTrace::AsyncClientCallDumpTrace(const TraceRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
+	AbstractAsyncClientCall(){
+	responder=stub_->PrepareAsyncDumpTrace(&context, request, &cq_);
+	responder->StartCall();
+	responder->Finish(&traceReply_, &status, (void*)this);
+}
+
+void AsyncClientCallDumpTrace::Proceed(bool ok){
+	if(ok&&status.ok()) printReport(traceReply_);
+	delete this;
+}
+
 // 客户端类
 OPSClient::OPSClient(std::shared_ptr<Channel> channel):
 		stub_(OrderService::NewStub(channel)){}
 
 // 提交订单
 void OPSClient::PushNewOrder(const std::string& fileName){
+	// 二进制报单文件直接映射后逐条发送
+	if(isOrderFile(fileName)){
+		std::shared_ptr<OrderFileReader> orderFile=std::make_shared<OrderFileReader>();
+		if(!orderFile->open(fileName)){
+			std::cout<<"Can not open: "<<fileName<<std::endl;
+			return;
+		}
+		new AsyncClientCallPushNewOrder(orderFile, cq_, stub_);
+		return;
+	}
 	std::vector<NewOrderRequest> requests;
 	readNewOrderRequest(fileName, requests);
 	// 注册报单请求处理
@@ -127,11 +276,58 @@ void OPSClient::PushCancelOrder(const uint64_t& orderID){
 	new AsyncClientCallPushCancelOrder(request, cq_, stub_);
 }
 
-// 查询订单
-void OPSClient::PushQueryOrder(){
+// 改单
+void OPSClient::AmendOrder(const uint64_t& orderID, const uint32_t& qty, const double& price){
+	new AsyncClientCallAmendOrder(MakeAmendOrderRequest(orderID, qty, price), cq_, stub_);
+}
+
+// 批量撤单
+void OPSClient::MassCancel(const uint64_t& clientID, const std::string& stockID, const MassCancelRequest::Side& side){
+	new AsyncClientCallMassCancel(MakeMassCancelRequest(clientID, stockID, side), cq_, stub_);
+}
+
+// 集合竞价
+void OPSClient::Auction(const std::string& stockID, const AuctionRequest::Action& action){
+	new AsyncClientCallAuction(MakeAuctionRequest(stockID, action), cq_, stub_);
+}
+
+// 批量报价
+void OPSClient::MassQuote(const uint64_t& clientID, const std::string& fileName){
+	MassQuoteRequest request=MakeMassQuoteRequest(clientID);
+	if(readMassQuoteRequest(fileName, request)==0){
+		std::cout<<"Can not read quotes: "<<fileName<<std::endl;
+		return;
+	}
+	new AsyncClientCallMassQuote(request, cq_, stub_);
+}
+
+// 查询一页订单
+void OPSClient::QueryOrders(const uint64_t& clientID, const std::string& stockID, const QueryOrderRequest::Side& side,
+		const QueryOrderRequest::Status& status, const uint64_t& cursor, const uint32_t& limit){
 	QueryOrderRequest request=MakeQueryOrderRequest();
+	request.set_clientid(clientID);
+	request.set_stockid(stockID);
+	request.set_side(side);
+	request.set_status(status);
+	request.set_cursor(cursor);
+	request.set_limit(limit);
 	// 注册查询订单请求
-	new AsyncClientCallPushQueryOrder(request, cq_, stub_);
+	new AsyncClientCallQueryOrders(request, cq_, stub_);
+}
+
+// 订阅档位深度
+void OPSClient::SubscribeDepth(const std::string& stockID, const uint32_t& levels){
+	new AsyncClientCallSubscribeDepth(MakeDepthRequest(stockID, levels), cq_, stub_);
+}
+
+// 查询服务端统计
+void OPSClient::GetStats(){
+	new AsyncClientCallGetStats(MakeStatsRequest(), cq_, stub_);
+}
+
+// 导出服务端的订单生命周期追踪
+void OPSClient::DumpTrace(){
+	new AsyncClientCallDumpTrace(MakeTraceRequest(), cq_, stub_);
 }
 
 // 异步处理完成队列中的事件
@@ -147,9 +343,13 @@ void OPSClient::AsyncCompleteRpc(){
 }
 
 int main(int argc, char* argv[]){
+	// 压测模式
+	if(argc>1&&std::string(argv[1])=="bench"){
+		return runBenchmark(argc, argv);
+	}
 	OPSClient client(grpc::CreateChannel("localhost:50010", grpc::InsecureChannelCredentials()));
 	std::thread thread_=std::thread(&OPSClient::AsyncCompleteRpc, &client);
-	std::cout<<"Please input operator and requests! usage: <New/ Cancel> <RequestsFile/ orderID>"<<std::endl;
+	std::cout<<"Please input operator and requests! usage: <New/ Cancel> <RequestsFile/ orderID>, Amend <orderID> <qty> <price>, MassCancel <clientID> <stockID|-> <S/B/A>, aUction <stockID> <Call/Uncross>, Price <clientID> <QuotesFile>, Depth <stockID> <levels>, Query <clientID> <stockID|-> <S/B/A> <Any/Resting/Pending> <cursor> <limit>, Stats or Trace"<<std::endl;
 	while(1){
 		std::string op;
 		std::cin>>op;
@@ -161,8 +361,53 @@ int main(int argc, char* argv[]){
 			uint64_t orderID;
 			std::cin>>orderID;
 			client.PushCancelOrder(orderID);
+		}else if(op=="Amend"||op=="A"||op=="amend"||op=="a"){
+			// 数量或价格为0表示不变
+			uint64_t orderID;
+			uint32_t qty;
+			double price;
+			std::cin>>orderID>>qty>>price;
+			client.AmendOrder(orderID, qty, price);
+		}else if(op=="MassCancel"||op=="M"||op=="masscancel"||op=="m"){
+			// clientID为0不限用户, stockID为"-"不限股票, 方向S/B之外撤销两侧
+			uint64_t clientID;
+			std::string stockID, side;
+			std::cin>>clientID>>stockID>>side;
+			if(stockID=="-") stockID.clear();
+			client.MassCancel(clientID, stockID, side=="S"||side=="s"?MassCancelRequest::SELL:
+				(side=="B"||side=="b"?MassCancelRequest::BUY:MassCancelRequest::BOTH));
+		}else if(op=="Auction"||op=="U"||op=="auction"||op=="u"){
+			// C开始集合竞价, U撮合并恢复连续竞价
+			std::string stockID, action;
+			std::cin>>stockID>>action;
+			client.Auction(stockID, action=="U"||action=="u"?AuctionRequest::UNCROSS:AuctionRequest::CALL);
+		}else if(op=="Price"||op=="P"||op=="price"||op=="p"){
+			// 报价文件中的每只股票整体替换该用户的双边报价
+			uint64_t clientID;
+			std::string fileName;
+			std::cin>>clientID>>fileName;
+			client.MassQuote(clientID, fileName);
+		}else if(op=="Depth"||op=="D"||op=="depth"||op=="d"){
+			// 持续输出该股票的档位深度, levels为0使用默认档位数
+			std::string stockID;
+			uint32_t levels;
+			std::cin>>stockID>>levels;
+			client.SubscribeDepth(stockID, levels);
 		}else if(op=="Query"||op=="Q"||op=="query"||op=="q"){
-			client.PushQueryOrder();
+			// clientID为0不限用户, stockID为"-"不限股票; 游标取上一页的下一页游标, 第一页为0
+			uint64_t clientID, cursor;
+			uint32_t limit;
+			std::string stockID, side, status;
+			std::cin>>clientID>>stockID>>side>>status>>cursor>>limit;
+			if(stockID=="-") stockID.clear();
+			client.QueryOrders(clientID, stockID, side=="S"||side=="s"?QueryOrderRequest::SELL:
+				(side=="B"||side=="b"?QueryOrderRequest::BUY:QueryOrderRequest::BOTH),
+				status=="R"||status=="r"?QueryOrderRequest::RESTING:(status=="P"||status=="p"?QueryOrderRequest::PENDING:QueryOrderRequest::ANY),
+				cursor, limit);
+		}else if(op=="Stats"||op=="S"||op=="stats"||op=="s"){
+			client.GetStats();
+		}else if(op=="Trace"||op=="T"||op=="trace"||op=="t"){
+			client.DumpTrace();
 		}
 	}
 	thread_.join();
@@ -14,6 +14,8 @@
 #include <fstream>
 #include <iostream>
 #include "../helper/helper.h"
+#include "../helper/order_file.h"
+#include "bench_client.h"
 #include "assert.h"
 
 #include <grpc++/grpc++.h>
@@ -36,14 +38,30 @@ using grpc::Status;
 
 using OPS::NewOrderRequest;
 using OPS::CancelOrderRequest;
+using OPS::AmendOrderRequest;
+using OPS::MassCancelRequest;
+using OPS::MassCancelReply;
+using OPS::AuctionRequest;
+using OPS::AuctionReply;
+using OPS::MassQuoteRequest;
+using OPS::MassQuoteReply;
+using OPS::DepthRequest;
+using OPS::DepthUpdate;
 using OPS::QueryOrderRequest;
+using OPS::QueryOrderReply;
 using OPS::ExecutionReport;
 using OPS::OrderReport;
+using OPS::StatsRequest;
+using OPS::StatsReport;
+using OPS::TraceRequest;
+using OPS::TraceReply;
 using OPS::OrderService;
 
 
 // 读入新订单文件
 void readNewOrderRequest(const std::string&, std::vector<NewOrderRequest>&);
+// 读入报价文件, 返回读到的报价数
+int readMassQuoteRequest(const std::string&, MassQuoteRequest&);
 
 // 抽象类
 class AbstractAsyncClientCall{
@@ -70,28 +88,106 @@ public:
 	virtual void Proceed(bool ok = true) override;
 };
 
+// 改单类
+class AsyncClientCallAmendOrder:public AbstractAsyncClientCall{
+private:
+	std::unique_ptr<ClientAsyncResponseReader<ExecutionReport> > responder;
+public:
+	AsyncClientCallAmendOrder(const AmendOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	virtual void Proceed(bool ok = true) override;
+};
+
+// 批量撤单类
+class AsyncClientCallMassCancel:public AbstractAsyncClientCall{
+private:
+	std::unique_ptr<ClientAsyncResponseReader<MassCancelReply> > responder;
+	MassCancelReply massCancelReply_;
+public:
+	AsyncClientCallMassCancel(const MassCancelRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	virtual void Proceed(bool ok = true) override;
+};
+
+// 集合竞价类
+class AsyncClientCallAuction:public AbstractAsyncClientCall{
+private:
+	std::unique_ptr<ClientAsyncResponseReader<AuctionReply> > responder;
+	AuctionReply auctionReply_;
+public:
+	AsyncClientCallAuction(const AuctionRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	virtual void Proceed(bool ok = true) override;
+};
+
+// 批量报价类
+class AsyncClientCallMassQuote:public AbstractAsyncClientCall{
+private:
+	std::unique_ptr<ClientAsyncResponseReader<MassQuoteReply> > responder;
+	MassQuoteReply massQuoteReply_;
+public:
+	AsyncClientCallMassQuote(const MassQuoteRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	virtual void Proceed(bool ok = true) override;
+};
+
 // 提交订单类
 class AsyncClientCallPushNewOrder:public AbstractAsyncClientCall{
 private:
 	std::unique_ptr<ClientAsyncReaderWriter<NewOrderRequest, ExecutionReport> >responder_;
-	uint32_t counter;
+	uint64_t counter;
 	bool writing_mode_;
 	std::vector<NewOrderRequest> requests_;
+	// 二进制报单文件, 逐条转换后发送
+	std::shared_ptr<OrderFileReader> orderFile_;
+	NewOrderRequest request_;
+	// 报单时间, 每秒更新一次
+	time_t timeSecond_;
+	std::string timeStr_;
+	// 获取下一条待发送的请求
+	const NewOrderRequest* nextRequest();
+	void startCall(CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
 public:
 	AsyncClientCallPushNewOrder(std::vector<NewOrderRequest>&& requests, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	AsyncClientCallPushNewOrder(std::shared_ptr<OrderFileReader> orderFile, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
 	virtual void Proceed(bool ok = true) override;
 };
 
 // 查询订单类
-class AsyncClientCallPushQueryOrder:public AbstractAsyncClientCall{
+class AsyncClientCallQueryOrders:public AbstractAsyncClientCall{
 private:
-	std::unique_ptr< ClientAsyncReader<OrderReport> > responder;
-	uint64_t reportsCounter;
+	std::unique_ptr<ClientAsyncResponseReader<QueryOrderReply> > responder;
+	QueryOrderReply queryOrderReply_;
 public:
-	AsyncClientCallPushQueryOrder(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	AsyncClientCallQueryOrders(const QueryOrderRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
 	virtual void Proceed(bool ok = true) override;
 };
 
+// 深度订阅类: 持续读取服务端推送的深度快照, 直到服务端结束
+class AsyncClientCallSubscribeDepth:public AbstractAsyncClientCall{
+private:
+	std::unique_ptr< ClientAsyncReader<DepthUpdate> > responder;
+	DepthUpdate depthUpdate_;
+public:
+	AsyncClientCallSubscribeDepth(const DepthRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	virtual void Proceed(bool ok = true) override;
+};
+
+// 统计查询类
+class AsyncClientCallGetStats:public AbstractAsyncClientCall{
+private:
+	std::unique_ptr<ClientAsyncResponseReader<StatsReport> > responder;
+	StatsReport statsReport_;
+public:
+	AsyncClientCallGetStats(const StatsRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	virtual void Proceed(bool ok = true) override;
+};
+
+// 追踪导出类
+class AsyncClientCallDumpTrace:public AbstractAsyncClientCall{
+private:
+	std::unique_ptr<ClientAsyncResponseReader<TraceReply> > responder;
+	TraceReply traceReply_;
+public:
+	AsyncClientCallDumpTrace(const TraceRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_);
+	virtual void Proceed(bool ok = true) override;
+};
 
 // 客户端类
 class OPSClient{
@@ -104,8 +200,23 @@ public:
 	void PushNewOrder(const std::string& fileName);
 	// 撤销订单
 	void PushCancelOrder(const uint64_t& orderID);
-	// 查询订单
-	void PushQueryOrder();
+	// 改单: 数量或价格为0表示不变
+	void AmendOrder(const uint64_t& orderID, const uint32_t& qty, const double& price);
+	// 批量撤单: clientID为0不限用户, stockID为空不限股票
+	void MassCancel(const uint64_t& clientID, const std::string& stockID, const MassCancelRequest::Side& side);
+	// 集合竞价: 开始收单或撮合后恢复连续竞价
+	void Auction(const std::string& stockID, const AuctionRequest::Action& action);
+	// 批量报价: 整体替换该用户在报价文件中各股票上的双边报价
+	void MassQuote(const uint64_t& clientID, const std::string& fileName);
+	// 查询一页订单: clientID为0不限用户, stockID为空不限股票; cursor为上一页返回的游标, limit为0使用默认值
+	void QueryOrders(const uint64_t& clientID, const std::string& stockID, const QueryOrderRequest::Side& side,
+		const QueryOrderRequest::Status& status, const uint64_t& cursor, const uint32_t& limit);
+	// 订阅一只股票的档位深度: levels为每侧的档位数, 0为默认值
+	void SubscribeDepth(const std::string& stockID, const uint32_t& levels);
+	// 查询服务端统计
+	void GetStats();
+	// 导出服务端的订单生命周期追踪
+	void DumpTrace();
 	// 异步处理完成队列中的事件
 	void AsyncCompleteRpc();
 };
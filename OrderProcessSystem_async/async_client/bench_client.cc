@@ -0,0 +1,287 @@
+#include "bench_client.h"
+#include <iomanip>
+
+void BenchStats::merge(const BenchStats& other){
+	newCorrected.merge(other.newCorrected);
+	newRaw.merge(other.newRaw);
+	cancelCorrected.merge(other.cancelCorrected);
+	cancelRaw.merge(other.cancelRaw);
+	accepted+=other.accepted;
+	rejected+=other.rejected;
+	canceled+=other.canceled;
+	cancelRejected+=other.cancelRejected;
+	cancelSkipped+=other.cancelSkipped;
+	errors+=other.errors;
+}
+
+static uint64_t elapsedNanos(const BenchClock::time_point& from, const BenchClock::time_point& to){
+	return to>from?std::chrono::duration_cast<std::chrono::nanoseconds>(to-from).count():0;
+}
+
+BenchCall::BenchCall(BenchWorker* worker, const BenchClock::time_point& intended):
+	worker(worker), intended(intended), sent(BenchClock::now()){
+	// 超时保证压测结束时所有请求都能完成
+	context.set_deadline(std::chrono::system_clock::now()+std::chrono::seconds(worker->config.deadlineSeconds));
+}
+
+// 新订单
+BenchNewOrderCall::BenchNewOrderCall(BenchWorker* worker, const BenchClock::time_point& intended, const size_t& recordIndex,
+		OrderService::Stub* stub, CompletionQueue* cq):
+	BenchCall(worker, intended), callStatus(START), recordIndex(recordIndex){
+	responder=stub->PrepareAsyncPushNewOrder(&context, cq);
+	responder->StartCall((void*)this);
+}
+
+void BenchNewOrderCall::Proceed(bool ok){
+	if(callStatus==START){
+		if(!ok){
+			++worker->stats.errors;
+			callStatus=FINISH;
+			responder->Finish(&status, (void*)this);
+			return;
+		}
+		// 写入后立即半关闭, 服务端随即写回报
+		callStatus=WRITE;
+		responder->WriteLast(worker->workload.requests[recordIndex], grpc::WriteOptions(), (void*)this);
+	}else if(callStatus==WRITE){
+		if(!ok){
+			++worker->stats.errors;
+			callStatus=FINISH;
+			responder->Finish(&status, (void*)this);
+			return;
+		}
+		callStatus=READ;
+		responder->Read(&report, (void*)this);
+	}else if(callStatus==READ){
+		// 收到回报即打时间戳
+		BenchClock::time_point received=BenchClock::now();
+		if(ok){
+			worker->stats.newCorrected.record(elapsedNanos(intended, received));
+			worker->stats.newRaw.record(elapsedNanos(sent, received));
+			if(report.stat()==ExecutionReport::ORDER_REJECT){
+				++worker->stats.rejected;
+			}else{
+				// 其他订单的成交回报也可能先到达, 只有报单接受才加入可撤列表
+				++worker->stats.accepted;
+				if(report.stat()==ExecutionReport::ORDER_ACCEPT) worker->onAccepted(recordIndex, report.orderid());
+			}
+		}else{
+			++worker->stats.errors;
+		}
+		// 后续的成交回报不计入, 直接取消流
+		context.TryCancel();
+		callStatus=FINISH;
+		responder->Finish(&status, (void*)this);
+	}else{
+		worker->onFinished();
+		delete this;
+	}
+}
+
+// 撤单
+BenchCancelOrderCall::BenchCancelOrderCall(BenchWorker* worker, const BenchClock::time_point& intended, const uint64_t& orderID,
+		OrderService::Stub* stub, CompletionQueue* cq):
+	BenchCall(worker, intended){
+	responder=stub->PrepareAsyncPushCancelOrder(&context, MakeCancelOrderRequest(orderID), cq);
+	responder->StartCall();
+	responder->Finish(&report, &status, (void*)this);
+}
+
+void BenchCancelOrderCall::Proceed(bool ok){
+	BenchClock::time_point received=BenchClock::now();
+	if(ok&&status.ok()){
+		worker->stats.cancelCorrected.record(elapsedNanos(intended, received));
+		worker->stats.cancelRaw.record(elapsedNanos(sent, received));
+		if(report.stat()==ExecutionReport::CANCELED) ++worker->stats.canceled;
+		else ++worker->stats.cancelRejected;
+	}else{
+		++worker->stats.errors;
+	}
+	worker->onFinished();
+	delete this;
+}
+
+// 压测线程
+BenchWorker::BenchWorker(const BenchConfig& config, const int& index, std::shared_ptr<Channel> channel, BenchWorkload& workload):
+	config(config), index(index), stub(OrderService::NewStub(channel)), workload(workload), outstanding(0), newCount(0), cancelCount(0){}
+
+void BenchWorker::start(const BenchClock::time_point& startTime){
+	completer=std::thread(&BenchWorker::completeLoop, this);
+	sender=std::thread(&BenchWorker::sendLoop, this, startTime);
+}
+
+void BenchWorker::join(){
+	sender.join();
+	// 等待在途请求完成后关闭完成队列
+	while(outstanding.load()>0){
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	cq.Shutdown();
+	completer.join();
+}
+
+// 按排定时刻发送, 落后时不补睡眠, 直接追赶
+void BenchWorker::sendLoop(BenchClock::time_point startTime){
+	std::mt19937_64 rng(config.seed+index);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	auto interval=std::chrono::nanoseconds(static_cast<uint64_t>(1e9*config.threads/config.rate));
+	auto endTime=startTime+std::chrono::nanoseconds(static_cast<uint64_t>(config.seconds*1e9));
+	// 各线程错开发送时刻
+	BenchClock::time_point intended=startTime+interval*index/config.threads;
+	size_t next=index;
+	size_t recordCount=workload.records.size();
+	for(;intended<endTime;intended+=interval){
+		std::this_thread::sleep_until(intended);
+		uint64_t orderID=0;
+		if(config.cancelRatio>0&&uniform(rng)<config.cancelRatio&&takeCancelTarget(orderID)){
+			++outstanding;
+			new BenchCancelOrderCall(this, intended, orderID, stub.get(), &cq);
+			++cancelCount;
+			continue;
+		}
+		size_t recordIndex=next%recordCount;
+		next+=config.threads;
+		const OrderFileRecord& record=workload.records[recordIndex];
+		if(record.kind==RECORD_CANCEL_ORDER){
+			// 文件中的撤单, 被撤订单尚未确认时跳过
+			orderID=record.target<recordCount?workload.orderIDs[record.target].exchange(0):0;
+			if(orderID==0){
+				++stats.cancelSkipped;
+				continue;
+			}
+			++outstanding;
+			new BenchCancelOrderCall(this, intended, orderID, stub.get(), &cq);
+			++cancelCount;
+		}else{
+			++outstanding;
+			new BenchNewOrderCall(this, intended, recordIndex, stub.get(), &cq);
+			++newCount;
+		}
+	}
+}
+
+void BenchWorker::completeLoop(){
+	void* tag;
+	bool ok=false;
+	while(cq.Next(&tag, &ok)){
+		static_cast<BenchCall*>(tag)->Proceed(ok);
+	}
+}
+
+// 撤最早确认的订单
+bool BenchWorker::takeCancelTarget(uint64_t& orderID){
+	std::lock_guard<std::mutex> lock(acceptedMutex);
+	if(acceptedOrders.empty()) return false;
+	orderID=acceptedOrders.front();
+	acceptedOrders.pop_front();
+	return true;
+}
+
+void BenchWorker::onAccepted(const size_t& recordIndex, const uint64_t& orderID){
+	if(workload.hasCancels){
+		workload.orderIDs[recordIndex].store(orderID);
+	}
+	if(config.cancelRatio<=0) return;
+	std::lock_guard<std::mutex> lock(acceptedMutex);
+	acceptedOrders.push_back(orderID);
+}
+
+void BenchWorker::onFinished(){
+	--outstanding;
+}
+
+const BenchStats& BenchWorker::getStats() const{
+	return stats;
+}
+
+uint64_t BenchWorker::sentNew() const{
+	return newCount;
+}
+
+uint64_t BenchWorker::sentCancel() const{
+	return cancelCount;
+}
+
+// 读入报单文件
+bool loadBenchWorkload(const std::string& fileName, BenchWorkload& workload){
+	if(!loadOrderRecords(fileName, workload.records)||workload.records.empty()) return false;
+	std::string time=getTime();
+	size_t count=workload.records.size();
+	workload.requests.resize(count);
+	workload.orderIDs.reset(new std::atomic<uint64_t>[count]);
+	for(size_t i=0;i<count;i++){
+		workload.orderIDs[i].store(0);
+		if(workload.records[i].kind!=RECORD_NEW_ORDER){
+			workload.hasCancels=true;
+			continue;
+		}
+		orderRecordToRequest(workload.records[i], workload.requests[i]);
+		workload.requests[i].set_time(time);
+	}
+	return true;
+}
+
+// ./OPSAsyncClient bench <报单文件> [速率] [秒数] [线程数] [连接数] [撤单占比]
+int runBenchmark(int argc, char* argv[]){
+	if(argc<3){
+		std::cout<<"usage: ./OPSAsyncClient bench <orders file> [rate] [seconds] [threads] [channels] [cancel ratio]"<<std::endl;
+		return 1;
+	}
+	BenchConfig config;
+	config.ordersFile=argv[2];
+	if(argc>3) config.rate=std::stod(argv[3]);
+	if(argc>4) config.seconds=std::stod(argv[4]);
+	if(argc>5) config.threads=std::max(1, std::stoi(argv[5]));
+	if(argc>6) config.channels=std::max(1, std::stoi(argv[6]));
+	if(argc>7) config.cancelRatio=std::min(std::max(std::stod(argv[7]), 0.0), 1.0);
+	if(config.rate<=0||config.seconds<=0){
+		std::cout<<"rate and seconds must be positive"<<std::endl;
+		return 1;
+	}
+	BenchWorkload workload;
+	if(!loadBenchWorkload(config.ordersFile, workload)){
+		std::cout<<"Can not read: "<<config.ordersFile<<std::endl;
+		return 1;
+	}
+	// 每个连接使用独立的子通道池, 保证建立不同的TCP连接
+	std::vector<std::shared_ptr<Channel> > channels;
+	for(int i=0;i<config.channels;i++){
+		grpc::ChannelArguments args;
+		args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+		channels.push_back(grpc::CreateCustomChannel(config.target, grpc::InsecureChannelCredentials(), args));
+	}
+	std::vector<std::unique_ptr<BenchWorker> > workers;
+	for(int i=0;i<config.threads;i++){
+		workers.emplace_back(new BenchWorker(config, i, channels[i%config.channels], workload));
+	}
+	// 预留连接建立时间
+	for(auto& channel:channels){
+		channel->WaitForConnected(std::chrono::system_clock::now()+std::chrono::seconds(5));
+	}
+	BenchClock::time_point startTime=BenchClock::now()+std::chrono::milliseconds(100);
+	for(auto& worker:workers) worker->start(startTime);
+	BenchStats total;
+	uint64_t sentNew=0, sentCancel=0;
+	for(auto& worker:workers){
+		worker->join();
+		total.merge(worker->getStats());
+		sentNew+=worker->sentNew();
+		sentCancel+=worker->sentCancel();
+	}
+	double elapsed=std::chrono::duration<double>(BenchClock::now()-startTime).count();
+	std::cout<<std::fixed<<std::setprecision(3);
+	std::cout<<"Benchmark: "<<config.ordersFile<<", target rate "<<config.rate<<"/s, "<<config.seconds<<" s, threads "
+		<<config.threads<<", channels "<<config.channels<<", cancel ratio "<<config.cancelRatio<<std::endl;
+	std::cout<<"	sent: new "<<sentNew<<", cancel "<<sentCancel<<", achieved "<<(sentNew+sentCancel)/config.seconds
+		<<"/s, completed in "<<elapsed<<" s"<<std::endl;
+	std::cout<<"	new order: accepted "<<total.accepted<<", rejected "<<total.rejected
+		<<"; cancel: canceled "<<total.canceled<<", rejected "<<total.cancelRejected<<", skipped "<<total.cancelSkipped
+		<<"; errors "<<total.errors<<std::endl;
+	total.newCorrected.print(std::cout, "	new order latency(us, corrected)");
+	total.newRaw.print(std::cout, "	new order latency(us, uncorrected)");
+	if(sentCancel>0){
+		total.cancelCorrected.print(std::cout, "	cancel latency(us, corrected)");
+		total.cancelRaw.print(std::cout, "	cancel latency(us, uncorrected)");
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+#ifndef BENCH_CLIENT_H
+#define BENCH_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include "../helper/helper.h"
+#include "../helper/order_file.h"
+#include "../helper/histogram.h"
+
+#include <grpc++/grpc++.h>
+#include <grpc/support/log.h>
+#include "../proto/OrderProcessSystem.grpc.pb.h"
+
+/*****************************************************************************************
+ * 开环压测: 按目标速率预先排定每个请求的发送时刻, 发送不等待响应
+ * 延迟从排定时刻起算(修正协调遗漏), 同时记录从实际发送起算的延迟作对比
+ * 服务端在流半关闭后才写回报, 因此每个新订单使用一条独立的流, 收到首个回报后取消
+ ****************************************************************************************/
+
+using grpc::Channel;
+using grpc::ClientContext;
+using grpc::ClientAsyncReaderWriter;
+using grpc::ClientAsyncResponseReader;
+using grpc::CompletionQueue;
+using grpc::Status;
+
+using OPS::NewOrderRequest;
+using OPS::CancelOrderRequest;
+using OPS::ExecutionReport;
+using OPS::OrderService;
+
+typedef std::chrono::steady_clock BenchClock;
+
+// 压测参数
+struct BenchConfig{
+	std::string target="localhost:50010";
+	std::string ordersFile;
+	double rate=1000;          // 目标速率(请求/秒), 包含撤单
+	double seconds=10;         // 持续时间
+	int threads=1;             // 发送线程数, 每个线程有独立的完成队列
+	int channels=1;            // 连接数
+	double cancelRatio=0;      // 撤单占比
+	uint64_t seed=1;           // 随机种子
+	int deadlineSeconds=10;    // 单个请求的超时
+};
+
+// 压测负载: 报单文件中的记录及其对应的请求
+// 撤单记录引用文件内序号, 收到报单接受后记录订单ID, 各线程共享
+struct BenchWorkload{
+	std::vector<OrderFileRecord> records;
+	std::vector<NewOrderRequest> requests;
+	std::unique_ptr<std::atomic<uint64_t>[]> orderIDs;
+	bool hasCancels=false;
+};
+
+// 每个线程的统计, 除跳过的撤单数由发送线程累加外, 只由该线程的完成队列线程写入
+struct BenchStats{
+	LatencyHistogram newCorrected;
+	LatencyHistogram newRaw;
+	LatencyHistogram cancelCorrected;
+	LatencyHistogram cancelRaw;
+	uint64_t accepted=0;
+	uint64_t rejected=0;
+	uint64_t canceled=0;
+	uint64_t cancelRejected=0;
+	uint64_t cancelSkipped=0;
+	uint64_t errors=0;
+	void merge(const BenchStats&);
+};
+
+class BenchWorker;
+
+// 压测请求抽象类
+class BenchCall{
+public:
+	BenchCall(BenchWorker* worker, const BenchClock::time_point& intended);
+	virtual ~BenchCall(){}
+	virtual void Proceed(bool ok)=0;
+protected:
+	BenchWorker* worker;
+	ClientContext context;
+	Status status;
+	ExecutionReport report;
+	// 排定的发送时刻与实际发送时刻
+	BenchClock::time_point intended;
+	BenchClock::time_point sent;
+};
+
+// 新订单: 建流, 写入一条订单并半关闭, 读取首个回报
+class BenchNewOrderCall:public BenchCall{
+public:
+	BenchNewOrderCall(BenchWorker*, const BenchClock::time_point&, const size_t&, OrderService::Stub*, CompletionQueue*);
+	virtual void Proceed(bool ok) override;
+private:
+	enum CallStatus {START, WRITE, READ, FINISH};
+	CallStatus callStatus;
+	// 在报单文件中的序号
+	size_t recordIndex;
+	std::unique_ptr<ClientAsyncReaderWriter<NewOrderRequest, ExecutionReport> > responder;
+};
+
+// 撤单
+class BenchCancelOrderCall:public BenchCall{
+public:
+	BenchCancelOrderCall(BenchWorker*, const BenchClock::time_point&, const uint64_t&, OrderService::Stub*, CompletionQueue*);
+	virtual void Proceed(bool ok) override;
+private:
+	std::unique_ptr<ClientAsyncResponseReader<ExecutionReport> > responder;
+};
+
+// 压测线程: 一个发送线程按排定时刻发出请求, 一个线程处理完成队列
+class BenchWorker{
+public:
+	BenchWorker(const BenchConfig&, const int&, std::shared_ptr<Channel>, BenchWorkload&);
+	void start(const BenchClock::time_point&);
+	void join();
+	const BenchStats& getStats() const;
+	uint64_t sentNew() const;
+	uint64_t sentCancel() const;
+private:
+	friend class BenchCall;
+	friend class BenchNewOrderCall;
+	friend class BenchCancelOrderCall;
+	void sendLoop(BenchClock::time_point);
+	void completeLoop();
+	bool takeCancelTarget(uint64_t&);
+	// 由完成队列线程调用
+	void onAccepted(const size_t&, const uint64_t&);
+	void onFinished();
+	const BenchConfig& config;
+	int index;
+	std::unique_ptr<OrderService::Stub> stub;
+	CompletionQueue cq;
+	BenchWorkload& workload;
+	std::thread sender;
+	std::thread completer;
+	// 已确认可撤的订单
+	std::mutex acceptedMutex;
+	std::deque<uint64_t> acceptedOrders;
+	std::atomic<uint64_t> outstanding;
+	uint64_t newCount;
+	uint64_t cancelCount;
+	BenchStats stats;
+};
+
+// 读入报单文件(文本或二进制), 压测时循环使用
+bool loadBenchWorkload(const std::string&, BenchWorkload&);
+// 解析命令行参数并执行压测
+int runBenchmark(int argc, char* argv[]);
+#endif
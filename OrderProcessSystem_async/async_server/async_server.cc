@@ -6,7 +6,7 @@ CommonCallData::CommonCallData(OrderService::AsyncService* service, ServerComple
 
 // 处理新订单类
 CallDataPushNewOrder::CallDataPushNewOrder(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* tradingMarket):
-		CommonCallData(service, cq, tradingMarket), responder_(&ctx_), new_responder_created_(false), writing_mode_(false), RequestsCounter_(0), ReportsCounter_(0){
+		CommonCallData(service, cq, tradingMarket), responder_(&ctx_), new_responder_created_(false), writing_mode_(false), RequestsCounter_(0), ReportsCounter_(0), writeStart_(0){
 	Proceed();
 }
 
@@ -26,16 +26,23 @@ void CallDataPushNewOrder::Proceed(bool ok) {
 				ok=true;	
 			}else{
 				//std::cout<<"Reading request..."<<std::endl;
+				uint64_t readStart=stageNanos();
+				uint64_t readTsc=traceTimestamp();
 				responder_.Read(&newOrderRequest_, (void*)this);
 				// printRequest(newOrderRequest_);
 				if(newOrderRequest_.clientid()>0){
+					recordStageSince(STAGE_READ, readStart);
 					// std::cout<<1<<std::endl;
 					uint64_t orderID=marketSystem_->processCreateOrder(newOrderRequest_, reports_);
 					// std::cout<<2<<std::endl;
 					// std::cout<<orderID<<std::endl;
 					if(orderID>0){
+						traceOrderAt(readTsc, TRACE_RECEIVED, orderID);
 						// (orderID_responder_)[orderID]=&responder_;
-						Responders::add(orderID, &responder_);
+						// 市价单与IOC, FOK不挂单, 之后不会再有回报, 不登记回报流
+						if(restsOnBook(newOrderRequest_)){
+							Responders::add(orderID, &responder_);
+						}
 						// std::cout<<3<<std::endl;
 						marketSystem_->processNewOrder(newOrderRequest_, orderID, reports_);
 						// std::cout<<orderID<<"ok"<<std::endl;
@@ -45,25 +52,31 @@ void CallDataPushNewOrder::Proceed(bool ok) {
 			}		
 		}
 		if(writing_mode_){
+			// 上一条回报写完成
+			if(writeStart_>0){
+				recordStageSince(STAGE_REPORT_WRITE, writeStart_);
+				writeStart_=0;
+			}
+			ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>* stream=&responder_;
+			// 跳过无法找到流的消息
+			while(ok&&ReportsCounter_<reports_.size()&&reports_[ReportsCounter_].first!=0
+					&&!Responders::get(reports_[ReportsCounter_].first, stream)){
+				++ReportsCounter_;
+			}
 			if(!ok||ReportsCounter_>=reports_.size()){
 				//status_=FINISH;
 				//responder_.Finish(Status(), (void*)this);	
 			}else{
-				auto& orderID= reports_[ReportsCounter_].first;
 				auto& report=reports_[ReportsCounter_].second;
 				// printReport(report);
-				if(orderID==0){
-					responder_.Write(report, (void*)this);
-				}else{
-					ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>* stream;
-					Responders::get(orderID, stream);
-					stream->Write(report, (void*)this);
-				}
+				writeStart_=stageNanos();
+				traceOrder(TRACE_REPORT_WRITTEN, report.orderid(), 0, report.fillqty());
+				stream->Write(report, (void*)this);
 				++ReportsCounter_;
 			}
 		}
 	}else{
-		std::cout<<"Delete!"<<std::endl;
+		LOG_DEBUG("PushNewOrder call finished");
 		// delete this;
 	}	
 }
@@ -91,12 +104,153 @@ void CallDataPushCancelOrder::Proceed(bool ok) {
 	}
 }
 
-// 处理查询订单
+// 处理改单, 原位修改挂单, 不更换订单ID与回报流
+CallDataAmendOrder::CallDataAmendOrder(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+		CommonCallData(service, cq, marketSystem), responder_(&ctx_){
+	Proceed();
+}
+
+void CallDataAmendOrder::Proceed(bool ok){
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestAmendOrder(&ctx_, &amendOrderRequest_, &responder_, cq_, cq_, this);
+	}else if(status_==PROCESS){
+		new CallDataAmendOrder(service_, cq_, marketSystem_);
+		initReport(report_, amendOrderRequest_);
+		marketSystem_->processAmendOrder(amendOrderRequest_, report_);
+		status_=FINISH;
+		responder_.Finish(report_, Status::OK, this);
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 处理批量撤单, 一次引擎操作撤销全部匹配的挂单
+CallDataMassCancel::CallDataMassCancel(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+		CommonCallData(service, cq, marketSystem), responder_(&ctx_){
+	Proceed();
+}
+
+void CallDataMassCancel::Proceed(bool ok){
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestMassCancel(&ctx_, &massCancelRequest_, &responder_, cq_, cq_, this);
+	}else if(status_==PROCESS){
+		new CallDataMassCancel(service_, cq_, marketSystem_);
+		marketSystem_->processMassCancel(massCancelRequest_, massCancelReply_);
+		status_=FINISH;
+		responder_.Finish(massCancelReply_, Status::OK, this);
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 处理集合竞价, 成交回报经模拟撮合的推送流写给各订单
+CallDataAuction::CallDataAuction(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+		CommonCallData(service, cq, marketSystem), responder_(&ctx_){
+	Proceed();
+}
+
+void CallDataAuction::Proceed(bool ok){
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestAuction(&ctx_, &auctionRequest_, &responder_, cq_, cq_, this);
+	}else if(status_==PROCESS){
+		new CallDataAuction(service_, cq_, marketSystem_);
+		marketSystem_->processAuction(auctionRequest_, auctionReply_);
+		status_=FINISH;
+		responder_.Finish(auctionReply_, Status::OK, this);
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 处理批量报价, 一批报价一个确认; 报价订单没有回报流, 成交由下次报价确认中的剩余数量体现
+CallDataMassQuote::CallDataMassQuote(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+		CommonCallData(service, cq, marketSystem), responder_(&ctx_){
+	Proceed();
+}
+
+void CallDataMassQuote::Proceed(bool ok){
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestMassQuote(&ctx_, &massQuoteRequest_, &responder_, cq_, cq_, this);
+	}else if(status_==PROCESS){
+		new CallDataMassQuote(service_, cq_, marketSystem_);
+		marketSystem_->processMassQuote(massQuoteRequest_, massQuoteReply_);
+		status_=FINISH;
+		responder_.Finish(massQuoteReply_, Status::OK, this);
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 处理统计查询
+CallDataGetStats::CallDataGetStats(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+		CommonCallData(service, cq, marketSystem), responder_(&ctx_){
+	Proceed();
+}
+
+void CallDataGetStats::Proceed(bool ok){
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestGetStats(&ctx_, &statsRequest_, &responder_, cq_, cq_, this);
+	}else if(status_==PROCESS){
+		new CallDataGetStats(service_, cq_, marketSystem_);
+		marketSystem_->processGetStats(statsRequest_, statsReport_);
+		status_=FINISH;
+		responder_.Finish(statsReport_, Status::OK, this);
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 导出订单生命周期追踪, 文件写在服务端的数据目录
+CallDataDumpTrace::CallDataDumpTrace(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+		CommonCallData(service, cq, marketSystem), responder_(&ctx_){
+	Proceed();
+}
+
+void CallDataDumpTrace::Proceed(bool ok){
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestDumpTrace(&ctx_, &traceRequest_, &responder_, cq_, cq_, this);
+	}else if(status_==PROCESS){
+		new CallDataDumpTrace(service_, cq_, marketSystem_);
+		std::string fileName=traceFileName(DATA_DIR);
+		int64_t events=dumpOrderTrace(fileName);
+		if(events<0){
+			traceReply_.set_errormessage("Can not write trace: "+fileName);
+		}else{
+			traceReply_.set_filename(fileName);
+			traceReply_.set_events(events);
+		}
+		status_=FINISH;
+		responder_.Finish(traceReply_, Status::OK, this);
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 处理查询订单(已弃用), 与QueryOrders使用同样的筛选条件, 由服务端翻页推送全部订单
 CallDataPushQueryOrder::CallDataPushQueryOrder(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
 	CommonCallData(service, cq, marketSystem), responder_(&ctx_), new_responder_created_(false), reportsCounter_(0){
 		Proceed();
 }
 
+void CallDataPushQueryOrder::nextPage(){
+	page_.Clear();
+	marketSystem_->processQueryOrder(queryOrderRequest_, page_);
+	queryOrderRequest_.set_cursor(page_.nextcursor());
+	reportsCounter_=0;
+}
+
 void CallDataPushQueryOrder::Proceed(bool ok){
 	if(status_ == CREATE){
 		status_ = PROCESS ;
@@ -106,14 +260,23 @@ void CallDataPushQueryOrder::Proceed(bool ok){
 		if(!new_responder_created_){
 			new CallDataPushQueryOrder(service_, cq_, marketSystem_);
 			new_responder_created_ = true ;
-			marketSystem_->processQueryOrder(queryOrderRequest_, queryOrderReports_);
+			nextPage();
+		}else if(!ok){
+			// 写失败说明客户端已断开
+			status_ = FINISH;
+			responder_.Finish(Status::CANCELLED, (void*)this);
+			return;
 		}
-		if(reportsCounter_ >= queryOrderReports_.size()){
+		// 本页推送完后取下一页; 筛选条件较严时可能取到空页, 游标为0时已没有更多订单
+		while(reportsCounter_>=page_.orders_size()&&page_.nextcursor()!=0){
+			nextPage();
+		}
+		if(reportsCounter_>=page_.orders_size()){
 			status_ = FINISH;
 			responder_.Finish(Status(), (void*)this);
 		}
 		else{
-			responder_.Write(queryOrderReports_[reportsCounter_], (void*)this);
+			responder_.Write(page_.orders(reportsCounter_), (void*)this);
 			++reportsCounter_;
 		}
 	}
@@ -122,6 +285,88 @@ void CallDataPushQueryOrder::Proceed(bool ok){
 	}
 }
 
+// 处理查询订单, 按筛选条件与游标返回一页, 调用方用应答中的游标继续翻页
+CallDataQueryOrders::CallDataQueryOrders(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+		CommonCallData(service, cq, marketSystem), responder_(&ctx_){
+	Proceed();
+}
+
+void CallDataQueryOrders::Proceed(bool ok){
+	if(status_==CREATE){
+		status_=PROCESS;
+		service_->RequestQueryOrders(&ctx_, &queryOrderRequest_, &responder_, cq_, cq_, this);
+	}else if(status_==PROCESS){
+		new CallDataQueryOrders(service_, cq_, marketSystem_);
+		marketSystem_->processQueryOrder(queryOrderRequest_, queryOrderReply_);
+		status_=FINISH;
+		responder_.Finish(queryOrderReply_, Status::OK, this);
+	}else{
+		GPR_ASSERT(status_==FINISH);
+		delete this;
+	}
+}
+
+// 处理深度订阅
+CallDataSubscribeDepth::CallDataSubscribeDepth(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
+	CommonCallData(service, cq, marketSystem), responder_(&ctx_), new_responder_created_(false), writing_(false), version_(0),
+	interval_(DEPTH_INTERVAL_MILLIS){
+		Proceed();
+}
+
+void CallDataSubscribeDepth::publish(){
+	marketSystem_->processGetDepth(depthRequest_, depthUpdate_);
+	version_=depthUpdate_.version();
+	lastWrite_=std::chrono::steady_clock::now();
+	writing_=true;
+	responder_.Write(depthUpdate_, (void*)this);
+}
+
+void CallDataSubscribeDepth::Proceed(bool ok){
+	if(status_ == CREATE){
+		status_ = PROCESS ;
+		service_->RequestSubscribeDepth(&ctx_, &depthRequest_, &responder_, cq_, cq_, this);
+	}else if(status_ == PROCESS){
+		if(!new_responder_created_){
+			new CallDataSubscribeDepth(service_, cq_, marketSystem_);
+			new_responder_created_ = true ;
+			std::string errorMessage;
+			if(!checkStockID(depthRequest_.stockid(), errorMessage)){
+				marketSystem_->processGetDepth(depthRequest_, depthUpdate_);
+				status_ = FINISH;
+				responder_.WriteAndFinish(depthUpdate_, grpc::WriteOptions(), Status(), (void*)this);
+				return;
+			}
+			// 订阅后先推送一次当前快照
+			publish();
+			return;
+		}
+		// 写失败说明订阅者已断开
+		if(!ok){
+			status_ = FINISH;
+			responder_.Finish(Status::CANCELLED, (void*)this);
+			return;
+		}
+		auto heartbeat=std::chrono::milliseconds(DEPTH_HEARTBEAT_MILLIS);
+		if(writing_){
+			// 写完成, 间隔后再检查
+			writing_=false;
+		}else if(marketSystem_->depthVersion(depthRequest_.stockid())!=version_){
+			interval_=std::chrono::milliseconds(DEPTH_INTERVAL_MILLIS);
+			publish();
+			return;
+		}else if(std::chrono::steady_clock::now()-lastWrite_>=heartbeat){
+			publish();
+			return;
+		}else{
+			// 没有变化, 检查间隔加倍, 不超过心跳间隔
+			interval_=std::min(interval_*2, heartbeat);
+		}
+		alarm_.Set(cq_, std::chrono::system_clock::now()+interval_, (void*)this);
+	}else if(status_ == FINISH){
+		delete this;
+	}
+}
+
 // 处理查询模拟撮合结果
 CallDataPushSendMessage::CallDataPushSendMessage(OrderService::AsyncService* service, ServerCompletionQueue* cq, MarketSystem* marketSystem):
 	CommonCallData(service, cq, marketSystem), responder_(&ctx_), new_responder_created_(false), ReportsCounter_(0){
@@ -139,17 +384,19 @@ void CallDataPushSendMessage::Proceed(bool ok){
 			new_responder_created_ = true ;
 			marketSystem_->getMathchReports(reports_);
 		}
+		// 获取读写流, 跳过无法找到流的消息
+		ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>* stream=nullptr;
+		while(ReportsCounter_<reports_.size()&&!Responders::get(reports_[ReportsCounter_].orderid(), stream)){
+			++ReportsCounter_;
+		}
 		if(ReportsCounter_>=reports_.size()){
 			status_ = FINISH;
 			responder_.Finish(Status(), (void*)this);
 		}else{
 			auto report=reports_[ReportsCounter_];
-			auto orderID=report.orderid();
-			// 获取读写流
-			ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>* stream;
-			Responders::get(orderID, stream);
 			// E0819 13:08:21.206054622   17285 proto_buffer_writer.h:65]   assertion failed: !byte_buffer->Valid()
 			// 已放弃 (核心已转储)
+			traceOrder(TRACE_REPORT_WRITTEN, report.orderid(), 0, report.fillqty());
 			stream->Write(report, (void*)this);
 			++ReportsCounter_;
 		}
@@ -161,15 +408,32 @@ void CallDataPushSendMessage::Proceed(bool ok){
 void ServerImpl::getSimulateMatchReports(){
 	LoopRequest loopRequest(grpc::CreateChannel("localhost:50010", grpc::InsecureChannelCredentials()));
 	std::thread thread_=std::thread(&LoopRequest::AsyncCompleteRpc, &loopRequest);
+	// 有新的模拟撮合消息时才发起推送, 不再定时轮询
+	uint64_t seen=0;
 	while(1){
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		seen=marketSystem_->waitMatchReports(seen, std::chrono::milliseconds(-1));
+		std::this_thread::sleep_for(std::chrono::microseconds(MATCH_REPORT_BATCH_MICROS));
 		loopRequest.PushSendMessage();
 	}
 	thread_.join();
 }
 
+// 定期生成快照
+void ServerImpl::takeSnapshots(){
+	while(1){
+		std::this_thread::sleep_for(std::chrono::seconds(SNAPSHOT_INTERVAL));
+		marketSystem_->takeSnapshot(SNAPSHOT_FILE);
+	}
+}
+
 // 服务端类
-void ServerImpl::Run(){
+bool ServerImpl::Run(){
+	// 从最近的快照和日志尾部恢复; 日志无法写入时拒绝启动, 不接收无法恢复的订单
+	mkdir(DATA_DIR, 0755);
+	if(!marketSystem_->recover(SNAPSHOT_FILE, JOURNAL_FILE)){
+		LOG_ERROR("Recovery failed, server not started");
+		return false;
+	}
 	std::string server_address("0.0.0.0:50010");
 	ServerBuilder builder;
 	builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -178,14 +442,16 @@ void ServerImpl::Run(){
 	// 建立完成队列
 	cq_=builder.AddCompletionQueue();
 	server_=builder.BuildAndStart();
-	std::cout<<"Server listening on: "<<server_address<<std::endl;	
+	LOG_INFO("Server listening on: {}", server_address);
 	std::thread thread1=std::thread(&ServerImpl::getSimulateMatchReports, this);
+	std::thread thread2=std::thread(&ServerImpl::takeSnapshots, this);
 	// 处理服务器的主循环
 	for(int i=0;i<9;i++){
 		// 创建多线程处理
 		std::thread thread_=std::thread(&ServerImpl::HandleRpcs, this);
 		thread_.join();
 	}
+	return true;
 }
 
 // 主循环
@@ -193,8 +459,16 @@ void ServerImpl::HandleRpcs(){
 	// 注册请求处理
 	new CallDataPushNewOrder(&service_, cq_.get(), marketSystem_);
 	new CallDataPushCancelOrder(&service_, cq_.get(), marketSystem_);
+	new CallDataAmendOrder(&service_, cq_.get(), marketSystem_);
+	new CallDataMassCancel(&service_, cq_.get(), marketSystem_);
+	new CallDataAuction(&service_, cq_.get(), marketSystem_);
+	new CallDataMassQuote(&service_, cq_.get(), marketSystem_);
 	new CallDataPushQueryOrder(&service_, cq_.get(), marketSystem_);
+	new CallDataQueryOrders(&service_, cq_.get(), marketSystem_);
 	new CallDataPushSendMessage(&service_, cq_.get(), marketSystem_);
+	new CallDataSubscribeDepth(&service_, cq_.get(), marketSystem_);
+	new CallDataGetStats(&service_, cq_.get(), marketSystem_);
+	new CallDataDumpTrace(&service_, cq_.get(), marketSystem_);
 	void* tag;
 	bool ok;
 	// 从完成队列中取出请求处理
@@ -208,7 +482,20 @@ void ServerImpl::HandleRpcs(){
 }
 
 int main(int argc, char** argv) {
+  // 两个导出线程用sigwait接收信号: 在创建任何线程之前一次屏蔽两个信号, 之后的线程(包括导出线程)都继承,
+  // 信号只会交给等待它的导出线程, 不会按默认动作结束进程
+  sigset_t dumpSignals;
+  sigemptyset(&dumpSignals);
+  sigaddset(&dumpSignals, SIGUSR1);
+  sigaddset(&dumpSignals, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &dumpSignals, nullptr);
+  // 以LOCK_PROFILE=1编译时, kill -USR1 <pid>输出锁竞争统计
+  startLockProfileDumper(SIGUSR1);
+  // 订单生命周期追踪, 环境变量OPS_TRACE_SAMPLE指定抽样间隔(0关闭); kill -USR2 <pid>导出至数据目录
+  const char* traceSample=getenv("OPS_TRACE_SAMPLE");
+  setTraceSampling(traceSample!=nullptr?std::strtoull(traceSample, nullptr, 10):TRACE_DEFAULT_SAMPLE);
+  mkdir(DATA_DIR, 0755);
+  startTraceDumper(SIGUSR2, DATA_DIR);
   ServerImpl server;
-  server.Run();
-  return 0;
+  return server.Run()?0:1;
 }
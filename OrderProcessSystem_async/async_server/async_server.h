@@ -16,11 +16,17 @@
 #include <boost/type_traits.hpp>
 #include <cmath>
 #include <assert.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <cstdlib>
 #include "../helper/helper.h"
+#include "../helper/lock_profile.h"
+#include "../helper/order_trace.h"
 #include "../market/market_system.h"
 #include "loop_request.h"
 
 #include <grpc++/grpc++.h>
+#include <grpcpp/alarm.h>
 #include <grpc/support/log.h>
 #include "../proto/OrderProcessSystem.grpc.pb.h"
 
@@ -36,30 +42,60 @@ using grpc::Status;
 
 using OPS::NewOrderRequest;
 using OPS::CancelOrderRequest;
+using OPS::AmendOrderRequest;
+using OPS::MassCancelRequest;
+using OPS::MassCancelReply;
+using OPS::AuctionRequest;
+using OPS::AuctionReply;
+using OPS::MassQuoteRequest;
+using OPS::MassQuoteReply;
+using OPS::DepthRequest;
+using OPS::DepthUpdate;
 using OPS::QueryOrderRequest;
+using OPS::QueryOrderReply;
 using OPS::SendMessageRequest;
+using OPS::StatsRequest;
+using OPS::StatsReport;
+using OPS::TraceRequest;
+using OPS::TraceReply;
 using OPS::ExecutionReport;
 using OPS::OrderReport;
 using OPS::OrderService;
 
+// 快照与日志文件
+#define DATA_DIR "./data"
+#define SNAPSHOT_FILE "./data/snapshot.bin"
+#define JOURNAL_FILE "./data/journal.bin"
+// 快照间隔(秒)
+#define SNAPSHOT_INTERVAL 60
+// 收到模拟撮合通知后等待同批消息的时间(微秒), 合并为一次推送
+#define MATCH_REPORT_BATCH_MICROS 1000
+// 深度订阅: 一次推送完成后检查挂单簿版本号的最短间隔(毫秒), 期间的变化合并为一次推送; 没有变化时间隔逐次加倍, 直到心跳间隔
+#define DEPTH_INTERVAL_MILLIS 10
+// 深度订阅: 挂单簿没有变化时重发当前快照的间隔(毫秒), 借此发现已断开的订阅者
+#define DEPTH_HEARTBEAT_MILLIS 1000
+
 class Responders{
 private:
-	static std::shared_mutex* rw_lock;
+	static ProfiledSharedMutex* rw_lock;
 	static std::unordered_map<uint64_t, ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>*> orderID_responder_;
 	// Responders(){}
 public:
 	static void add(const uint64_t& orderID, ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>* responder_){
-		std::unique_lock<std::shared_mutex> w(*rw_lock);
+		std::unique_lock<ProfiledSharedMutex> w(*rw_lock);
 		orderID_responder_[orderID]=responder_;
 	}
-	static void get(const uint64_t& orderID, ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>*& responder_){
-		std::shared_lock<std::shared_mutex> r(*rw_lock);
-		if(orderID_responder_.count(orderID)) responder_=orderID_responder_.at(orderID);
-		else std::cout<<"bug"<<std::endl;
+	// 订单无对应的流(如重启前提交的订单)时返回false
+	static bool get(const uint64_t& orderID, ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>*& responder_){
+		std::shared_lock<ProfiledSharedMutex> r(*rw_lock);
+		auto it=orderID_responder_.find(orderID);
+		if(it==orderID_responder_.end()) return false;
+		responder_=it->second;
+		return true;
 	}
 };
 
-std::shared_mutex* Responders::rw_lock=new std::shared_mutex();
+ProfiledSharedMutex* Responders::rw_lock=new ProfiledSharedMutex("Responders::rw_lock");
 std::unordered_map<uint64_t, ServerAsyncReaderWriter<ExecutionReport, NewOrderRequest>*> Responders::orderID_responder_;
 
 // 基类
@@ -96,6 +132,8 @@ private:
 	uint32_t RequestsCounter_;
 	uint32_t ReportsCounter_;
 	std::vector<std::pair<uint64_t, ExecutionReport> > reports_;
+	// 上一次写回报的时刻, 为0表示没有进行中的写
+	uint64_t writeStart_;
 public:
 	CallDataPushNewOrder(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
 	virtual void Proceed(bool =true) override;
@@ -111,18 +149,119 @@ public:
 	virtual void Proceed(bool = true) override;
 };
 
-// 处理查询订单
+// 处理改单
+class CallDataAmendOrder:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<ExecutionReport> responder_;
+	AmendOrderRequest amendOrderRequest_;
+public:
+	CallDataAmendOrder(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 处理批量撤单
+class CallDataMassCancel:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<MassCancelReply> responder_;
+	MassCancelRequest massCancelRequest_;
+	MassCancelReply massCancelReply_;
+public:
+	CallDataMassCancel(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 处理集合竞价
+class CallDataAuction:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<AuctionReply> responder_;
+	AuctionRequest auctionRequest_;
+	AuctionReply auctionReply_;
+public:
+	CallDataAuction(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 处理批量报价
+class CallDataMassQuote:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<MassQuoteReply> responder_;
+	MassQuoteRequest massQuoteRequest_;
+	MassQuoteReply massQuoteReply_;
+public:
+	CallDataMassQuote(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 处理统计查询
+class CallDataGetStats:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<StatsReport> responder_;
+	StatsRequest statsRequest_;
+	StatsReport statsReport_;
+public:
+	CallDataGetStats(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 导出订单生命周期追踪
+class CallDataDumpTrace:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<TraceReply> responder_;
+	TraceRequest traceRequest_;
+	TraceReply traceReply_;
+public:
+	CallDataDumpTrace(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 处理查询订单(已弃用): 按游标逐页取出订单依次推送, 同一时刻只持有一页
 class CallDataPushQueryOrder:public CommonCallData{
 private:
 	ServerAsyncWriter<OrderReport> responder_;
 	bool new_responder_created_;
-	uint32_t reportsCounter_;
-	std::vector<OrderReport> queryOrderReports_;
+	int reportsCounter_;
+	QueryOrderReply page_;
+	// 取游标处的下一页
+	void nextPage();
 public:
 	CallDataPushQueryOrder(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
 	virtual void Proceed(bool =true) override;
 };
 
+// 处理查询订单, 一次应答一页
+class CallDataQueryOrders:public CommonCallData{
+private:
+	ServerAsyncResponseWriter<QueryOrderReply> responder_;
+	QueryOrderReply queryOrderReply_;
+public:
+	CallDataQueryOrders(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool = true) override;
+};
+
+// 处理深度订阅
+// 只保存上次推送的版本号, 不为订阅者排队: 上一次写完成后才取最新的快照, 慢消费者收到的快照更少, 撮合不受影响
+class CallDataSubscribeDepth:public CommonCallData{
+private:
+	ServerAsyncWriter<DepthUpdate> responder_;
+	DepthRequest depthRequest_;
+	DepthUpdate depthUpdate_;
+	// 推送间隔与心跳的定时器, 到期时回到完成队列
+	grpc::Alarm alarm_;
+	bool new_responder_created_;
+	// 是否有未完成的写, 否则是定时器到期
+	bool writing_;
+	// 上次推送的版本号与时刻
+	uint64_t version_;
+	std::chrono::steady_clock::time_point lastWrite_;
+	// 当前的检查间隔, 有变化时恢复为最短间隔
+	std::chrono::milliseconds interval_;
+	// 取最新的快照推送
+	void publish();
+public:
+	CallDataSubscribeDepth(OrderService::AsyncService*, ServerCompletionQueue*, MarketSystem*);
+	virtual void Proceed(bool =true) override;
+};
+
 // 处理模拟撮合订单
 class CallDataPushSendMessage:public CommonCallData{
 private:
@@ -142,11 +281,13 @@ public:
 		marketSystem_=MarketSystem::getInstance();
 	}
 	~ServerImpl(){
-		server_->Shutdown();
-		cq_->Shutdown();	
+		// 恢复失败时服务未启动
+		if(server_) server_->Shutdown();
+		if(cq_) cq_->Shutdown();
 		delete marketSystem_;
 	}
-	void Run();
+	// 恢复失败返回false, 不启动服务
+	bool Run();
 private:
 	std::unique_ptr<ServerCompletionQueue> cq_;
  	OrderService::AsyncService service_;
@@ -154,5 +295,7 @@ private:
 	MarketSystem* marketSystem_;
 	void HandleRpcs();
 	void getSimulateMatchReports();
+	// 定期生成快照
+	void takeSnapshots();
 };
 #endif
\ No newline at end of file
@@ -2,8 +2,10 @@
 // 发送消息类
 PushSendMessageCall::PushSendMessageCall(const SendMessageRequest& request, CompletionQueue& cq_, std::unique_ptr<OrderService::Stub>& stub_):
 	AbstractLoopCall(), reportsCounter(0){
-		responder = stub_->AsyncPushSendMessage(&context, request, &cq_, (void*)this);
 		callStatus = PROCESS ;
+		// 先保存responder再启动调用, 避免完成事件先于赋值到达
+		responder = stub_->PrepareAsyncPushSendMessage(&context, request, &cq_);
+		responder->StartCall((void*)this);
 }
 
 void PushSendMessageCall::Proceed(bool ok){
@@ -0,0 +1,383 @@
+#include <vector>
+#include <atomic>
+#include <random>
+#include <benchmark/benchmark.h>
+#include "../helper/helper.h"
+#include "../market/order_system.h"
+#include "../market/market_system.h"
+#include "../timer/timer.h"
+
+/*****************************************************************************************
+ * 撮合引擎与计时器的微基准测试, 按挂单数量(参数)和线程数参数化
+ * 每个基准在Setup中建立独立的对象并填充挂单, 多线程共享同一对象以体现锁竞争
+ * 需要成对操作维持规模的基准按批处理: 批内计时, 批间暂停计时做反向操作
+ * make bench 输出JSON结果, 便于比较不同版本
+ ****************************************************************************************/
+
+// 每批操作数
+static const size_t kBatch=1024;
+// 挂单所属的客户数
+static const uint64_t kClients=64;
+// 压测线程使用的客户ID起点, 与挂单客户不重叠, 避免触发对敲检查
+static const uint64_t kThreadClientBase=1000;
+
+static NewOrderRequest makeLimitOrder(const bool& sell, const uint64_t& clientID, const double& price, const uint32_t& qty){
+    return MakeNewOrderRequest(TYPE_LIMIT, sell, clientID, "600030", qty, price);
+}
+
+/***************************************************************************************
+                                		OrderSystem
+****************************************************************************************/
+static OrderSystem* orderSystem=nullptr;
+static std::atomic<uint64_t> nextOrderID(1);
+
+// 每个客户的卖单价格在[50, 60), 买单价格在[40, 50)
+static void SetupOrderSystem(const benchmark::State& state){
+    orderSystem=new OrderSystem();
+    std::mt19937_64 rng(1);
+    uint64_t bookSize=state.range(0);
+    for(uint64_t i=1;i<=bookSize;i++){
+        bool sell=i&1;
+        double price=(sell?50:40)+static_cast<double>(rng()%1000)/100;
+        orderSystem->insertOrder(i, makeLimitOrder(sell, 1+i%kClients, price, 100));
+    }
+    nextOrderID=bookSize+1;
+}
+
+static void TeardownOrderSystem(const benchmark::State&){
+    delete orderSystem;
+    orderSystem=nullptr;
+}
+
+// 每个线程预先构造的请求
+static std::vector<NewOrderRequest> makeThreadRequests(){
+    std::vector<NewOrderRequest> requests;
+    for(size_t i=0;i<kBatch;i++){
+        requests.push_back(makeLimitOrder(i&1, 1+i%kClients, (i&1?50:40)+static_cast<double>(i%1000)/100, 100));
+    }
+    return requests;
+}
+
+static void BM_OrderSystem_InsertOrder(benchmark::State& state){
+    std::vector<NewOrderRequest> requests=makeThreadRequests();
+    std::vector<uint64_t> ids;
+    ids.reserve(kBatch);
+    for(auto _:state){
+        uint64_t orderID=nextOrderID++;
+        orderSystem->insertOrder(orderID, requests[ids.size()]);
+        ids.push_back(orderID);
+        if(ids.size()==kBatch){
+            state.PauseTiming();
+            for(auto id:ids) orderSystem->deleteOrder(id);
+            ids.clear();
+            state.ResumeTiming();
+        }
+    }
+    for(auto id:ids) orderSystem->deleteOrder(id);
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_OrderSystem_DeleteOrder(benchmark::State& state){
+    std::vector<NewOrderRequest> requests=makeThreadRequests();
+    std::vector<uint64_t> ids;
+    size_t next=kBatch;
+    for(auto _:state){
+        if(next==kBatch){
+            state.PauseTiming();
+            ids.clear();
+            for(size_t i=0;i<kBatch;i++){
+                ids.push_back(nextOrderID++);
+                orderSystem->insertOrder(ids.back(), requests[i]);
+            }
+            next=0;
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(orderSystem->deleteOrder(ids[next++]));
+    }
+    for(;next<ids.size();next++) orderSystem->deleteOrder(ids[next]);
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_OrderSystem_GetOrderInfo(benchmark::State& state){
+    uint64_t bookSize=state.range(0);
+    std::mt19937_64 rng(state.thread_index()+1);
+    NewOrderRequest info;
+    for(auto _:state){
+        benchmark::DoNotOptimize(orderSystem->getOrderInfo(1+rng()%bookSize, info));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 成交后数量会减为0, 此后的成交数量为0, 但加锁与回报生成的路径相同
+static void BM_OrderSystem_TradingOrders(benchmark::State& state){
+    uint64_t bookSize=state.range(0);
+    std::mt19937_64 rng(state.thread_index()+1);
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    for(auto _:state){
+        // 奇数为卖单, 偶数为买单
+        uint64_t sellOrderID=1+2*(rng()%((bookSize+1)/2));
+        uint64_t buyOrderID=2+2*(rng()%std::max<uint64_t>(1, bookSize/2));
+        auto* sellOrder=orderSystem->findOrder(sellOrderID);
+        auto* buyOrder=orderSystem->findOrder(buyOrderID);
+        if(sellOrder!=nullptr&&buyOrder!=nullptr) orderSystem->tradingOrders(sellOrder, buyOrder, true, reports);
+        reports.clear();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_OrderSystem_IsImproperMatchedOrder(benchmark::State& state){
+    std::mt19937_64 rng(state.thread_index()+1);
+    std::vector<NewOrderRequest> requests;
+    for(size_t i=0;i<kBatch;i++){
+        // 价格落在对手方区间之外, 走完整的检查路径
+        requests.push_back(makeLimitOrder(i&1, 1+rng()%kClients, i&1?60.5:39.5, 100));
+    }
+    size_t next=0;
+    for(auto _:state){
+        benchmark::DoNotOptimize(orderSystem->isImproperMatchedOrder(requests[next]));
+        next=(next+1)%kBatch;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/***************************************************************************************
+                                		MarketSystem
+****************************************************************************************/
+static MarketSystem* market=nullptr;
+
+// 填充卖单, 数量足够大, 作为对手方时不会被吃完
+static void populateSellBook(const uint64_t& bookSize, const double& price){
+    market=new MarketSystem(false);
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    for(uint64_t i=0;i<bookSize;i++){
+        NewOrderRequest request=makeLimitOrder(true, 1+i%kClients, price, 1000000000);
+        uint64_t orderID=market->processCreateOrder(request, reports);
+        if(orderID>0) market->processNewOrder(request, orderID, reports);
+        reports.clear();
+    }
+}
+
+// 卖单价格高于新买单, 新买单不与任何档位交叉, 直接挂单
+static void SetupPassiveBook(const benchmark::State& state){
+    populateSellBook(state.range(0), 100.0);
+}
+
+// 卖单价格低于新买单, 新买单与第一个卖单成交
+static void SetupCrossingBook(const benchmark::State& state){
+    populateSellBook(state.range(0), 10.0);
+}
+
+static void TeardownMarket(const benchmark::State&){
+    delete market;
+    market=nullptr;
+}
+
+// 下单并撮合, 返回订单ID
+static uint64_t submitOrder(const NewOrderRequest& request, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+    uint64_t orderID=market->processCreateOrder(request, reports);
+    if(orderID>0) market->processNewOrder(request, orderID, reports);
+    reports.clear();
+    return orderID;
+}
+
+static void cancelOrders(const std::vector<uint64_t>& ids){
+    ExecutionReport report;
+    for(auto id:ids){
+        market->processCancelOrder(MakeCancelOrderRequest(id), report);
+    }
+}
+
+// 不成交的新买单, 每批结束后撤单以维持买容器规模
+static void BM_Market_ProcessNewOrderPassive(benchmark::State& state){
+    NewOrderRequest request=makeLimitOrder(false, kThreadClientBase+state.thread_index(), 5.0, 100);
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    std::vector<uint64_t> ids;
+    ids.reserve(kBatch);
+    for(auto _:state){
+        ids.push_back(submitOrder(request, reports));
+        if(ids.size()==kBatch){
+            state.PauseTiming();
+            cancelOrders(ids);
+            ids.clear();
+            state.ResumeTiming();
+        }
+    }
+    cancelOrders(ids);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 立即全部成交的新买单
+static void BM_Market_ProcessNewOrderCrossing(benchmark::State& state){
+    NewOrderRequest request=makeLimitOrder(false, kThreadClientBase+state.thread_index(), 11.0, 1);
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    for(auto _:state){
+        submitOrder(request, reports);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_Market_ProcessCancelOrder(benchmark::State& state){
+    NewOrderRequest request=makeLimitOrder(false, kThreadClientBase+state.thread_index(), 5.0, 100);
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    std::vector<CancelOrderRequest> cancels;
+    ExecutionReport report;
+    size_t next=kBatch;
+    for(auto _:state){
+        if(next==kBatch){
+            state.PauseTiming();
+            cancels.clear();
+            for(size_t i=0;i<kBatch;i++){
+                cancels.push_back(MakeCancelOrderRequest(submitOrder(request, reports)));
+            }
+            next=0;
+            state.ResumeTiming();
+        }
+        market->processCancelOrder(cancels[next++], report);
+    }
+    ExecutionReport rest;
+    for(;next<cancels.size();next++) market->processCancelOrder(cancels[next], rest);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 改价: 每个线程一个买单在两个价位之间来回改价, 每次换档位
+static void BM_Market_ProcessAmendOrder(benchmark::State& state){
+    NewOrderRequest request=makeLimitOrder(false, kThreadClientBase+state.thread_index(), 5.0, 100);
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    uint64_t orderID=submitOrder(request, reports);
+    AmendOrderRequest amends[2]={MakeAmendOrderRequest(orderID, 0, 4.99), MakeAmendOrderRequest(orderID, 0, 5.0)};
+    ExecutionReport report;
+    size_t next=0;
+    for(auto _:state){
+        market->processAmendOrder(amends[next], report);
+        next^=1;
+    }
+    cancelOrders({orderID});
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 与改价对照: 撤单后以新价格重新下单
+static void BM_Market_CancelAndNewOrder(benchmark::State& state){
+    NewOrderRequest requests[2]={makeLimitOrder(false, kThreadClientBase+state.thread_index(), 4.99, 100),
+        makeLimitOrder(false, kThreadClientBase+state.thread_index(), 5.0, 100)};
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    uint64_t orderID=submitOrder(requests[1], reports);
+    ExecutionReport report;
+    size_t next=0;
+    for(auto _:state){
+        market->processCancelOrder(MakeCancelOrderRequest(orderID), report);
+        orderID=submitOrder(requests[next], reports);
+        next^=1;
+    }
+    cancelOrders({orderID});
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_Market_ProcessQueryOrder(benchmark::State& state){
+    QueryOrderRequest request=MakeQueryOrderRequest();
+    QueryOrderReply reply;
+    for(auto _:state){
+        market->processQueryOrder(request, reply);
+        reply.Clear();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/***************************************************************************************
+                                		TaskList
+****************************************************************************************/
+static TaskList* taskList=nullptr;
+static std::atomic<uint64_t> nextTaskID(1);
+// 预先填充的任务句柄, 订单ID为下标加一
+static std::vector<TaskNode*> setupTasks;
+
+// 时间戳为1的任务均已到期
+static void SetupTaskList(const benchmark::State& state){
+    taskList=new TaskList();
+    uint64_t size=state.range(0);
+    setupTasks.assign(size, nullptr);
+    for(uint64_t i=1;i<=size;i++){
+        taskList->addTask(i, setupTasks[i-1], 1);
+    }
+    nextTaskID=size+1;
+}
+
+static void TeardownTaskList(const benchmark::State&){
+    delete taskList;
+    taskList=nullptr;
+}
+
+// 每个线程的任务句柄, 生命周期覆盖整个基准
+static std::vector<TaskNode*> makeTaskSlots(){
+    return std::vector<TaskNode*>(kBatch, nullptr);
+}
+
+static void BM_TaskList_AddTask(benchmark::State& state){
+    std::vector<TaskNode*> slots=makeTaskSlots();
+    size_t next=0;
+    for(auto _:state){
+        taskList->addTask(nextTaskID++, slots[next++]);
+        if(next==kBatch){
+            state.PauseTiming();
+            for(auto& slot:slots) taskList->delTask(slot);
+            next=0;
+            state.ResumeTiming();
+        }
+    }
+    for(auto& slot:slots) taskList->delTask(slot);
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_TaskList_DelTask(benchmark::State& state){
+    std::vector<TaskNode*> slots=makeTaskSlots();
+    size_t next=kBatch;
+    for(auto _:state){
+        if(next==kBatch){
+            state.PauseTiming();
+            for(auto& slot:slots) taskList->addTask(nextTaskID++, slot);
+            next=0;
+            state.ResumeTiming();
+        }
+        taskList->delTask(slots[next++]);
+    }
+    for(auto& slot:slots) taskList->delTask(slot);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 取出到期的首个任务, 每批结束后放回链表尾部
+static void BM_TaskList_GetFirstTask(benchmark::State& state){
+    std::vector<uint64_t> ids;
+    ids.reserve(kBatch);
+    for(auto _:state){
+        uint64_t orderID=0;
+        if(taskList->getFirstTask(orderID)) ids.push_back(orderID);
+        if(ids.size()==kBatch){
+            state.PauseTiming();
+            for(auto id:ids) taskList->addTask(id, setupTasks[id-1], 1);
+            ids.clear();
+            state.ResumeTiming();
+        }
+    }
+    for(auto id:ids) taskList->addTask(id, setupTasks[id-1], 1);
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 挂单数量与线程数
+#define OPS_BENCH_PARAMS(setup, teardown) \
+    Setup(setup)->Teardown(teardown)->ArgName("book")->Arg(256)->Arg(4096)->Arg(65536)->ThreadRange(1, 8)->UseRealTime()
+
+BENCHMARK(BM_OrderSystem_InsertOrder)->OPS_BENCH_PARAMS(SetupOrderSystem, TeardownOrderSystem);
+BENCHMARK(BM_OrderSystem_DeleteOrder)->OPS_BENCH_PARAMS(SetupOrderSystem, TeardownOrderSystem);
+BENCHMARK(BM_OrderSystem_GetOrderInfo)->OPS_BENCH_PARAMS(SetupOrderSystem, TeardownOrderSystem);
+BENCHMARK(BM_OrderSystem_TradingOrders)->OPS_BENCH_PARAMS(SetupOrderSystem, TeardownOrderSystem);
+BENCHMARK(BM_OrderSystem_IsImproperMatchedOrder)->OPS_BENCH_PARAMS(SetupOrderSystem, TeardownOrderSystem);
+BENCHMARK(BM_Market_ProcessNewOrderPassive)->OPS_BENCH_PARAMS(SetupPassiveBook, TeardownMarket);
+BENCHMARK(BM_Market_ProcessNewOrderCrossing)->OPS_BENCH_PARAMS(SetupCrossingBook, TeardownMarket);
+BENCHMARK(BM_Market_ProcessCancelOrder)->OPS_BENCH_PARAMS(SetupPassiveBook, TeardownMarket);
+BENCHMARK(BM_Market_ProcessAmendOrder)->OPS_BENCH_PARAMS(SetupPassiveBook, TeardownMarket);
+BENCHMARK(BM_Market_CancelAndNewOrder)->OPS_BENCH_PARAMS(SetupPassiveBook, TeardownMarket);
+BENCHMARK(BM_Market_ProcessQueryOrder)->OPS_BENCH_PARAMS(SetupPassiveBook, TeardownMarket);
+BENCHMARK(BM_TaskList_AddTask)->OPS_BENCH_PARAMS(SetupTaskList, TeardownTaskList);
+BENCHMARK(BM_TaskList_DelTask)->OPS_BENCH_PARAMS(SetupTaskList, TeardownTaskList);
+BENCHMARK(BM_TaskList_GetFirstTask)->OPS_BENCH_PARAMS(SetupTaskList, TeardownTaskList);
+
+BENCHMARK_MAIN();
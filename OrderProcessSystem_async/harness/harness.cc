@@ -0,0 +1,249 @@
+#ifndef HARNESS_CC
+#define HARNESS_CC
+#include "harness.h"
+
+void HarnessStats::merge(const HarnessStats& other){
+    newLatency.merge(other.newLatency);
+    cancelLatency.merge(other.cancelLatency);
+    queryLatency.merge(other.queryLatency);
+    amendLatency.merge(other.amendLatency);
+    newWait.merge(other.newWait);
+    cancelWait.merge(other.cancelWait);
+    queryWait.merge(other.queryWait);
+    amendWait.merge(other.amendWait);
+    accepted+=other.accepted;
+    rejected+=other.rejected;
+    fills+=other.fills;
+    canceled+=other.canceled;
+    cancelRejected+=other.cancelRejected;
+    queries+=other.queries;
+    amended+=other.amended;
+    amendRejected+=other.amendRejected;
+    totalNanos+=other.totalNanos;
+    totalWaitNanos+=other.totalWaitNanos;
+}
+
+// 墙钟时间与线程CPU时间(纳秒)
+static uint64_t wallNanos(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t cpuNanos(){
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+// 记录一次操作的耗时与离开CPU的时间
+class OperationTimer{
+public:
+    OperationTimer(LatencyHistogram& latency, LatencyHistogram& wait, HarnessStats& stats):
+        latency(latency), wait(wait), stats(stats), wallStart(wallNanos()), cpuStart(cpuNanos()){}
+    ~OperationTimer(){
+        uint64_t cpu=cpuNanos()-cpuStart;
+        uint64_t wall=wallNanos()-wallStart;
+        uint64_t offCpu=wall>cpu?wall-cpu:0;
+        latency.record(wall);
+        wait.record(offCpu);
+        stats.totalNanos+=wall;
+        stats.totalWaitNanos+=offCpu;
+    }
+private:
+    LatencyHistogram& latency;
+    LatencyHistogram& wait;
+    HarnessStats& stats;
+    uint64_t wallStart;
+    uint64_t cpuStart;
+};
+
+HarnessProducer::HarnessProducer(MarketSystem& market, const HarnessConfig& config, const int& index,
+        const std::vector<NewOrderRequest>& requests, std::atomic<bool>& stop):
+    market(market), config(config), index(index), requests(requests), stop(stop), next(index){}
+
+void HarnessProducer::start(){
+    thread=std::thread(&HarnessProducer::run, this);
+}
+
+void HarnessProducer::join(){
+    thread.join();
+}
+
+const HarnessStats& HarnessProducer::getStats() const{
+    return stats;
+}
+
+void HarnessProducer::run(){
+    std::mt19937_64 rng(config.seed+index);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    while(!stop.load(std::memory_order_relaxed)){
+        double u=uniform(rng);
+        if(u<config.queryRatio){
+            submitQuery();
+        }else if(u<config.queryRatio+config.cancelRatio&&!resting.empty()){
+            submitCancel();
+        }else if(u<config.queryRatio+config.cancelRatio+config.amendRatio&&!resting.empty()){
+            submitAmend();
+        }else{
+            submitNew();
+        }
+    }
+}
+
+// 各线程按序号交错使用报单文件中的订单
+void HarnessProducer::submitNew(){
+    const NewOrderRequest& request=requests[next%requests.size()];
+    next+=config.threads;
+    uint64_t orderID=0;
+    {
+        OperationTimer timer(stats.newLatency, stats.newWait, stats);
+        orderID=market.processCreateOrder(request, reports);
+        if(orderID>0) market.processNewOrder(request, orderID, reports);
+    }
+    if(orderID>0){
+        ++stats.accepted;
+        resting.push_back(orderID);
+    }else{
+        ++stats.rejected;
+    }
+    for(const auto& [id, report]:reports){
+        if(report.stat()==ExecutionReport::FILL) ++stats.fills;
+    }
+    reports.clear();
+}
+
+// 撤最早提交的订单, 已成交的订单撤单失败
+void HarnessProducer::submitCancel(){
+    CancelOrderRequest request=MakeCancelOrderRequest(resting.front());
+    resting.pop_front();
+    ExecutionReport report;
+    initReport(report, request);
+    {
+        OperationTimer timer(stats.cancelLatency, stats.cancelWait, stats);
+        market.processCancelOrder(request, report);
+    }
+    if(report.stat()==ExecutionReport::CANCELED) ++stats.canceled;
+    else ++stats.cancelRejected;
+}
+
+// 改最近提交的订单: 奇数次减量一股(保留时间优先), 偶数次把价格下调一分(换档位)
+// 已成交, 价格交叉或对敲的改单失败
+void HarnessProducer::submitAmend(){
+    uint64_t orderID=resting.back();
+    const NewOrderRequest& original=requests[(next+requests.size()-config.threads)%requests.size()];
+    bool sizeDown=(stats.amended+stats.amendRejected)%2==1;
+    uint32_t qty=sizeDown&&original.orderqty()>1?original.orderqty()-1:0;
+    double price=sizeDown?0:std::max(original.price()-0.01, 0.01);
+    AmendOrderRequest request=MakeAmendOrderRequest(orderID, qty, price);
+    ExecutionReport report;
+    initReport(report, request);
+    {
+        OperationTimer timer(stats.amendLatency, stats.amendWait, stats);
+        market.processAmendOrder(request, report);
+    }
+    if(report.stat()==ExecutionReport::REPLACED) ++stats.amended;
+    else ++stats.amendRejected;
+}
+
+void HarnessProducer::submitQuery(){
+    QueryOrderRequest request=MakeQueryOrderRequest();
+    QueryOrderReply reply;
+    {
+        OperationTimer timer(stats.queryLatency, stats.queryWait, stats);
+        market.processQueryOrder(request, reply);
+    }
+    ++stats.queries;
+}
+
+// ./Harness <报单文件> [线程数] [秒数] [撤单占比] [查询占比] [计时器 0/1] [改单占比]
+int main(int argc, char* argv[]){
+    if(argc<2){
+        std::cout<<"usage: ./Harness <orders file> [threads] [seconds] [cancel ratio] [query ratio] [timer 0/1] [amend ratio]"<<std::endl;
+        return 1;
+    }
+    HarnessConfig config;
+    config.ordersFile=argv[1];
+    if(argc>2) config.threads=std::max(1, std::stoi(argv[2]));
+    if(argc>3) config.seconds=std::stod(argv[3]);
+    if(argc>4) config.cancelRatio=std::min(std::max(std::stod(argv[4]), 0.0), 1.0);
+    if(argc>5) config.queryRatio=std::min(std::max(std::stod(argv[5]), 0.0), 1.0);
+    if(argc>6) config.runTimer=std::stoi(argv[6])!=0;
+    if(argc>7) config.amendRatio=std::min(std::max(std::stod(argv[7]), 0.0), 1.0);
+    // 读入新订单, 撤单由生产者线程针对自己的挂单生成
+    std::vector<OrderFileRecord> records;
+    if(!loadOrderRecords(config.ordersFile, records)){
+        std::cout<<"Can not read: "<<config.ordersFile<<std::endl;
+        return 1;
+    }
+    std::vector<NewOrderRequest> requests;
+    std::string time=getTime();
+    for(const auto& record:records){
+        if(record.kind!=RECORD_NEW_ORDER) continue;
+        requests.emplace_back();
+        orderRecordToRequest(record, requests.back());
+        requests.back().set_time(time);
+    }
+    if(requests.empty()){
+        std::cout<<"No orders in: "<<config.ordersFile<<std::endl;
+        return 1;
+    }
+
+    // 独立实例, 由参数决定是否运行计时器线程
+    MarketSystem market(config.runTimer);
+    std::atomic<bool> stop(false);
+    // 与服务端一样在有新消息时取走模拟撮合的回报, 避免堆积
+    uint64_t matchReports=0;
+    std::thread drainer([&](){
+        std::vector<ExecutionReport> reports;
+        uint64_t seen=0;
+        while(!stop.load()){
+            seen=market.waitMatchReports(seen, std::chrono::milliseconds(100));
+            market.getMathchReports(reports);
+            matchReports+=reports.size();
+            reports.clear();
+        }
+    });
+    std::vector<std::unique_ptr<HarnessProducer> > producers;
+    for(int i=0;i<config.threads;i++){
+        producers.emplace_back(new HarnessProducer(market, config, i, requests, stop));
+    }
+    auto startTime=std::chrono::steady_clock::now();
+    for(auto& producer:producers) producer->start();
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    stop=true;
+    HarnessStats total;
+    for(auto& producer:producers){
+        producer->join();
+        total.merge(producer->getStats());
+    }
+    double elapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-startTime).count();
+    drainer.join();
+    market.stopTimer();
+
+    uint64_t newOrders=total.accepted+total.rejected;
+    uint64_t cancels=total.canceled+total.cancelRejected;
+    uint64_t amends=total.amended+total.amendRejected;
+    std::cout<<std::fixed<<std::setprecision(3);
+    std::cout<<"Harness: "<<config.ordersFile<<", threads "<<config.threads<<", "<<config.seconds<<" s, cancel ratio "
+        <<config.cancelRatio<<", query ratio "<<config.queryRatio<<", amend ratio "<<config.amendRatio<<", timer "<<(config.runTimer?"on":"off")<<std::endl;
+    std::cout<<"	new: "<<newOrders<<" (accepted "<<total.accepted<<", rejected "<<total.rejected<<", fills "<<total.fills
+        <<"), cancel: "<<cancels<<" (canceled "<<total.canceled<<", rejected "<<total.cancelRejected<<"), amend: "<<amends
+        <<" (amended "<<total.amended<<", rejected "<<total.amendRejected<<"), query: "<<total.queries<<", simulation match reports: "<<matchReports<<std::endl;
+    std::cout<<"	throughput: "<<newOrders/elapsed<<" orders/s, "<<(newOrders+cancels+amends+total.queries)/elapsed<<" ops/s"<<std::endl;
+    total.newLatency.print(std::cout, "	new order latency(us)");
+    total.cancelLatency.print(std::cout, "	cancel latency(us)");
+    total.queryLatency.print(std::cout, "	query latency(us)");
+    total.amendLatency.print(std::cout, "	amend latency(us)");
+    total.newWait.print(std::cout, "	new order lock wait(us)");
+    total.cancelWait.print(std::cout, "	cancel lock wait(us)");
+    total.queryWait.print(std::cout, "	query lock wait(us)");
+    total.amendWait.print(std::cout, "	amend lock wait(us)");
+    std::cout<<"	lock wait share: "<<(total.totalNanos>0?100.0*total.totalWaitNanos/total.totalNanos:0)<<"%"<<std::endl;
+    // 引擎内各阶段的耗时
+    StageStatsSnapshot stages;
+    stages.collect();
+    stages.print(std::cout);
+    // 以LOCK_PROFILE=1编译时输出每个锁的统计
+    dumpLockProfile(std::cout);
+    return 0;
+}
+#endif
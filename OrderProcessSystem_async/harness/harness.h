@@ -0,0 +1,88 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <time.h>
+#include "../helper/helper.h"
+#include "../helper/order_file.h"
+#include "../helper/histogram.h"
+#include "../helper/lock_profile.h"
+#include "../helper/stage_stats.h"
+#include "../market/market_system.h"
+
+/*****************************************************************************************
+ * 进程内吞吐测试: 直接创建MarketSystem, 由多个生产者线程混合提交新订单, 撤单, 改单与查询
+ * 不经过gRPC, 用于单独衡量撮合引擎的可扩展性
+ * 锁等待以每次操作的墙钟时间减去线程CPU时间估计: 引擎路径内没有IO(未打开日志),
+ * 线程离开CPU基本是阻塞在锁上; 单核机器上被抢占的时间也会计入
+ ****************************************************************************************/
+
+// 测试参数
+struct HarnessConfig{
+    std::string ordersFile;
+    int threads=4;
+    double seconds=10;
+    double cancelRatio=0.2;    // 撤单占比
+    double queryRatio=0.001;   // 查询占比(查询遍历全部订单, 开销大)
+    double amendRatio=0;       // 改单占比(交替减量与改价)
+    bool runTimer=true;        // 是否启动计时器线程进行模拟撮合
+    uint64_t seed=1;
+};
+
+// 每个生产者线程的统计
+struct HarnessStats{
+    LatencyHistogram newLatency;
+    LatencyHistogram cancelLatency;
+    LatencyHistogram queryLatency;
+    LatencyHistogram amendLatency;
+    // 离开CPU的时间(近似锁等待)
+    LatencyHistogram newWait;
+    LatencyHistogram cancelWait;
+    LatencyHistogram queryWait;
+    LatencyHistogram amendWait;
+    uint64_t accepted=0;
+    uint64_t rejected=0;
+    uint64_t fills=0;
+    uint64_t canceled=0;
+    uint64_t cancelRejected=0;
+    uint64_t queries=0;
+    uint64_t amended=0;
+    uint64_t amendRejected=0;
+    uint64_t totalNanos=0;
+    uint64_t totalWaitNanos=0;
+    void merge(const HarnessStats&);
+};
+
+// 生产者线程
+class HarnessProducer{
+public:
+    HarnessProducer(MarketSystem&, const HarnessConfig&, const int&, const std::vector<NewOrderRequest>&, std::atomic<bool>&);
+    void start();
+    void join();
+    const HarnessStats& getStats() const;
+private:
+    void run();
+    void submitNew();
+    void submitCancel();
+    void submitQuery();
+    void submitAmend();
+    MarketSystem& market;
+    const HarnessConfig& config;
+    int index;
+    const std::vector<NewOrderRequest>& requests;
+    std::atomic<bool>& stop;
+    std::thread thread;
+    size_t next;
+    // 本线程提交且仍可能挂单的订单
+    std::deque<uint64_t> resting;
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    HarnessStats stats;
+};
+#endif
@@ -0,0 +1,93 @@
+#ifndef EPOCH_CC
+#define EPOCH_CC
+#include "epoch.h"
+#include <mutex>
+#include <vector>
+
+// 每个线程的纪元槽位, 0表示不在读端临界区
+struct alignas(64) EpochSlot{
+	std::atomic<uint64_t> epoch;
+	// 嵌套深度, 只由所属线程访问
+	uint32_t depth;
+	EpochSlot(): epoch(0), depth(0){}
+};
+
+struct RetiredObject{
+	void* object;
+	void (*deleter)(void*);
+	uint64_t epoch;
+};
+
+// 全局纪元从1开始, 0留给空闲槽位
+static std::atomic<uint64_t> globalEpoch(1);
+
+// 全部线程的槽位与退休对象; 线程退出后槽位保留(已清零)
+static std::mutex& registryMutex(){
+	static std::mutex* m=new std::mutex();
+	return *m;
+}
+
+static std::vector<EpochSlot*>& registry(){
+	static auto* r=new std::vector<EpochSlot*>();
+	return *r;
+}
+
+static std::vector<RetiredObject>& retiredObjects(){
+	static auto* r=new std::vector<RetiredObject>();
+	return *r;
+}
+
+static EpochSlot* localSlot(){
+	static thread_local EpochSlot* slot=nullptr;
+	if(slot==nullptr){
+		slot=new EpochSlot();
+		std::unique_lock<std::mutex> w(registryMutex());
+		registry().push_back(slot);
+	}
+	return slot;
+}
+
+// 进入时先发布纪元再读被保护的指针, 二者都是顺序一致的, 写者扫描槽位时不会漏掉本线程
+EpochGuard::EpochGuard(){
+	EpochSlot* slot=localSlot();
+	if(slot->depth++==0){
+		slot->epoch.store(globalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+	}
+}
+
+EpochGuard::~EpochGuard(){
+	EpochSlot* slot=localSlot();
+	if(--slot->depth==0){
+		slot->epoch.store(0, std::memory_order_release);
+	}
+}
+
+// 调用方需持有registryMutex
+static size_t reclaimLocked(){
+	uint64_t oldest=UINT64_MAX;
+	for(const EpochSlot* slot:registry()){
+		uint64_t epoch=slot->epoch.load(std::memory_order_seq_cst);
+		if(epoch!=0&&epoch<oldest) oldest=epoch;
+	}
+	std::vector<RetiredObject>& retired=retiredObjects();
+	size_t kept=0;
+	for(size_t i=0;i<retired.size();i++){
+		// 纪元不大于退休纪元的读者可能仍持有旧指针
+		if(retired[i].epoch<oldest) retired[i].deleter(retired[i].object);
+		else retired[kept++]=retired[i];
+	}
+	retired.resize(kept);
+	return kept;
+}
+
+void retireObject(void* object, void (*deleter)(void*)){
+	std::unique_lock<std::mutex> w(registryMutex());
+	retiredObjects().push_back(RetiredObject{object, deleter, globalEpoch.fetch_add(1, std::memory_order_seq_cst)});
+	reclaimLocked();
+}
+
+size_t reclaimRetired(){
+	std::unique_lock<std::mutex> w(registryMutex());
+	return reclaimLocked();
+}
+#endif
@@ -0,0 +1,36 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/*****************************************************************************************
+ * 基于纪元的内存回收, 用于读多写少的共享结构(如股票索引): 写者复制修改后原子替换指针,
+ * 旧对象交给retire, 等所有可能读到它的读者离开后再释放
+ * 读者进入时把全局纪元记到本线程的槽位, 离开时清零; 槽位各占一个缓存行, 读者之间不共享写
+ * 写者退休对象时记下当前纪元并推进全局纪元, 槽位中的纪元都大于它(或为0)时即可释放
+ * 写者替换指针与读者在临界区内读取指针都必须是顺序一致的(memory_order_seq_cst),
+ * 与槽位的发布和扫描构成全序; 读者用acquire读取时可能读到旧指针而写者扫描不到它的纪元
+ ****************************************************************************************/
+
+// 读端临界区, 可嵌套; 期间读到的被保护指针保持有效
+class EpochGuard{
+public:
+	EpochGuard();
+	~EpochGuard();
+	EpochGuard(const EpochGuard&)=delete;
+	EpochGuard& operator=(const EpochGuard&)=delete;
+};
+
+// 退休对象, 没有读者能再访问时调用deleter释放; 必须在替换指针之后调用
+void retireObject(void*, void (*)(void*));
+
+template<typename T>
+void retire(T* object){
+	retireObject(object, [](void* p){ delete static_cast<T*>(p); });
+}
+
+// 释放已无读者的退休对象, 返回尚未释放的个数
+size_t reclaimRetired();
+#endif
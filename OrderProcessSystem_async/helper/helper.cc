@@ -1,6 +1,7 @@
 #ifndef HELPER_CC
 #define HELPER_CC
 #include "helper.h"
+#include <limits>
 
 // 获取时间
 std::string getTime(){
@@ -16,92 +17,263 @@ uint64_t getTimestamp(){
 	return t.time*1000+t.millitm;
 }
 
+// 复制字符串至定长字符数组
+void copyFixedString(char* dst, const size_t& size, const std::string& src){
+	memset(dst, 0, size);
+	memcpy(dst, src.data(), std::min(src.size(), size-1));
+}
+
+// 从定长字符数组读取字符串
+std::string readFixedString(const char* src, const size_t& size){
+	return std::string(src, strnlen(src, size));
+}
 
+// 输出函数先拼成一个字符串, 整条消息只写出并刷新一次
 void printRequest(const NewOrderRequest& request){
-	std::cout<<"报单请求: "<<std::endl;
-	std::cout<<"	客户ID: "<<request.clientid()<<", "<<std::endl;
-	if(request.direction()==NewOrderRequest::SELL) std::cout<<"	订单类型: [SELL]"<<", "<<std::endl;
-	else std::cout<<"	订单类型: [BUY]"<<", "<<std::endl;
-	std::cout<<"	股票ID: "<<request.stockid()<<", "<<std::endl;
-	std::cout<<"	订单数量: "<<request.orderqty()<<", "<<std::endl;
-	std::cout<<"	订单价格: "<<request.price()<<", "<<std::endl;
-	if(request.ordertype()==NewOrderRequest::LIMIT) std::cout<<"	价格类型: [LIMIT]"<<", "<<std::endl;
-	else std::cout<<"	价格类型: [CURRENT]"<<", "<<std::endl;
-	std::cout<<"	报单时间: "<<request.time();
-	std::cout<<std::endl;
+	std::ostringstream out;
+	out<<"报单请求: \n";
+	out<<"	客户ID: "<<request.clientid()<<", \n";
+	if(request.direction()==NewOrderRequest::SELL) out<<"	订单类型: [SELL], \n";
+	else out<<"	订单类型: [BUY], \n";
+	out<<"	股票ID: "<<request.stockid()<<", \n";
+	out<<"	订单数量: "<<request.orderqty()<<", \n";
+	out<<"	订单价格: "<<request.price()<<", \n";
+	if(request.ordertype()==NewOrderRequest::LIMIT) out<<"	价格类型: [LIMIT], \n";
+	else out<<"	价格类型: [CURRENT], \n";
+	out<<"	有效期: ["<<NewOrderRequest::TimeInForce_Name(request.timeinforce())<<"], \n";
+	if(request.stopprice()>0) out<<"	止损价: "<<request.stopprice()<<", \n";
+	out<<"	报单时间: "<<request.time();
+	out<<"\n";
+	std::cout<<out.str()<<std::flush;
 }
 
 void printRequest(const CancelOrderRequest& request){
-	std::cout<<"撤单请求: "<<std::endl;
-	std::cout<<"	订单ID: "<<request.orderid()<<", "<<std::endl;
-	std::cout<<"	撤单时间:  "<<request.time();
-	std::cout<<std::endl;
+	std::ostringstream out;
+	out<<"撤单请求: \n";
+	out<<"	订单ID: "<<request.orderid()<<", \n";
+	out<<"	撤单时间:  "<<request.time();
+	out<<"\n";
+	std::cout<<out.str()<<std::flush;
 }
 
 void printReport(const ExecutionReport& report){
-	std::cout<<"执行结果: "<<std::endl;
+	std::ostringstream out;
+	out<<"执行结果: \n";
 	if(report.stat()==ExecutionReport::ORDER_ACCEPT){
-		std::cout<<"	[报单接受 ORDER_ACCEPT]"<<", "<<std::endl;
+		out<<"	[报单接受 ORDER_ACCEPT], \n";
 	}else if(report.stat()==ExecutionReport::ORDER_REJECT){
-		std::cout<<"	[报单拒绝 ORDER_REJECT]"<<", "<<std::endl;
+		out<<"	[报单拒绝 ORDER_REJECT], \n";
 	}else if(report.stat()==ExecutionReport::FILL){
-		std::cout<<"	[交易成功 FILL]"<<", "<<std::endl;
+		out<<"	[交易成功 FILL], \n";
 	}else if(report.stat()==ExecutionReport::CANCELED){
-		std::cout<<"	[订单取消 CANCELED]"<<", "<<std::endl;
+		out<<"	[订单取消 CANCELED], \n";
+	}else if(report.stat()==ExecutionReport::REPLACED){
+		out<<"	[改单成功 REPLACED], \n";
+	}else if(report.stat()==ExecutionReport::REPLACE_REJECT){
+		out<<"	[改单拒绝 REPLACE_REJECT], \n";
+	}else if(report.stat()==ExecutionReport::TRIGGERED){
+		out<<"	[止损触发 TRIGGERED], \n";
 	}else{
-		std::cout<<"	[撤单拒绝 CANCEL_REJECT]"<<", "<<std::endl;
+		out<<"	[撤单拒绝 CANCEL_REJECT], \n";
 	}
 	if(report.errormessage().size()>0){
-		std::cout<<"	错误信息: "<<report.errormessage()<<", "<<std::endl;
+		out<<"	错误信息: "<<report.errormessage()<<", \n";
 	}
 	else{
-		std::cout<<"	客户ID: "<<report.clientid()<<", "<<std::endl;
-		std::cout<<"	订单ID: "<<report.orderid()<<", "<<std::endl;
-		std::cout<<"	股票ID: "<<report.stockid()<<", "<<std::endl;
-		std::cout<<"	订单数量: "<<report.orderqty()<<", "<<std::endl;
-		std::cout<<"	订单价格: "<<report.orderprice()<<", "<<std::endl;
-		std::cout<<"	交易数量: "<<report.fillqty()<<", "<<std::endl;
-		std::cout<<"	交易价格: "<<report.fillprice()<<", "<<std::endl;
-		std::cout<<"	剩余数量: "<<report.leaveqty()<<", "<<std::endl;
-		std::cout<<"	交易时间: "<<report.time();
+		out<<"	客户ID: "<<report.clientid()<<", \n";
+		out<<"	订单ID: "<<report.orderid()<<", \n";
+		out<<"	股票ID: "<<report.stockid()<<", \n";
+		out<<"	订单数量: "<<report.orderqty()<<", \n";
+		out<<"	订单价格: "<<report.orderprice()<<", \n";
+		out<<"	交易数量: "<<report.fillqty()<<", \n";
+		out<<"	交易价格: "<<report.fillprice()<<", \n";
+		out<<"	剩余数量: "<<report.leaveqty()<<", \n";
+		out<<"	交易时间: "<<report.time();
 	}
-	std::cout<<std::endl;
+	out<<"\n";
+	std::cout<<out.str()<<std::flush;
 }
 
 void printReport(const OrderReport& report){
-	std::cout<<"查询结果: "<<std::endl;
-	std::cout<<"	订单ID: "<<report.orderid()<<", "<<std::endl;
-	std::cout<<"	客户ID: "<<report.clientid()<<", "<<std::endl;
-	if(report.direction()==OrderReport::SELL) std::cout<<"	订单类型: [SELL]"<<", "<<std::endl;
-	else std::cout<<"	订单类型: [BUY]"<<", "<<std::endl;
-	std::cout<<"	股票ID: "<<report.stockid()<<", "<<std::endl;
-	std::cout<<"	订单数量: "<<report.orderqty()<<", "<<std::endl;
-	std::cout<<"	订单价格: "<<report.price()<<", "<<std::endl;
-	if(report.ordertype()==OrderReport::LIMIT) std::cout<<"	价格类型: [LIMIT]"<<", "<<std::endl;
-	else std::cout<<"	价格类型: [CURRENT]"<<", "<<std::endl;
-	std::cout<<"	报单时间: "<<report.time();
-	std::cout<<std::endl;
+	std::ostringstream out;
+	out<<"查询结果: \n";
+	out<<"	订单ID: "<<report.orderid()<<", \n";
+	out<<"	客户ID: "<<report.clientid()<<", \n";
+	if(report.direction()==OrderReport::SELL) out<<"	订单类型: [SELL], \n";
+	else out<<"	订单类型: [BUY], \n";
+	out<<"	股票ID: "<<report.stockid()<<", \n";
+	out<<"	订单数量: "<<report.orderqty()<<", \n";
+	out<<"	订单价格: "<<report.price()<<", \n";
+	if(report.ordertype()==OrderReport::LIMIT) out<<"	价格类型: [LIMIT], \n";
+	else out<<"	价格类型: [CURRENT], \n";
+	out<<"	报单时间: "<<report.time();
+	out<<"\n";
+	std::cout<<out.str()<<std::flush;
+}
+
+void printReport(const StatsReport& report){
+	std::ostringstream out;
+	out<<"统计结果: \n";
+	out<<"	新订单: "<<report.orders()<<", 拒绝: "<<report.rejects()<<", 成交回报: "<<report.fills()
+		<<", 撤单: "<<report.cancels()<<", 撤单拒绝: "<<report.cancelrejects()
+		<<", 改单: "<<report.amends()<<", 改单拒绝: "<<report.amendrejects()<<", 止损触发: "<<report.triggers()
+		<<", 报价: "<<report.quotes()<<", 报价拒绝: "<<report.quoterejects()<<", 计时任务: "<<report.timertasks()<<"\n";
+	out<<"	各阶段耗时(us): \n";
+	for(const auto& stage:report.stages()){
+		out<<"		"<<stage.stage()<<": count "<<stage.count()<<", mean "<<stage.mean()<<", p50 "<<stage.p50()
+			<<", p90 "<<stage.p90()<<", p99 "<<stage.p99()<<", p99.9 "<<stage.p999()<<", max "<<stage.max()<<"\n";
+	}
+	out<<"	挂单数量: \n";
+	for(const auto& book:report.books()){
+		out<<"		"<<book.stockid()<<": sell "<<book.sellorders()<<", buy "<<book.buyorders()
+			<<", last "<<book.lastprice()<<", bid "<<book.bidprice()<<", ask "<<book.askprice()<<", stops "<<book.stoporders()<<"\n";
+	}
+	out<<"	统计时间: "<<report.time()<<"\n";
+	std::cout<<out.str()<<std::flush;
+}
+
+void printReport(const TraceReply& reply){
+	std::ostringstream out;
+	out<<"追踪导出: \n";
+	if(reply.errormessage().size()>0){
+		out<<"	错误信息: "<<reply.errormessage()<<"\n";
+	}else{
+		out<<"	服务端文件: "<<reply.filename()<<", 事件数: "<<reply.events()<<"\n";
+	}
+	std::cout<<out.str()<<std::flush;
+}
+
+void printReport(const MassCancelReply& reply){
+	std::ostringstream out;
+	out<<"批量撤单: \n";
+	if(reply.errormessage().size()>0){
+		out<<"	错误信息: "<<reply.errormessage()<<"\n";
+	}else{
+		out<<"	撤销订单数: "<<reply.canceled()<<", \n";
+		for(const auto& report:reply.reports()){
+			out<<"		订单ID: "<<report.orderid()<<", 客户ID: "<<report.clientid()<<", 股票ID: "<<report.stockid()
+				<<", 剩余数量: "<<report.leaveqty()<<", 订单价格: "<<report.orderprice()<<"\n";
+		}
+		out<<"	撤单时间: "<<reply.time()<<"\n";
+	}
+	std::cout<<out.str()<<std::flush;
+}
+
+void printReport(const AuctionReply& reply){
+	std::ostringstream out;
+	out<<"集合竞价: \n";
+	if(reply.errormessage().size()>0){
+		out<<"	错误信息: "<<reply.errormessage()<<"\n";
+	}else{
+		out<<"	股票ID: "<<reply.stockid()<<", 成交价格: "<<reply.price()<<", 成交数量: "<<reply.volume()
+			<<", 成交回报数: "<<reply.fills()<<"\n";
+		out<<"	竞价时间: "<<reply.time()<<"\n";
+	}
+	std::cout<<out.str()<<std::flush;
+}
+
+void printReport(const MassQuoteReply& reply){
+	std::ostringstream out;
+	out<<"批量报价: \n";
+	if(reply.errormessage().size()>0){
+		out<<"	错误信息: "<<reply.errormessage()<<"\n";
+	}else{
+		out<<"	用户ID: "<<reply.clientid()<<", 接受报价: "<<reply.accepted()<<"/"<<reply.acks_size()<<"\n";
+		for(const auto& ack:reply.acks()){
+			out<<"	股票ID: "<<ack.stockid();
+			if(ack.errormessage().size()>0){
+				out<<", 错误信息: "<<ack.errormessage()<<"\n";
+				continue;
+			}
+			out<<", 买报价订单ID: "<<ack.bidorderid()<<", 卖报价订单ID: "<<ack.askorderid()
+				<<", 原买报价剩余: "<<ack.bidleaves()<<", 原卖报价剩余: "<<ack.askleaves()<<"\n";
+		}
+		out<<"	报价时间: "<<reply.time()<<"\n";
+	}
+	std::cout<<out.str()<<std::flush;
+}
+
+void printReport(const DepthUpdate& update){
+	std::ostringstream out;
+	out<<"档位深度: \n";
+	if(update.errormessage().size()>0){
+		out<<"	错误信息: "<<update.errormessage()<<"\n";
+	}else{
+		out<<"	股票ID: "<<update.stockid()<<", 版本号: "<<update.version()<<", 最新成交价: "<<update.lastprice()<<"\n";
+		// 卖方由高到低输出在上, 买方由高到低输出在下
+		for(int i=update.asks_size()-1;i>=0;i--){
+			const auto& level=update.asks(i);
+			out<<"	卖"<<i+1<<": "<<level.price()<<" x "<<level.qty()<<" ("<<level.orders()<<"笔)\n";
+		}
+		for(int i=0;i<update.bids_size();i++){
+			const auto& level=update.bids(i);
+			out<<"	买"<<i+1<<": "<<level.price()<<" x "<<level.qty()<<" ("<<level.orders()<<"笔)\n";
+		}
+		out<<"	推送时间: "<<update.time()<<"\n";
+	}
+	std::cout<<out.str()<<std::flush;
+}
+
+void printReport(const QueryOrderReply& reply){
+	for(const auto& report:reply.orders()){
+		printReport(report);
+	}
+	std::ostringstream out;
+	out<<"查询订单: \n";
+	out<<"	本页订单: "<<reply.orders_size()<<", 下一页游标: "<<reply.nextcursor();
+	if(reply.nextcursor()==0) out<<"(已无更多订单)";
+	out<<"\n	查询时间: "<<reply.time()<<"\n";
+	std::cout<<out.str()<<std::flush;
+}
+
+// 判断股票ID的合法性
+bool checkStockID(const std::string& stockID, std::string& errorMessage){
+	if(stockID.empty()){
+		errorMessage="Error: StockID is illegal!";
+		return false;
+	}
+	if(stockID.size()>STOCK_ID_MAX_LENGTH){
+		errorMessage="Error: StockID is too long!";
+		return false;
+	}
+	return true;
 }
 
 // 判断订单的合法性
 bool checkRequest(const NewOrderRequest& request, std::string& errorMessage){
 	if(request.clientid()<=0){
 		errorMessage="Error: ClientID is illegal!";
-	}else if(request.stockid().size()<=0){
-		errorMessage="Error: StockID is illegal!";
+	}else if(!checkStockID(request.stockid(), errorMessage)){
 	}else if(request.direction()!=NewOrderRequest::SELL&&request.direction()!=NewOrderRequest::BUY){
 		errorMessage="Error: Order direction is illegal!";
 	}else if(request.orderqty()<=0){
 		errorMessage="Error: Order quantity is illegal!";
-	}else if(request.price()<=0){
+	}else if(request.price()<0||(request.price()==0&&request.ordertype()!=NewOrderRequest::MARKET)){
 		errorMessage="Error: Order price is illegal!";
 	}else if(request.ordertype()!=NewOrderRequest::LIMIT&&request.ordertype()!=NewOrderRequest::MARKET){
 		errorMessage="Error: Order type is illegal!";
+	}else if(!NewOrderRequest::TimeInForce_IsValid(request.timeinforce())){
+		errorMessage="Error: Time in force is illegal!";
+	}else if(request.stopprice()<0){
+		errorMessage="Error: Stop price is illegal!";
 	}
 	if(errorMessage.size()>0) return false;
 	return true;
 }
 
+// 撮合的限价
+double matchPrice(const NewOrderRequest& request){
+	if(request.ordertype()==NewOrderRequest::MARKET&&request.price()==0){
+		return request.direction()==NewOrderRequest::SELL?0:std::numeric_limits<double>::infinity();
+	}
+	return request.price();
+}
+
+// 未成交部分是否挂单
+bool restsOnBook(const NewOrderRequest& request){
+	return request.stopprice()>0||(request.ordertype()==NewOrderRequest::LIMIT&&request.timeinforce()==NewOrderRequest::DAY);
+}
+
 // 初始化应答
 void initReport(ExecutionReport& report, const NewOrderRequest& request){
 	// 订单状态
@@ -142,6 +314,20 @@ void initReport(ExecutionReport& report, const CancelOrderRequest& request){
 	report.set_time("");
 }
 // 初始化应答
+void initReport(ExecutionReport& report, const AmendOrderRequest& request){
+	report.set_stat(ExecutionReport::REPLACE_REJECT);
+	report.set_clientid(0);
+	report.set_orderid(request.orderid());
+	report.set_stockid("");
+	report.set_orderqty(request.orderqty());
+	report.set_orderprice(request.price());
+	report.set_fillqty(0);
+	report.set_fillprice(0);
+	report.set_leaveqty(0);
+	report.set_errormessage("");
+	report.set_time("");
+}
+// 初始化应答
 void initReport(OrderReport& report, const NewOrderRequest& request, const uint64_t& orderID){
 	report.set_orderid(orderID);
 	if(request.ordertype()==NewOrderRequest::LIMIT) report.set_ordertype(OrderReport::LIMIT);
@@ -176,6 +362,19 @@ NewOrderRequest MakeNewOrderRequest(const bool& type, const bool& direction,
 	return request;
 }
 
+// 将二进制报单记录转换为新订单请求
+void orderRecordToRequest(const OrderFileRecord& record, NewOrderRequest& request){
+	request.set_clientid(record.clientID);
+	request.set_direction(record.direction==NewOrderRequest::SELL?NewOrderRequest::SELL:NewOrderRequest::BUY);
+	request.set_stockid(readFixedString(record.stockID, sizeof(record.stockID)));
+	request.set_orderqty(record.orderQty);
+	request.set_price(record.price);
+	request.set_ordertype(record.orderType==NewOrderRequest::LIMIT?NewOrderRequest::LIMIT:NewOrderRequest::MARKET);
+	request.set_timeinforce(NewOrderRequest::TimeInForce_IsValid(record.timeInForce)?
+		static_cast<NewOrderRequest::TimeInForce>(record.timeInForce):NewOrderRequest::DAY);
+	request.set_stopprice(record.kind==RECORD_NEW_ORDER?record.stopPrice:0);
+}
+
 // 创建撤销订单请求
 CancelOrderRequest MakeCancelOrderRequest(const uint64_t& orderID){
 	CancelOrderRequest request;
@@ -184,6 +383,52 @@ CancelOrderRequest MakeCancelOrderRequest(const uint64_t& orderID){
 	return request;
 }
 
+// 创建改单请求
+AmendOrderRequest MakeAmendOrderRequest(const uint64_t& orderID, const uint32_t& qty, const double& price){
+	AmendOrderRequest request;
+	request.set_orderid(orderID);
+	request.set_orderqty(qty);
+	request.set_price(price);
+	request.set_time(getTime());
+	return request;
+}
+
+// 创建批量撤单请求
+MassCancelRequest MakeMassCancelRequest(const uint64_t& clientID, const std::string& stockID, const MassCancelRequest::Side& side){
+	MassCancelRequest request;
+	request.set_clientid(clientID);
+	request.set_stockid(stockID);
+	request.set_side(side);
+	request.set_time(getTime());
+	return request;
+}
+
+// 创建集合竞价请求
+AuctionRequest MakeAuctionRequest(const std::string& stockID, const AuctionRequest::Action& action){
+	AuctionRequest request;
+	request.set_stockid(stockID);
+	request.set_action(action);
+	request.set_time(getTime());
+	return request;
+}
+
+// 创建批量报价请求
+MassQuoteRequest MakeMassQuoteRequest(const uint64_t& clientID){
+	MassQuoteRequest request;
+	request.set_clientid(clientID);
+	request.set_time(getTime());
+	return request;
+}
+
+// 创建深度订阅请求
+DepthRequest MakeDepthRequest(const std::string& stockID, const uint32_t& levels){
+	DepthRequest request;
+	request.set_stockid(stockID);
+	request.set_levels(levels);
+	request.set_time(getTime());
+	return request;
+}
+
 // 创建查询订单请求
 QueryOrderRequest MakeQueryOrderRequest(){
 	QueryOrderRequest request;
@@ -197,4 +442,18 @@ SendMessageRequest MakeSendMessageRequest(){
     request.set_time(getTime());
 	return request;
 }
+
+// 创建统计查询请求
+StatsRequest MakeStatsRequest(){
+	StatsRequest request;
+	request.set_time(getTime());
+	return request;
+}
+
+// 创建追踪导出请求
+TraceRequest MakeTraceRequest(){
+	TraceRequest request;
+	request.set_time(getTime());
+	return request;
+}
 #endif 
\ No newline at end of file
@@ -2,15 +2,23 @@
 #define HELPER_H
 
 #include <string>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include <time.h>
 #include <sys/timeb.h>
+#include "order_file.h"
+#include "logger.h"
 #include "../proto/OrderProcessSystem.grpc.pb.h"
 
 #define TYPE_LIMIT true
 #define TYPE_MARKET false
 #define DIRE_SELL true
 #define DIRE_BUY false
+// 股票ID的最大长度, 日志与快照记录中为char[16]
+#define STOCK_ID_MAX_LENGTH 15
 
 using grpc::Server;
 using grpc::ServerAsyncReaderWriter;
@@ -24,10 +32,24 @@ using grpc::Status;
 
 using OPS::NewOrderRequest;
 using OPS::CancelOrderRequest;
+using OPS::AmendOrderRequest;
+using OPS::MassCancelRequest;
+using OPS::MassCancelReply;
+using OPS::AuctionRequest;
+using OPS::AuctionReply;
+using OPS::MassQuoteRequest;
+using OPS::MassQuoteReply;
+using OPS::DepthRequest;
+using OPS::DepthUpdate;
 using OPS::QueryOrderRequest;
+using OPS::QueryOrderReply;
 using OPS::SendMessageRequest;
 using OPS::ExecutionReport;
 using OPS::OrderReport;
+using OPS::StatsRequest;
+using OPS::StatsReport;
+using OPS::TraceRequest;
+using OPS::TraceReply;
 using OPS::OrderService;
 
 // 输出请求和响应消息
@@ -35,10 +57,25 @@ void printRequest(const NewOrderRequest&);
 void printRequest(const CancelOrderRequest&);
 void printReport(const ExecutionReport&);
 void printReport(const OrderReport&);
+void printReport(const StatsReport&);
+void printReport(const TraceReply&);
+void printReport(const MassCancelReply&);
+void printReport(const AuctionReply&);
+void printReport(const MassQuoteReply&);
+void printReport(const DepthUpdate&);
+void printReport(const QueryOrderReply&);
 // 判断请求的格式
 bool checkRequest(const NewOrderRequest&, std::string&);
+// 判断股票ID: 不能为空, 也不能超过日志与快照记录中定长字段的长度, 否则恢复后会变成另一只股票
+bool checkStockID(const std::string&, std::string&);
+// 撮合的限价: 市价单价格为0时不限价(卖为0, 买为正无穷), 否则价格作为保护价
+double matchPrice(const NewOrderRequest&);
+// 未成交部分是否挂单: 只有当日有效的限价单挂单, 市价单与IOC, FOK的剩余部分撤销
+// 止损单先挂入止损簿等待触发, 触发后的回报同样写回该订单的回报流
+bool restsOnBook(const NewOrderRequest&);
 void initReport(ExecutionReport&, const NewOrderRequest&);
 void initReport(ExecutionReport&, const CancelOrderRequest&);
+void initReport(ExecutionReport&, const AmendOrderRequest&);
 void initReport(OrderReport&, const NewOrderRequest&, const uint64_t&);
 
 // 获取系统时间，年月日时分秒
@@ -46,17 +83,55 @@ std::string getTime();
 // 获取时间戳
 uint64_t getTimestamp();
 
+// 自旋等待时提示CPU
+inline void cpuRelax(){
+#if defined(__x86_64__)||defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// 复制字符串至定长字符数组, 保证以'\0'结尾
+void copyFixedString(char*, const size_t&, const std::string&);
+// 从定长字符数组读取字符串
+std::string readFixedString(const char*, const size_t&);
+
 // 创建新订单请求
 NewOrderRequest MakeNewOrderRequest(const bool&, const bool&, 
 				const uint64_t&, const std::string&,
 				const uint32_t&, const double&);
 
+// 将二进制报单记录转换为新订单请求(不设置时间)
+void orderRecordToRequest(const OrderFileRecord&, NewOrderRequest&);
+
 // 创建撤销订单请求
 CancelOrderRequest MakeCancelOrderRequest(const uint64_t&);
 
+// 创建改单请求
+AmendOrderRequest MakeAmendOrderRequest(const uint64_t&, const uint32_t&, const double&);
+
+// 创建批量撤单请求
+MassCancelRequest MakeMassCancelRequest(const uint64_t&, const std::string&, const MassCancelRequest::Side&);
+
+// 创建集合竞价请求
+AuctionRequest MakeAuctionRequest(const std::string&, const AuctionRequest::Action&);
+
+// 创建批量报价请求, 报价由调用方逐条加入
+MassQuoteRequest MakeMassQuoteRequest(const uint64_t&);
+
+// 创建深度订阅请求, levels为0时使用默认档位数
+DepthRequest MakeDepthRequest(const std::string&, const uint32_t&);
+
 // 创建查询订单请求
 QueryOrderRequest MakeQueryOrderRequest();
 
 // 创建发送消息请求
 SendMessageRequest MakeSendMessageRequest();
+
+// 创建统计查询请求
+StatsRequest MakeStatsRequest();
+
+// 创建追踪导出请求
+TraceRequest MakeTraceRequest();
 #endif 
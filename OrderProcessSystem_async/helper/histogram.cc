@@ -0,0 +1,90 @@
+#ifndef HISTOGRAM_CC
+#define HISTOGRAM_CC
+#include "histogram.h"
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram(const uint64_t& highest, const int& subBucketBits):
+	highest(std::max<uint64_t>(highest, 1ULL<<subBucketBits)), subBucketBits(subBucketBits),
+	halfCount(1ULL<<(subBucketBits-1)), totalCount(0), minValue(UINT64_MAX), maxValue(0), sum(0){
+	counts.assign(indexOf(this->highest)+1, 0);
+}
+
+// 小于2^bits的值逐个成桶; 更大的值按最高位分区间, 区间内取次高的bits-1位作为子桶
+size_t LatencyHistogram::indexOf(const uint64_t& value) const{
+	if(value<(halfCount<<1)) return value;
+	int msb=63-__builtin_clzll(value);
+	int shift=msb-subBucketBits+1;
+	return shift*halfCount+(value>>shift);
+}
+
+uint64_t LatencyHistogram::highestValueOf(const size_t& index) const{
+	if(index<(halfCount<<1)) return index;
+	uint64_t shift=index/halfCount-1;
+	uint64_t sub=index-shift*halfCount;
+	return ((sub+1)<<shift)-1;
+}
+
+void LatencyHistogram::record(const uint64_t& value){
+	uint64_t v=std::min(value, highest);
+	++counts[indexOf(v)];
+	++totalCount;
+	minValue=std::min(minValue, v);
+	maxValue=std::max(maxValue, v);
+	sum+=v;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other){
+	for(size_t i=0;i<counts.size()&&i<other.counts.size();i++){
+		counts[i]+=other.counts[i];
+	}
+	totalCount+=other.totalCount;
+	minValue=std::min(minValue, other.minValue);
+	maxValue=std::max(maxValue, other.maxValue);
+	sum+=other.sum;
+}
+
+void LatencyHistogram::reset(){
+	std::fill(counts.begin(), counts.end(), 0);
+	totalCount=0;
+	minValue=UINT64_MAX;
+	maxValue=0;
+	sum=0;
+}
+
+uint64_t LatencyHistogram::count() const{
+	return totalCount;
+}
+
+uint64_t LatencyHistogram::min() const{
+	return totalCount==0?0:minValue;
+}
+
+uint64_t LatencyHistogram::max() const{
+	return maxValue;
+}
+
+double LatencyHistogram::mean() const{
+	return totalCount==0?0:sum/totalCount;
+}
+
+uint64_t LatencyHistogram::valueAtPercentile(const double& percentile) const{
+	if(totalCount==0) return 0;
+	double p=std::min(std::max(percentile, 0.0), 100.0);
+	uint64_t target=std::max<uint64_t>(1, static_cast<uint64_t>(p/100.0*totalCount+0.5));
+	uint64_t seen=0;
+	for(size_t i=0;i<counts.size();i++){
+		seen+=counts[i];
+		if(seen>=target){
+			return std::min(highestValueOf(i), maxValue);
+		}
+	}
+	return maxValue;
+}
+
+void LatencyHistogram::print(std::ostream& out, const std::string& name, const double& scale) const{
+	out<<name<<": count "<<count()<<", mean "<<mean()/scale
+		<<", p50 "<<valueAtPercentile(50)/scale<<", p90 "<<valueAtPercentile(90)/scale
+		<<", p99 "<<valueAtPercentile(99)/scale<<", p99.9 "<<valueAtPercentile(99.9)/scale
+		<<", p99.99 "<<valueAtPercentile(99.99)/scale<<", max "<<max()/scale<<std::endl;
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+/*****************************************************************************************
+ * HDR风格的延迟直方图: 每个2的幂区间内再线性划分子桶, 相对误差固定, 内存与记录数无关
+ * 非线程安全, 每个线程各自记录, 结束后合并
+ ****************************************************************************************/
+
+class LatencyHistogram{
+public:
+	// highest: 可记录的最大值, 超过的按最大值记录; subBucketBits: 子桶位数, 相对误差约为2^-(bits-1)
+	explicit LatencyHistogram(const uint64_t& highest=60ULL*1000*1000*1000, const int& subBucketBits=8);
+	// 记录一个值
+	void record(const uint64_t&);
+	// 合并另一个直方图(参数必须相同)
+	void merge(const LatencyHistogram&);
+	void reset();
+	uint64_t count() const;
+	uint64_t min() const;
+	uint64_t max() const;
+	double mean() const;
+	// 百分位对应的值(p取0~100), 返回所在桶的上界
+	uint64_t valueAtPercentile(const double&) const;
+	// 输出常用分位数, 数值除以scale后显示
+	void print(std::ostream&, const std::string&, const double& scale=1000.0) const;
+private:
+	size_t indexOf(const uint64_t&) const;
+	uint64_t highestValueOf(const size_t&) const;
+	uint64_t highest;
+	int subBucketBits;
+	uint64_t halfCount;
+	std::vector<uint64_t> counts;
+	uint64_t totalCount;
+	uint64_t minValue;
+	uint64_t maxValue;
+	double sum;
+};
+#endif
@@ -0,0 +1,92 @@
+#ifndef LOCK_POLICY_H
+#define LOCK_POLICY_H
+
+#include <atomic>
+#include "lock_profile.h"
+#include "mpsc_queue.h"
+#include "epoch.h"
+#include "stage_stats.h"
+#include "order_trace.h"
+
+/*****************************************************************************************
+ * 引擎的编译期锁策略: OrderSystem, 股票容器, 计时器与MarketSystem以策略为模板参数
+ *     ConcurrentLockPolicy: 带名字的互斥锁与读写锁, 订单的版本号读写, 纪元回收, 无锁消息队列, 阶段统计与追踪
+ *     SingleThreadLockPolicy: 空锁, 订单字段为普通变量, 单线程消息队列, 不做统计与追踪
+ * 单线程策略用于按股票分片, 每个分片只由一个线程驱动的场景, 以及回放
+ * 此时热路径上(包括写日志, 查股票索引)没有加锁, 原子指令与内存屏障, 也不能启动计时器线程
+ ****************************************************************************************/
+
+// 不做任何事的锁, 满足std::unique_lock与std::shared_lock的要求
+class NullMutex{
+public:
+	explicit NullMutex(const char*){}
+	void lock(){}
+	bool try_lock(){ return true; }
+	void unlock(){}
+};
+
+class NullSharedMutex: public NullMutex{
+public:
+	explicit NullSharedMutex(const char* name): NullMutex(name){}
+	void lock_shared(){}
+	bool try_lock_shared(){ return true; }
+	void unlock_shared(){}
+};
+
+// 单线程策略下代替std::atomic的普通变量, 接口相同, 忽略内存序
+template<typename T>
+class PlainAtomic{
+public:
+	PlainAtomic(const T& value=T()): value(value){}
+	T load(std::memory_order=std::memory_order_seq_cst) const{ return value; }
+	void store(const T& v, std::memory_order=std::memory_order_seq_cst){ value=v; }
+private:
+	T value;
+};
+
+// 单线程引擎读股票索引时没有并发的写者, 不需要纪元临界区
+class NullEpochGuard{
+public:
+	NullEpochGuard(){}
+};
+
+// 多线程引擎的阶段统计与生命周期追踪, 写入每个线程自己的统计块与环形缓冲区
+struct ThreadInstrument{
+	static uint64_t now(){ return stageNanos(); }
+	static uint64_t recordStageSince(const OrderStage& stage, const uint64_t& start){ return ::recordStageSince(stage, start); }
+	static void addCounter(const OrderCounter& counter, const uint64_t& n=1){ ::addCounter(counter, n); }
+	static void traceOrder(const TraceEvent& event, const uint64_t& orderID, const uint64_t& arg=0, const uint32_t& qty=0){
+		::traceOrder(event, orderID, arg, qty);
+	}
+};
+
+// 单线程引擎不记录: 统计块与追踪环用原子变量供其他线程合并, 不放在单线程的热路径上
+struct NullInstrument{
+	static uint64_t now(){ return 0; }
+	static uint64_t recordStageSince(const OrderStage&, const uint64_t&){ return 0; }
+	static void addCounter(const OrderCounter&, const uint64_t& =1){}
+	static void traceOrder(const TraceEvent&, const uint64_t&, const uint64_t& =0, const uint32_t& =0){}
+};
+
+// 多线程引擎
+struct ConcurrentLockPolicy{
+	typedef ProfiledMutex Mutex;
+	typedef ProfiledSharedMutex SharedMutex;
+	template<typename T> using Queue=MpscQueue<T>;
+	template<typename T> using Atomic=std::atomic<T>;
+	typedef EpochGuard ReadGuard;
+	typedef ThreadInstrument Instrument;
+	static constexpr bool threadSafe=true;
+};
+
+// 单线程引擎
+struct SingleThreadLockPolicy{
+	typedef NullMutex Mutex;
+	typedef NullSharedMutex SharedMutex;
+	template<typename T> using Queue=SingleThreadQueue<T>;
+	template<typename T> using Atomic=PlainAtomic<T>;
+	typedef NullEpochGuard ReadGuard;
+	typedef NullInstrument Instrument;
+	static constexpr bool threadSafe=false;
+};
+#endif
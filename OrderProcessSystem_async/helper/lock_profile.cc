@@ -0,0 +1,156 @@
+#ifndef LOCK_PROFILE_CC
+#define LOCK_PROFILE_CC
+#include "lock_profile.h"
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <signal.h>
+#include <pthread.h>
+
+#ifdef OPS_LOCK_PROFILE
+
+AtomicLog2Histogram::AtomicLog2Histogram(): total(0), maxValue(0){
+	for(auto& bucket:buckets) bucket.store(0, std::memory_order_relaxed);
+}
+
+// 桶i(i>0)存放最高位为第i-1位的值, 桶0存放0
+void AtomicLog2Histogram::record(const uint64_t& value){
+	int index=value==0?0:64-__builtin_clzll(value);
+	buckets[index].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(value, std::memory_order_relaxed);
+	uint64_t current=maxValue.load(std::memory_order_relaxed);
+	while(value>current&&!maxValue.compare_exchange_weak(current, value, std::memory_order_relaxed)){}
+}
+
+uint64_t AtomicLog2Histogram::count() const{
+	uint64_t n=0;
+	for(const auto& bucket:buckets) n+=bucket.load(std::memory_order_relaxed);
+	return n;
+}
+
+uint64_t AtomicLog2Histogram::sum() const{
+	return total.load(std::memory_order_relaxed);
+}
+
+uint64_t AtomicLog2Histogram::max() const{
+	return maxValue.load(std::memory_order_relaxed);
+}
+
+uint64_t AtomicLog2Histogram::valueAtPercentile(const double& percentile) const{
+	uint64_t n=count();
+	if(n==0) return 0;
+	uint64_t target=std::max<uint64_t>(1, static_cast<uint64_t>(std::min(percentile, 100.0)/100.0*n+0.5));
+	uint64_t seen=0;
+	for(int i=0;i<65;i++){
+		seen+=buckets[i].load(std::memory_order_relaxed);
+		if(seen>=target){
+			if(i==0) return 0;
+			uint64_t upper=i==64?UINT64_MAX:(1ULL<<i)-1;
+			return std::min(upper, max());
+		}
+	}
+	return max();
+}
+
+LockStats::LockStats(const std::string& name): name(name), instances(0), exclusive(0), shared(0), contended(0){}
+
+namespace lock_profile{
+	// 全部统计, 按名字索引; 有意不释放, 保证静态对象析构期间的锁仍可使用
+	static std::mutex& registryMutex(){
+		static std::mutex* m=new std::mutex();
+		return *m;
+	}
+	static std::unordered_map<std::string, LockStats*>& registry(){
+		static auto* r=new std::unordered_map<std::string, LockStats*>();
+		return *r;
+	}
+
+	LockStats* statsOf(const char* name){
+		std::unique_lock<std::mutex> w(registryMutex());
+		LockStats*& stats=registry()[name];
+		if(stats==nullptr) stats=new LockStats(name);
+		return stats;
+	}
+
+	// 本线程持有的锁, 嵌套层数有限, 超出的不记录持有时间
+	#define LOCK_PROFILE_MAX_HELD 32
+	struct HeldLock{
+		const void* lock;
+		uint64_t since;
+	};
+	static thread_local HeldLock held[LOCK_PROFILE_MAX_HELD];
+	static thread_local int heldCount=0;
+
+	void pushHeld(const void* lock){
+		if(heldCount<LOCK_PROFILE_MAX_HELD) held[heldCount++]={lock, now()};
+	}
+
+	// 一般按后进先出释放, 从栈顶开始查找
+	uint64_t popHeld(const void* lock){
+		for(int i=heldCount-1;i>=0;i--){
+			if(held[i].lock!=lock) continue;
+			uint64_t duration=now()-held[i].since;
+			held[i]=held[--heldCount];
+			return duration;
+		}
+		return 0;
+	}
+}
+
+void dumpLockProfile(std::ostream& out){
+	std::vector<LockStats*> all;
+	{
+		std::unique_lock<std::mutex> w(lock_profile::registryMutex());
+		for(const auto& [name, stats]:lock_profile::registry()) all.push_back(stats);
+	}
+	std::sort(all.begin(), all.end(), [](const LockStats* a, const LockStats* b){
+		return a->waitNanos.sum()>b->waitNanos.sum();
+	});
+	std::ios::fmtflags flags=out.flags();
+	out<<std::fixed<<std::setprecision(3);
+	out<<"Lock profile (wait/hold in us, wait only counts contended acquisitions):"<<std::endl;
+	for(const LockStats* stats:all){
+		uint64_t exclusive=stats->exclusive.load(std::memory_order_relaxed);
+		uint64_t shared=stats->shared.load(std::memory_order_relaxed);
+		uint64_t contended=stats->contended.load(std::memory_order_relaxed);
+		uint64_t acquisitions=exclusive+shared;
+		out<<"	"<<stats->name<<": instances "<<stats->instances.load(std::memory_order_relaxed)
+			<<", acquisitions "<<acquisitions<<" (exclusive "<<exclusive<<", shared "<<shared<<")"
+			<<", contended "<<contended<<" ("<<(acquisitions>0?100.0*contended/acquisitions:0)<<"%)"<<std::endl;
+		out<<"		wait: total "<<stats->waitNanos.sum()/1000.0
+			<<", p50 "<<stats->waitNanos.valueAtPercentile(50)/1000.0
+			<<", p99 "<<stats->waitNanos.valueAtPercentile(99)/1000.0
+			<<", max "<<stats->waitNanos.max()/1000.0<<std::endl;
+		out<<"		hold: total "<<stats->holdNanos.sum()/1000.0
+			<<", p50 "<<stats->holdNanos.valueAtPercentile(50)/1000.0
+			<<", p99 "<<stats->holdNanos.valueAtPercentile(99)/1000.0
+			<<", max "<<stats->holdNanos.max()/1000.0<<std::endl;
+	}
+	out.flags(flags);
+}
+
+void startLockProfileDumper(const int& signal){
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, signal);
+	pthread_sigmask(SIG_BLOCK, &set, nullptr);
+	std::thread([set](){
+		int received;
+		while(sigwait(&set, &received)==0){
+			dumpLockProfile(std::cerr);
+		}
+	}).detach();
+}
+
+#else
+
+void dumpLockProfile(std::ostream& out){
+	out<<"Lock profile disabled, rebuild with: make clean && make LOCK_PROFILE=1"<<std::endl;
+}
+
+void startLockProfileDumper(const int&){}
+
+#endif
+#endif
@@ -0,0 +1,165 @@
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <iostream>
+
+/*****************************************************************************************
+ * 带名字的锁: 引擎内的锁统一使用ProfiledMutex与ProfiledSharedMutex, 构造时给出名字
+ * 默认编译时二者直接继承std::mutex与std::shared_mutex, 名字被忽略, 没有额外开销
+ * 以make LOCK_PROFILE=1编译(定义OPS_LOCK_PROFILE)时, 按名字统计:
+ *     获取次数(独占/共享), 发生等待的次数, 等待时间与持有时间的直方图
+ * 同名的锁(如每个订单各自的锁)共用一份统计; 统计可在运行时用dumpLockProfile输出
+ ****************************************************************************************/
+
+#ifndef OPS_LOCK_PROFILE
+
+class ProfiledMutex: public std::mutex{
+public:
+	explicit ProfiledMutex(const char*){}
+};
+
+class ProfiledSharedMutex: public std::shared_mutex{
+public:
+	explicit ProfiledSharedMutex(const char*){}
+};
+
+#else
+
+// 以2的幂分桶的直方图(纳秒), 多线程并发记录
+class AtomicLog2Histogram{
+public:
+	AtomicLog2Histogram();
+	void record(const uint64_t&);
+	uint64_t count() const;
+	uint64_t sum() const;
+	uint64_t max() const;
+	// 百分位(p取0~100)所在桶的上界
+	uint64_t valueAtPercentile(const double&) const;
+private:
+	std::atomic<uint64_t> buckets[65];
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> maxValue;
+};
+
+// 一个名字下全部锁的统计
+struct LockStats{
+	std::string name;
+	std::atomic<uint64_t> instances;
+	std::atomic<uint64_t> exclusive;    // 独占获取次数
+	std::atomic<uint64_t> shared;       // 共享获取次数
+	std::atomic<uint64_t> contended;    // 需要等待的次数
+	AtomicLog2Histogram waitNanos;      // 仅记录发生等待的获取
+	AtomicLog2Histogram holdNanos;
+	explicit LockStats(const std::string&);
+};
+
+namespace lock_profile{
+	// 按名字取统计(首次使用时创建, 之后不会释放)
+	LockStats* statsOf(const char*);
+	inline uint64_t now(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	// 记录本线程持有的锁及获取时刻, 释放时计算持有时间
+	void pushHeld(const void*);
+	uint64_t popHeld(const void*);
+}
+
+class ProfiledMutex{
+public:
+	explicit ProfiledMutex(const char* name): stats(lock_profile::statsOf(name)){
+		++stats->instances;
+	}
+	ProfiledMutex(const ProfiledMutex&)=delete;
+	ProfiledMutex& operator=(const ProfiledMutex&)=delete;
+	void lock(){
+		if(!m.try_lock()){
+			uint64_t start=lock_profile::now();
+			m.lock();
+			stats->waitNanos.record(lock_profile::now()-start);
+			stats->contended.fetch_add(1, std::memory_order_relaxed);
+		}
+		stats->exclusive.fetch_add(1, std::memory_order_relaxed);
+		lock_profile::pushHeld(this);
+	}
+	bool try_lock(){
+		if(!m.try_lock()) return false;
+		stats->exclusive.fetch_add(1, std::memory_order_relaxed);
+		lock_profile::pushHeld(this);
+		return true;
+	}
+	void unlock(){
+		stats->holdNanos.record(lock_profile::popHeld(this));
+		m.unlock();
+	}
+private:
+	std::mutex m;
+	LockStats* stats;
+};
+
+class ProfiledSharedMutex{
+public:
+	explicit ProfiledSharedMutex(const char* name): stats(lock_profile::statsOf(name)){
+		++stats->instances;
+	}
+	ProfiledSharedMutex(const ProfiledSharedMutex&)=delete;
+	ProfiledSharedMutex& operator=(const ProfiledSharedMutex&)=delete;
+	void lock(){
+		if(!m.try_lock()){
+			uint64_t start=lock_profile::now();
+			m.lock();
+			stats->waitNanos.record(lock_profile::now()-start);
+			stats->contended.fetch_add(1, std::memory_order_relaxed);
+		}
+		stats->exclusive.fetch_add(1, std::memory_order_relaxed);
+		lock_profile::pushHeld(this);
+	}
+	bool try_lock(){
+		if(!m.try_lock()) return false;
+		stats->exclusive.fetch_add(1, std::memory_order_relaxed);
+		lock_profile::pushHeld(this);
+		return true;
+	}
+	void unlock(){
+		stats->holdNanos.record(lock_profile::popHeld(this));
+		m.unlock();
+	}
+	void lock_shared(){
+		if(!m.try_lock_shared()){
+			uint64_t start=lock_profile::now();
+			m.lock_shared();
+			stats->waitNanos.record(lock_profile::now()-start);
+			stats->contended.fetch_add(1, std::memory_order_relaxed);
+		}
+		stats->shared.fetch_add(1, std::memory_order_relaxed);
+		lock_profile::pushHeld(this);
+	}
+	bool try_lock_shared(){
+		if(!m.try_lock_shared()) return false;
+		stats->shared.fetch_add(1, std::memory_order_relaxed);
+		lock_profile::pushHeld(this);
+		return true;
+	}
+	void unlock_shared(){
+		stats->holdNanos.record(lock_profile::popHeld(this));
+		m.unlock_shared();
+	}
+private:
+	std::shared_mutex m;
+	LockStats* stats;
+};
+
+#endif
+
+// 输出全部锁的统计, 按总等待时间降序; 未开启时输出提示
+void dumpLockProfile(std::ostream&);
+// 收到指定信号时把统计输出到标准错误
+// 由专门的线程sigwait等待; 调用方需在创建任何线程之前屏蔽该信号(与其他用sigwait等待的信号一起),
+// 否则信号可能交给未屏蔽的线程, 按默认动作结束进程; 未开启时不做任何事
+void startLockProfileDumper(const int&);
+#endif
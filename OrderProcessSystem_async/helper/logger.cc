@@ -0,0 +1,158 @@
+#ifndef LOGGER_CC
+#define LOGGER_CC
+#include "logger.h"
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace logger{
+	// 后台线程无消息时的休眠间隔
+	#define LOG_IDLE_MICROS 2000
+
+	static const char* LEVEL_NAMES[]={"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+	// 全部线程的缓冲区; 线程退出后保留, 剩余消息仍会写出
+	class Backend{
+	public:
+		Backend(): running(true), drainRounds(0){
+			thread=std::thread(&Backend::run, this);
+			// 进程退出时写完剩余消息
+			atexit([](){ instance().stop(); });
+		}
+		static Backend& instance(){
+			static Backend* backend=new Backend();
+			return *backend;
+		}
+		LogRing* registerRing(){
+			LogRing* ring=new LogRing();
+			std::unique_lock<std::mutex> w(ringsMutex);
+			rings.push_back(ring);
+			return ring;
+		}
+		// 等待后台线程完成两轮取出, 保证调用前写入的消息都已输出
+		void flush(){
+			if(!running.load()) return;
+			uint64_t target=drainRounds.load()+2;
+			while(running.load()&&drainRounds.load()<target){
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+		void stop(){
+			if(!running.exchange(false)) return;
+			thread.join();
+			drain();
+		}
+	private:
+		void run(){
+			while(running.load()){
+				if(!drain()) std::this_thread::sleep_for(std::chrono::microseconds(LOG_IDLE_MICROS));
+				++drainRounds;
+			}
+		}
+		// 取出全部缓冲区中的消息, 格式化后一次写出; 没有消息返回false
+		bool drain(){
+			std::vector<LogRing*> all;
+			{
+				std::unique_lock<std::mutex> w(ringsMutex);
+				all=rings;
+			}
+			buffer.clear();
+			for(LogRing* ring:all){
+				uint64_t tail=ring->tail.load(std::memory_order_relaxed);
+				uint64_t head=ring->head.load(std::memory_order_acquire);
+				for(;tail<head;tail++){
+					format(ring->slots[tail&(LOG_RING_SLOTS-1)]);
+				}
+				ring->tail.store(tail, std::memory_order_release);
+				uint64_t dropped=ring->dropped.load(std::memory_order_relaxed);
+				if(dropped>ring->droppedReported){
+					buffer+="WARN  "+std::to_string(dropped-ring->droppedReported)+" log messages dropped\n";
+					ring->droppedReported=dropped;
+				}
+			}
+			if(buffer.empty()) return false;
+			size_t written=0;
+			while(written<buffer.size()){
+				ssize_t n=::write(STDERR_FILENO, buffer.data()+written, buffer.size()-written);
+				if(n<=0) break;
+				written+=n;
+			}
+			return true;
+		}
+		// 时间 级别 消息
+		void format(const LogSlot& slot){
+			char prefix[64];
+			time_t seconds=slot.timestamp/1000000000ULL;
+			struct tm local;
+			localtime_r(&seconds, &local);
+			size_t n=strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+			snprintf(prefix+n, sizeof(prefix)-n, ".%06llu %s ",
+				static_cast<unsigned long long>(slot.timestamp%1000000000ULL/1000), LEVEL_NAMES[slot.level<4?slot.level:3]);
+			buffer+=prefix;
+			size_t offset=0;
+			uint8_t used=0;
+			for(const char* p=slot.format;*p;p++){
+				if(p[0]=='{'&&p[1]=='}'&&used<slot.argc){
+					offset=appendArg(slot, offset);
+					++used;
+					++p;
+				}else{
+					buffer+=*p;
+				}
+			}
+			buffer+='\n';
+		}
+		// 追加一个参数, 返回下一个参数的位置
+		size_t appendArg(const LogSlot& slot, size_t offset){
+			LogArgType type=static_cast<LogArgType>(slot.data[offset++]);
+			char text[32];
+			if(type==LOG_ARG_INT){
+				int64_t value;
+				memcpy(&value, slot.data+offset, sizeof(value));
+				offset+=sizeof(value);
+				snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+				buffer+=text;
+			}else if(type==LOG_ARG_UINT){
+				uint64_t value;
+				memcpy(&value, slot.data+offset, sizeof(value));
+				offset+=sizeof(value);
+				snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(value));
+				buffer+=text;
+			}else if(type==LOG_ARG_DOUBLE){
+				double value;
+				memcpy(&value, slot.data+offset, sizeof(value));
+				offset+=sizeof(value);
+				snprintf(text, sizeof(text), "%g", value);
+				buffer+=text;
+			}else{
+				uint16_t length;
+				memcpy(&length, slot.data+offset, sizeof(length));
+				offset+=sizeof(length);
+				buffer.append(slot.data+offset, length);
+				offset+=length;
+			}
+			return offset;
+		}
+		std::atomic<bool> running;
+		std::atomic<uint64_t> drainRounds;
+		std::thread thread;
+		std::mutex ringsMutex;
+		std::vector<LogRing*> rings;
+		// 只由后台线程使用
+		std::string buffer;
+	};
+
+	LogRing* localRing(){
+		static thread_local LogRing* ring=Backend::instance().registerRing();
+		return ring;
+	}
+
+	void flush(){
+		Backend::instance().flush();
+	}
+}
+#endif
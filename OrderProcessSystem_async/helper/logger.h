@@ -0,0 +1,141 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <time.h>
+
+/*****************************************************************************************
+ * 异步分级日志
+ * 调用线程只把格式串指针与参数的二进制值写入本线程的环形缓冲区(单写者, 不加锁, 不做格式化),
+ * 后台线程定期取出, 按格式串中的{}依次替换参数后批量写到标准错误
+ * 缓冲区满时丢弃新消息并计数, 调用线程不会阻塞
+ * 低于OPS_LOG_LEVEL的级别在编译期去掉, 参数不会被求值; 以make LOG_LEVEL=0编译可开启DEBUG
+ * 格式串必须是字符串字面量; 字符串参数按值复制, 过长的截断
+ ****************************************************************************************/
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+#ifndef OPS_LOG_LEVEL
+#define OPS_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// 每个线程的消息槽数(2的幂)与每条消息的参数区大小
+#define LOG_RING_SLOTS 1024
+#define LOG_SLOT_DATA 224
+
+// 一条消息
+struct LogSlot{
+	uint64_t timestamp;   // 实时时钟(纳秒)
+	const char* format;
+	uint8_t level;
+	uint8_t argc;
+	uint16_t used;        // 参数区已用字节
+	char data[LOG_SLOT_DATA];
+};
+
+// 参数类型标记
+enum LogArgType: uint8_t{
+	LOG_ARG_INT=0,
+	LOG_ARG_UINT,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STRING
+};
+
+// 每个线程的环形缓冲区
+struct LogRing{
+	std::atomic<uint64_t> head;     // 写者发布
+	std::atomic<uint64_t> tail;     // 后台线程发布
+	std::atomic<uint64_t> dropped;  // 缓冲区满丢弃的消息数, 只由写者累加
+	uint64_t droppedReported;       // 后台线程已报告的丢弃数
+	LogSlot slots[LOG_RING_SLOTS];
+	LogRing(): head(0), tail(0), dropped(0), droppedReported(0){}
+};
+
+namespace logger{
+	// 取本线程的缓冲区, 首次调用时注册并按需启动后台线程
+	LogRing* localRing();
+
+	inline void putBytes(LogSlot& slot, const void* bytes, const size_t& size){
+		memcpy(slot.data+slot.used, bytes, size);
+		slot.used+=size;
+	}
+
+	template<typename T>
+	inline void putValue(LogSlot& slot, const LogArgType& type, const T& value){
+		if(slot.used+1+sizeof(T)>LOG_SLOT_DATA) return;
+		putBytes(slot, &type, 1);
+		putBytes(slot, &value, sizeof(T));
+		++slot.argc;
+	}
+
+	inline void putString(LogSlot& slot, const char* str, size_t size){
+		if(slot.used+1+sizeof(uint16_t)>LOG_SLOT_DATA) return;
+		size=std::min<size_t>(size, LOG_SLOT_DATA-slot.used-1-sizeof(uint16_t));
+		uint16_t length=size;
+		LogArgType type=LOG_ARG_STRING;
+		putBytes(slot, &type, 1);
+		putBytes(slot, &length, sizeof(length));
+		putBytes(slot, str, size);
+		++slot.argc;
+	}
+
+	template<typename T>
+	inline void encode(LogSlot& slot, const T& value){
+		if constexpr(std::is_same<T, bool>::value){
+			putString(slot, value?"true":"false", value?4:5);
+		}else if constexpr(std::is_floating_point<T>::value){
+			putValue(slot, LOG_ARG_DOUBLE, static_cast<double>(value));
+		}else if constexpr(std::is_enum<T>::value||std::is_signed<T>::value){
+			putValue(slot, LOG_ARG_INT, static_cast<int64_t>(value));
+		}else if constexpr(std::is_unsigned<T>::value){
+			putValue(slot, LOG_ARG_UINT, static_cast<uint64_t>(value));
+		}else if constexpr(std::is_same<T, std::string>::value){
+			putString(slot, value.data(), value.size());
+		}else{
+			const char* str=value;
+			putString(slot, str, strlen(str));
+		}
+	}
+
+	template<typename... Args>
+	void write(const int& level, const char* format, const Args&... args){
+		LogRing* ring=localRing();
+		uint64_t head=ring->head.load(std::memory_order_relaxed);
+		if(head-ring->tail.load(std::memory_order_acquire)>=LOG_RING_SLOTS){
+			ring->dropped.store(ring->dropped.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+			return;
+		}
+		LogSlot& slot=ring->slots[head&(LOG_RING_SLOTS-1)];
+		timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		slot.timestamp=ts.tv_sec*1000000000ULL+ts.tv_nsec;
+		slot.format=format;
+		slot.level=level;
+		slot.argc=0;
+		slot.used=0;
+		(encode(slot, args), ...);
+		ring->head.store(head+1, std::memory_order_release);
+	}
+
+	// 等待后台线程写出此前的全部消息
+	void flush();
+}
+
+// 格式串用{}占位, 例如 LOG_INFO("Snapshot saved: {} orders", count);
+#define OPS_LOG(level, format, ...) do{ \
+	if constexpr((level)>=OPS_LOG_LEVEL) logger::write((level), "" format, ##__VA_ARGS__); \
+}while(0)
+#define LOG_DEBUG(format, ...) OPS_LOG(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) OPS_LOG(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) OPS_LOG(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) OPS_LOG(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#endif
@@ -0,0 +1,172 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <condition_variable>
+
+/*****************************************************************************************
+ * 多生产者单消费者队列(无锁链表, 生产者一次原子交换入队)
+ * 节点预先分配, 空闲节点放在带版本号的无锁栈中; 预分配的节点用完时临时new, 出队后delete
+ * 消费者一次取出当前全部元素; 同一时刻只能有一个消费者, 多个取出方需自行串行化
+ * 生产者入队后增加发布计数, 仅当消费者正在等待时才加锁通知, 消费者无需轮询
+ ****************************************************************************************/
+
+template<typename T>
+class MpscQueue{
+public:
+	// capacity: 预分配的节点数(不含哨兵节点)
+	explicit MpscQueue(const uint32_t& capacity): nodes(capacity+1), freeHead(NIL), head(&nodes[0]), tail(&nodes[0]),
+		publishedCount(0), waiters(0){
+		nodes[0].index=0;
+		for(uint32_t i=1;i<=capacity;i++){
+			nodes[i].index=i;
+			nodes[i].nextFree.store(i<capacity?i+1:NIL, std::memory_order_relaxed);
+		}
+		freeHead.store(capacity>0?1:NIL, std::memory_order_relaxed);
+	}
+	~MpscQueue(){
+		Node* node=tail->next.load(std::memory_order_relaxed);
+		if(tail->index==NIL) delete tail;
+		while(node!=nullptr){
+			Node* next=node->next.load(std::memory_order_relaxed);
+			if(node->index==NIL) delete node;
+			node=next;
+		}
+	}
+	MpscQueue(const MpscQueue&)=delete;
+	MpscQueue& operator=(const MpscQueue&)=delete;
+
+	// 入队(任意线程)
+	void push(T&& value){
+		Node* node=allocate();
+		node->value=std::move(value);
+		node->next.store(nullptr, std::memory_order_relaxed);
+		Node* prev=head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+		publishedCount.fetch_add(1, std::memory_order_seq_cst);
+		if(waiters.load(std::memory_order_seq_cst)>0){
+			std::unique_lock<std::mutex> w(waitMutex);
+			waitCondition.notify_all();
+		}
+	}
+
+	// 取出当前全部元素追加到values, 返回取出的个数(仅消费者)
+	// 生产者已交换head但尚未链接时, 该元素留到下一次取出
+	size_t drain(std::vector<T>& values){
+		size_t count=0;
+		Node* next=tail->next.load(std::memory_order_acquire);
+		while(next!=nullptr){
+			values.push_back(std::move(next->value));
+			release(tail);
+			tail=next;
+			next=tail->next.load(std::memory_order_acquire);
+			++count;
+		}
+		return count;
+	}
+
+	// 丢弃当前全部元素(仅消费者)
+	void clear(){
+		std::vector<T> values;
+		drain(values);
+	}
+
+	// 累计入队的元素数, 消费者据此判断是否有新元素
+	uint64_t published() const{
+		return publishedCount.load(std::memory_order_seq_cst);
+	}
+
+	// 等待累计入队数不等于seen, 返回当前的累计入队数; timeout小于0时一直等待
+	uint64_t wait(const uint64_t& seen, const std::chrono::milliseconds& timeout){
+		uint64_t current=published();
+		if(current!=seen) return current;
+		std::unique_lock<std::mutex> w(waitMutex);
+		waiters.fetch_add(1, std::memory_order_seq_cst);
+		auto ready=[&](){return published()!=seen;};
+		if(timeout.count()<0) waitCondition.wait(w, ready);
+		else waitCondition.wait_for(w, timeout, ready);
+		waiters.fetch_sub(1, std::memory_order_seq_cst);
+		return published();
+	}
+private:
+	static constexpr uint32_t NIL=UINT32_MAX;
+	struct Node{
+		std::atomic<Node*> next;
+		std::atomic<uint32_t> nextFree;
+		// 在nodes中的下标, 临时new的节点为NIL
+		uint32_t index;
+		T value;
+		Node(): next(nullptr), nextFree(NIL), index(NIL){}
+	};
+	// 从空闲栈取一个节点, 空闲栈为空时new一个
+	// 栈顶高32位为版本号, 每次修改加一, 避免ABA
+	Node* allocate(){
+		uint64_t top=freeHead.load(std::memory_order_acquire);
+		while(true){
+			uint32_t index=static_cast<uint32_t>(top);
+			if(index==NIL) return new Node();
+			uint64_t next=nodes[index].nextFree.load(std::memory_order_relaxed);
+			if(freeHead.compare_exchange_weak(top, ((top>>32)+1)<<32|next, std::memory_order_acq_rel, std::memory_order_acquire)){
+				return &nodes[index];
+			}
+		}
+	}
+	// 归还节点: 预分配的压回空闲栈, 临时new的释放
+	void release(Node* node){
+		if(node->index==NIL){
+			delete node;
+			return;
+		}
+		uint64_t top=freeHead.load(std::memory_order_relaxed);
+		do{
+			node->nextFree.store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+		}while(!freeHead.compare_exchange_weak(top, ((top>>32)+1)<<32|node->index, std::memory_order_release, std::memory_order_relaxed));
+	}
+	std::vector<Node> nodes;
+	std::atomic<uint64_t> freeHead;
+	// 生产者交换head, 消费者独占tail; tail始终指向已取出的哨兵节点
+	alignas(64) std::atomic<Node*> head;
+	alignas(64) Node* tail;
+	alignas(64) std::atomic<uint64_t> publishedCount;
+	std::atomic<uint32_t> waiters;
+	std::mutex waitMutex;
+	std::condition_variable waitCondition;
+};
+
+// 与MpscQueue接口相同的单线程队列, 供单线程引擎使用, 不含任何原子操作
+template<typename T>
+class SingleThreadQueue{
+public:
+	explicit SingleThreadQueue(const uint32_t& capacity): publishedCount(0){
+		values.reserve(capacity);
+	}
+	void push(T&& value){
+		values.push_back(std::move(value));
+		++publishedCount;
+	}
+	size_t drain(std::vector<T>& out){
+		size_t count=values.size();
+		for(auto& value:values) out.push_back(std::move(value));
+		values.clear();
+		return count;
+	}
+	void clear(){
+		values.clear();
+	}
+	uint64_t published() const{
+		return publishedCount;
+	}
+	// 没有其他生产者, 不等待
+	uint64_t wait(const uint64_t&, const std::chrono::milliseconds&){
+		return publishedCount;
+	}
+private:
+	std::vector<T> values;
+	uint64_t publishedCount;
+};
+#endif
@@ -0,0 +1,134 @@
+#ifndef ORDER_FILE_CC
+#define ORDER_FILE_CC
+#include "order_file.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+
+// 判断是否为二进制报单文件
+bool isOrderFile(const std::string& fileName){
+    FILE* file=fopen(fileName.c_str(), "rb");
+    if(file==nullptr) return false;
+    OrderFileHeader header;
+    bool res=fread(&header, sizeof(header), 1, file)==1&&header.magic==ORDER_FILE_MAGIC;
+    fclose(file);
+    return res;
+}
+
+// 读入全部记录
+bool loadOrderRecords(const std::string& fileName, std::vector<OrderFileRecord>& records){
+    if(isOrderFile(fileName)){
+        OrderFileReader reader;
+        if(!reader.open(fileName)) return false;
+        records.clear();
+        for(uint64_t i=0;i<reader.size();i++) records.push_back(reader.at(i));
+        return true;
+    }
+    std::ifstream fin(fileName);
+    if(!fin.is_open()) return false;
+    uint64_t requestNum=0;
+    fin>>requestNum;
+    records.reserve(requestNum);
+    std::string type, direction, stockID;
+    for(uint64_t i=0;i<requestNum&&fin>>type;i++){
+        OrderFileRecord record;
+        memset(&record, 0, sizeof(record));
+        if(type=="CANCEL"){
+            record.kind=RECORD_CANCEL_ORDER;
+            if(!(fin>>record.clientID>>record.target)) break;
+        }else{
+            record.kind=RECORD_NEW_ORDER;
+            // 类型后的止损价: LIMIT@9.5, MARKET:IOC@10.2
+            size_t at=type.find('@');
+            if(at!=std::string::npos){
+                record.stopPrice=atof(type.c_str()+at+1);
+                type.resize(at);
+            }
+            // 类型后的有效期: LIMIT:IOC, MARKET:FOK
+            size_t colon=type.find(':');
+            std::string timeInForce=colon==std::string::npos?"":type.substr(colon+1);
+            record.orderType=type.compare(0, colon, "LIMIT")==0?0:1;
+            record.timeInForce=timeInForce=="IOC"?1:(timeInForce=="FOK"?2:0);
+            if(!(fin>>direction>>record.clientID>>stockID>>record.orderQty>>record.price)) break;
+            record.direction=direction=="SELL"?0:1;
+            strncpy(record.stockID, stockID.c_str(), sizeof(record.stockID)-1);
+        }
+        records.push_back(record);
+    }
+    return true;
+}
+
+OrderFileWriter::OrderFileWriter():file(nullptr), count(0){}
+
+OrderFileWriter::~OrderFileWriter(){
+    close();
+}
+
+bool OrderFileWriter::open(const std::string& fileName){
+    file=fopen(fileName.c_str(), "wb");
+    if(file==nullptr) return false;
+    count=0;
+    // 先写入占位文件头, 关闭时回写记录数
+    OrderFileHeader header={ORDER_FILE_MAGIC, ORDER_FILE_VERSION, sizeof(OrderFileRecord), 0};
+    return fwrite(&header, sizeof(header), 1, file)==1;
+}
+
+bool OrderFileWriter::append(const OrderFileRecord& record){
+    if(file==nullptr||fwrite(&record, sizeof(record), 1, file)!=1) return false;
+    ++count;
+    return true;
+}
+
+bool OrderFileWriter::close(){
+    if(file==nullptr) return false;
+    OrderFileHeader header={ORDER_FILE_MAGIC, ORDER_FILE_VERSION, sizeof(OrderFileRecord), count};
+    bool res=fseek(file, 0, SEEK_SET)==0&&fwrite(&header, sizeof(header), 1, file)==1;
+    res=fclose(file)==0&&res;
+    file=nullptr;
+    return res;
+}
+
+OrderFileReader::OrderFileReader():data(MAP_FAILED), length(0), count(0){}
+
+OrderFileReader::~OrderFileReader(){
+    if(data!=MAP_FAILED) munmap(data, length);
+}
+
+bool OrderFileReader::open(const std::string& fileName){
+    int fd=::open(fileName.c_str(), O_RDONLY);
+    if(fd<0) return false;
+    struct stat st;
+    if(fstat(fd, &st)!=0||st.st_size<static_cast<off_t>(sizeof(OrderFileHeader))){
+        ::close(fd);
+        return false;
+    }
+    length=st.st_size;
+    data=mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data==MAP_FAILED) return false;
+    const OrderFileHeader* header=static_cast<const OrderFileHeader*>(data);
+    if(header->magic!=ORDER_FILE_MAGIC||header->version!=ORDER_FILE_VERSION||header->recordSize!=sizeof(OrderFileRecord)){
+        munmap(data, length);
+        data=MAP_FAILED;
+        return false;
+    }
+    // 以文件实际长度为准, 防止记录数与文件不一致
+    count=std::min<uint64_t>(header->recordCount, (length-sizeof(OrderFileHeader))/sizeof(OrderFileRecord));
+    // 按顺序发送, 提示内核预读
+    madvise(data, length, MADV_SEQUENTIAL);
+    return true;
+}
+
+uint64_t OrderFileReader::size() const{
+    return count;
+}
+
+const OrderFileRecord& OrderFileReader::at(const uint64_t& i) const{
+    return reinterpret_cast<const OrderFileRecord*>(static_cast<const char*>(data)+sizeof(OrderFileHeader))[i];
+}
+#endif
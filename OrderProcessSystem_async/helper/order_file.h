@@ -0,0 +1,85 @@
+#ifndef ORDER_FILE_H
+#define ORDER_FILE_H
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*****************************************************************************************
+ * 二进制报单文件: 文件头 + 定长记录, 生成器写入, 客户端内存映射后逐条发送
+ * 不依赖protobuf, 方向与类型的取值与NewOrderRequest的枚举一致
+ * 撤单记录以文件内序号引用之前的新订单, 由回放与压测在收到订单ID后解析
+ * 文本格式每行一条: LIMIT/MARKET <SELL/BUY> <客户ID> <股票ID> <数量> <价格>, 或 CANCEL <客户ID> <序号>
+ * 类型后可加有效期, 如LIMIT:IOC, MARKET:FOK, 不加为DAY; 再后可加止损价, 如LIMIT@9.5, MARKET:IOC@10.2
+ ****************************************************************************************/
+
+#define ORDER_FILE_MAGIC 0x31444f5253504f4fULL
+#define ORDER_FILE_VERSION 2
+
+// 记录类型
+enum OrderRecordKind : uint8_t{
+    RECORD_NEW_ORDER=0,    // 新订单
+    RECORD_CANCEL_ORDER=1  // 撤单
+};
+
+// 文件头
+struct OrderFileHeader{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+};
+
+// 定长报单记录
+struct OrderFileRecord{
+    uint64_t clientID;   // 客户ID
+    double price;        // 报单价格
+    union{
+        uint64_t target;     // 撤单记录: 被撤订单在文件中的序号
+        double stopPrice;    // 新订单记录: 止损价, 0表示普通订单
+    };
+    uint32_t orderQty;   // 订单数量
+    uint8_t kind;        // 记录类型
+    uint8_t direction;   // 买卖方向: 0卖 1买
+    uint8_t orderType;   // 订单类型: 0限价 1市价
+    uint8_t timeInForce; // 有效期: 0当日 1IOC 2FOK
+    char stockID[16];    // 股票ID
+};
+
+// 判断是否为二进制报单文件
+bool isOrderFile(const std::string&);
+// 读入全部记录, 自动识别文本或二进制格式
+bool loadOrderRecords(const std::string&, std::vector<OrderFileRecord>&);
+
+// 顺序写入报单文件
+class OrderFileWriter{
+public:
+    OrderFileWriter();
+    ~OrderFileWriter();
+    bool open(const std::string&);
+    // 追加一条记录
+    bool append(const OrderFileRecord&);
+    // 回写记录数并关闭
+    bool close();
+private:
+    FILE* file;
+    uint64_t count;
+};
+
+// 以内存映射方式读取报单文件
+class OrderFileReader{
+public:
+    OrderFileReader();
+    ~OrderFileReader();
+    bool open(const std::string&);
+    // 记录数
+    uint64_t size() const;
+    // 第i条记录
+    const OrderFileRecord& at(const uint64_t&) const;
+private:
+    void* data;
+    size_t length;
+    uint64_t count;
+};
+#endif
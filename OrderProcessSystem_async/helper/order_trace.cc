@@ -0,0 +1,197 @@
+#ifndef ORDER_TRACE_CC
+#define ORDER_TRACE_CC
+#include "order_trace.h"
+#include "logger.h"
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+
+static const char* TRACE_EVENT_NAMES[TRACE_EVENT_COUNT]={
+	"received", "accepted", "rested", "matched", "timer armed", "simulated fill", "canceled", "report written", "amended",
+	"stop parked", "triggered"
+};
+
+const char* traceEventName(const int& event){
+	return event>=0&&event<TRACE_EVENT_COUNT?TRACE_EVENT_NAMES[event]:"unknown";
+}
+
+std::atomic<uint64_t> traceSampleEvery(0);
+
+void setTraceSampling(const uint64_t& every){
+	traceSampleEvery.store(every, std::memory_order_relaxed);
+}
+
+// 每个线程的环形缓冲区, 只由所属线程写入
+// 写者先写记录再发布head; 读者复制后重读head, 丢弃复制期间可能被覆盖的记录
+struct TraceRing{
+	std::atomic<uint64_t> head;
+	uint32_t tid;
+	TraceRecord records[TRACE_RING_SIZE];
+	explicit TraceRing(const uint32_t& tid): head(0), tid(tid){}
+};
+
+// 全部线程的环; 线程退出后保留
+static std::mutex& registryMutex(){
+	static std::mutex* m=new std::mutex();
+	return *m;
+}
+
+static std::vector<TraceRing*>& registry(){
+	static auto* r=new std::vector<TraceRing*>();
+	return *r;
+}
+
+static TraceRing* localRing(){
+	static thread_local TraceRing* ring=nullptr;
+	if(ring==nullptr){
+		std::unique_lock<std::mutex> w(registryMutex());
+		ring=new TraceRing(registry().size()+1);
+		registry().push_back(ring);
+	}
+	return ring;
+}
+
+void appendTrace(const uint64_t& tsc, const TraceEvent& event, const uint64_t& orderID, const uint64_t& arg, const uint32_t& qty){
+	TraceRing* ring=localRing();
+	uint64_t head=ring->head.load(std::memory_order_relaxed);
+	ring->records[head&(TRACE_RING_SIZE-1)]={tsc, orderID, arg, qty, static_cast<uint32_t>(event)};
+	ring->head.store(head+1, std::memory_order_release);
+}
+
+static uint64_t steadyNanos(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 进程启动时的时间戳与单调时钟, 导出时据此换算TSC频率
+static const uint64_t calibrationTsc=traceTimestamp();
+static const uint64_t calibrationNanos=steadyNanos();
+
+static double ticksPerNano(){
+#if defined(__x86_64__)||defined(__i386__)
+	if(steadyNanos()-calibrationNanos<10000000ULL){
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	uint64_t nanos=steadyNanos();
+	uint64_t tsc=traceTimestamp();
+	return static_cast<double>(tsc-calibrationTsc)/(nanos-calibrationNanos);
+#else
+	return 1.0;
+#endif
+}
+
+struct TraceEntry{
+	TraceRecord record;
+	uint32_t tid;
+};
+
+// 复制一个环中仍然有效的记录
+static void copyRing(const TraceRing* ring, std::vector<TraceEntry>& entries){
+	uint64_t head=ring->head.load(std::memory_order_acquire);
+	uint64_t begin=head>TRACE_RING_SIZE?head-TRACE_RING_SIZE:0;
+	std::vector<TraceRecord> copied(ring->records, ring->records+TRACE_RING_SIZE);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t after=ring->head.load(std::memory_order_relaxed);
+	// 复制期间写入的记录会覆盖最旧的槽位, 正在写的槽位也一并丢弃
+	if(after+1>begin+TRACE_RING_SIZE) begin=after+1-TRACE_RING_SIZE;
+	for(uint64_t i=begin;i<head;i++){
+		entries.push_back(TraceEntry{copied[i&(TRACE_RING_SIZE-1)], ring->tid});
+	}
+}
+
+static void writeArgs(std::ofstream& out, const TraceRecord& record){
+	out<<"\"args\":{\"order\":"<<record.orderID;
+	if(record.event==TRACE_MATCHED) out<<",\"counterparty\":"<<record.arg;
+	else if(record.event==TRACE_RESTED) out<<",\"leaveQty\":"<<record.arg;
+	if(record.qty>0) out<<",\"qty\":"<<record.qty;
+	out<<"}";
+}
+
+int64_t dumpOrderTrace(const std::string& fileName){
+	std::vector<TraceRing*> rings;
+	{
+		std::unique_lock<std::mutex> w(registryMutex());
+		rings=registry();
+	}
+	std::vector<TraceEntry> entries;
+	for(const TraceRing* ring:rings) copyRing(ring, entries);
+	std::sort(entries.begin(), entries.end(), [](const TraceEntry& a, const TraceEntry& b){
+		return a.record.tsc<b.record.tsc;
+	});
+	std::ofstream out(fileName);
+	if(!out.is_open()) return -1;
+	double scale=1.0/ticksPerNano()/1000.0;
+	uint64_t base=entries.empty()?0:entries.front().record.tsc;
+	auto micros=[&](const uint64_t& tsc){return (tsc-base)*scale;};
+	out<<std::fixed<<std::setprecision(3);
+	out<<"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first=true;
+	auto separator=[&](){
+		if(!first) out<<",";
+		out<<"\n";
+		first=false;
+	};
+	for(const TraceRing* ring:rings){
+		separator();
+		out<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"<<ring->tid
+			<<",\"args\":{\"name\":\"thread "<<ring->tid<<"\"}}";
+	}
+	// 每个订单的第一个与最后一个事件
+	std::unordered_map<uint64_t, std::pair<const TraceEntry*, const TraceEntry*> > spans;
+	for(const auto& entry:entries){
+		const TraceRecord& record=entry.record;
+		separator();
+		out<<"{\"name\":\""<<traceEventName(record.event)<<"\",\"cat\":\"order\",\"ph\":\"i\",\"s\":\"t\",\"ts\":"
+			<<micros(record.tsc)<<",\"pid\":1,\"tid\":"<<entry.tid<<",";
+		writeArgs(out, record);
+		out<<"}";
+		auto it=spans.find(record.orderID);
+		if(it==spans.end()) spans.emplace(record.orderID, std::make_pair(&entry, &entry));
+		else it->second.second=&entry;
+	}
+	for(const auto& [orderID, span]:spans){
+		separator();
+		out<<"{\"name\":\"order "<<orderID<<"\",\"cat\":\"order\",\"ph\":\"b\",\"id\":"<<orderID<<",\"ts\":"
+			<<micros(span.first->record.tsc)<<",\"pid\":1,\"tid\":"<<span.first->tid<<"}";
+		separator();
+		out<<"{\"name\":\"order "<<orderID<<"\",\"cat\":\"order\",\"ph\":\"e\",\"id\":"<<orderID<<",\"ts\":"
+			<<micros(span.second->record.tsc)<<",\"pid\":1,\"tid\":"<<span.second->tid<<"}";
+	}
+	out<<"\n]}\n";
+	out.close();
+	return out?static_cast<int64_t>(entries.size()):-1;
+}
+
+std::string traceFileName(const std::string& dir){
+	time_t now=time(NULL);
+	struct tm local;
+	localtime_r(&now, &local);
+	char buffer[32];
+	strftime(buffer, sizeof(buffer), "%Y%m%d-%H%M%S", &local);
+	return dir+"/trace-"+buffer+".json";
+}
+
+void startTraceDumper(const int& signal, const std::string& dir){
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, signal);
+	pthread_sigmask(SIG_BLOCK, &set, nullptr);
+	std::thread([set, dir](){
+		int received;
+		while(sigwait(&set, &received)==0){
+			std::string fileName=traceFileName(dir);
+			int64_t events=dumpOrderTrace(fileName);
+			if(events<0) LOG_ERROR("Can not write trace: {}", fileName);
+			else LOG_INFO("Trace saved: {}, {} events", fileName, events);
+		}
+	}).detach();
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef ORDER_TRACE_H
+#define ORDER_TRACE_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#if defined(__x86_64__)||defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/*****************************************************************************************
+ * 订单生命周期追踪: 按订单ID抽样, 被抽中订单的每个事件追加到所在线程的环形缓冲区
+ * 每个线程只写自己的环(单写者, 不加锁), 写满后覆盖最旧的记录; 时间戳取TSC
+ * 导出时合并全部线程的环, 写成Chrome trace/Perfetto可读的JSON:
+ *     每个事件为所在线程上的瞬时事件, 每个订单从第一个到最后一个事件另成一段异步区间
+ ****************************************************************************************/
+
+// 每个线程环形缓冲区的记录数(2的幂)
+#define TRACE_RING_SIZE 8192
+// 服务端默认每1024个订单抽样一个
+#define TRACE_DEFAULT_SAMPLE 1024
+
+// 生命周期事件
+enum TraceEvent{
+	TRACE_RECEIVED=0,      // 读到新订单请求
+	TRACE_ACCEPTED,        // 通过检查并分配订单ID
+	TRACE_RESTED,          // 剩余数量挂入股票索引, arg为剩余数量
+	TRACE_MATCHED,         // 与对手方成交, arg为对手方订单ID, qty为成交数量
+	TRACE_TIMER_ARMED,     // 加入计时器
+	TRACE_SIMULATED_FILL,  // 计时器到期后模拟撮合, qty为成交数量
+	TRACE_CANCELED,        // 撤单成功
+	TRACE_REPORT_WRITTEN,  // 回报写入流
+	TRACE_AMENDED,         // 改单成功, arg为新价格的整数部分, qty为新的剩余数量
+	TRACE_STOP_PARKED,     // 止损单挂入止损簿等待触发
+	TRACE_TRIGGERED,       // 止损单被最新成交价触发
+	TRACE_EVENT_COUNT
+};
+
+// 一条追踪记录
+struct TraceRecord{
+	uint64_t tsc;
+	uint64_t orderID;
+	uint64_t arg;
+	uint32_t qty;
+	uint32_t event;
+};
+
+const char* traceEventName(const int&);
+
+// 时间戳计数器, 非x86平台退化为单调时钟
+inline uint64_t traceTimestamp(){
+#if defined(__x86_64__)||defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// 抽样间隔, 0为关闭
+extern std::atomic<uint64_t> traceSampleEvery;
+
+// 设置抽样间隔: 订单ID为n的倍数时追踪, 0关闭
+void setTraceSampling(const uint64_t&);
+
+// 订单是否被抽中
+inline bool traceSampled(const uint64_t& orderID){
+	uint64_t every=traceSampleEvery.load(std::memory_order_relaxed);
+	return every>0&&orderID>0&&orderID%every==0;
+}
+
+// 追加一条记录(调用方已确认被抽中)
+void appendTrace(const uint64_t&, const TraceEvent&, const uint64_t&, const uint64_t&, const uint32_t&);
+
+// 被抽中时记录事件, 时间戳取当前时刻
+inline void traceOrder(const TraceEvent& event, const uint64_t& orderID, const uint64_t& arg=0, const uint32_t& qty=0){
+	if(traceSampled(orderID)) appendTrace(traceTimestamp(), event, orderID, arg, qty);
+}
+
+// 被抽中时以给定时间戳记录事件(事件发生时订单ID尚未确定)
+inline void traceOrderAt(const uint64_t& tsc, const TraceEvent& event, const uint64_t& orderID, const uint64_t& arg=0, const uint32_t& qty=0){
+	if(traceSampled(orderID)) appendTrace(tsc, event, orderID, arg, qty);
+}
+
+// 把全部线程的记录写成JSON文件, 返回写出的事件数, 失败返回-1
+int64_t dumpOrderTrace(const std::string&);
+// 在指定目录下生成带时间戳的文件名
+std::string traceFileName(const std::string&);
+// 收到指定信号时导出到指定目录, 由专门的线程sigwait等待; 调用方需在创建任何线程之前屏蔽该信号(同上)
+void startTraceDumper(const int&, const std::string&);
+#endif
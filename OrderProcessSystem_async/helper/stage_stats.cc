@@ -0,0 +1,179 @@
+#ifndef STAGE_STATS_CC
+#define STAGE_STATS_CC
+#include "stage_stats.h"
+#include <mutex>
+#include <vector>
+#include <cstring>
+#include <iomanip>
+#include <algorithm>
+
+static const char* STAGE_NAMES[STAGE_COUNT]={
+	"read", "validate", "assign id", "order insert", "journal", "match", "book insert", "report write"
+};
+
+static const char* COUNTER_NAMES[COUNTER_COUNT]={
+	"orders", "rejects", "fills", "cancels", "cancel rejects", "amends", "amend rejects", "stop triggers",
+	"quotes", "quote rejects"
+};
+
+const char* stageName(const int& stage){
+	return stage>=0&&stage<STAGE_COUNT?STAGE_NAMES[stage]:"unknown";
+}
+
+const char* counterName(const int& counter){
+	return counter>=0&&counter<COUNTER_COUNT?COUNTER_NAMES[counter]:"unknown";
+}
+
+#define STAGE_HALF_COUNT (1ULL<<(STAGE_SUB_BUCKET_BITS-1))
+
+// 小于2^bits的值逐个成桶, 更大的值按最高位分区间, 区间内取次高的bits-1位作为子桶
+static size_t stageIndexOf(const uint64_t& value){
+	if(value<(STAGE_HALF_COUNT<<1)) return value;
+	int msb=63-__builtin_clzll(value);
+	int shift=msb-STAGE_SUB_BUCKET_BITS+1;
+	return shift*STAGE_HALF_COUNT+(value>>shift);
+}
+
+static uint64_t stageHighestValueOf(const size_t& index){
+	if(index<(STAGE_HALF_COUNT<<1)) return index;
+	uint64_t shift=index/STAGE_HALF_COUNT-1;
+	uint64_t sub=index-shift*STAGE_HALF_COUNT;
+	return ((sub+1)<<shift)-1;
+}
+
+// 每个线程的统计块, 只由所属线程写入
+struct ThreadStageStats{
+	std::atomic<uint64_t> counts[STAGE_COUNT][STAGE_BUCKETS];
+	std::atomic<uint64_t> sums[STAGE_COUNT];
+	std::atomic<uint64_t> maxs[STAGE_COUNT];
+	std::atomic<uint64_t> counters[COUNTER_COUNT];
+	ThreadStageStats(){
+		for(auto& stage:counts) for(auto& c:stage) c.store(0, std::memory_order_relaxed);
+		for(auto& s:sums) s.store(0, std::memory_order_relaxed);
+		for(auto& m:maxs) m.store(0, std::memory_order_relaxed);
+		for(auto& c:counters) c.store(0, std::memory_order_relaxed);
+	}
+};
+
+// 全部线程的统计块; 线程退出后统计块保留, 其数据仍计入合并结果
+static std::mutex& registryMutex(){
+	static std::mutex* m=new std::mutex();
+	return *m;
+}
+
+static std::vector<ThreadStageStats*>& registry(){
+	static auto* r=new std::vector<ThreadStageStats*>();
+	return *r;
+}
+
+static ThreadStageStats* localStats(){
+	static thread_local ThreadStageStats* stats=nullptr;
+	if(stats==nullptr){
+		stats=new ThreadStageStats();
+		std::unique_lock<std::mutex> w(registryMutex());
+		registry().push_back(stats);
+	}
+	return stats;
+}
+
+// 单写者, 不需要原子的读-改-写
+static inline void increase(std::atomic<uint64_t>& value, const uint64_t& n){
+	value.store(value.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+}
+
+void recordStage(const OrderStage& stage, const uint64_t& nanos){
+	ThreadStageStats* stats=localStats();
+	uint64_t value=std::min<uint64_t>(nanos, STAGE_MAX_VALUE);
+	increase(stats->counts[stage][stageIndexOf(value)], 1);
+	increase(stats->sums[stage], value);
+	if(value>stats->maxs[stage].load(std::memory_order_relaxed)){
+		stats->maxs[stage].store(value, std::memory_order_relaxed);
+	}
+}
+
+uint64_t recordStageSince(const OrderStage& stage, const uint64_t& start){
+	uint64_t now=stageNanos();
+	recordStage(stage, now>start?now-start:0);
+	return now;
+}
+
+void addCounter(const OrderCounter& counter, const uint64_t& n){
+	increase(localStats()->counters[counter], n);
+}
+
+StageStatsSnapshot::StageStatsSnapshot(){
+	memset(counts, 0, sizeof(counts));
+	memset(totals, 0, sizeof(totals));
+	memset(sums, 0, sizeof(sums));
+	memset(maxs, 0, sizeof(maxs));
+	memset(counters, 0, sizeof(counters));
+}
+
+void StageStatsSnapshot::collect(){
+	*this=StageStatsSnapshot();
+	std::vector<ThreadStageStats*> all;
+	{
+		std::unique_lock<std::mutex> w(registryMutex());
+		all=registry();
+	}
+	for(const ThreadStageStats* stats:all){
+		for(int s=0;s<STAGE_COUNT;s++){
+			for(size_t i=0;i<STAGE_BUCKETS;i++){
+				uint64_t c=stats->counts[s][i].load(std::memory_order_relaxed);
+				counts[s][i]+=c;
+				totals[s]+=c;
+			}
+			sums[s]+=stats->sums[s].load(std::memory_order_relaxed);
+			maxs[s]=std::max(maxs[s], stats->maxs[s].load(std::memory_order_relaxed));
+		}
+		for(int c=0;c<COUNTER_COUNT;c++){
+			counters[c]+=stats->counters[c].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+uint64_t StageStatsSnapshot::count(const int& stage) const{
+	return totals[stage];
+}
+
+uint64_t StageStatsSnapshot::max(const int& stage) const{
+	return maxs[stage];
+}
+
+double StageStatsSnapshot::mean(const int& stage) const{
+	return totals[stage]>0?static_cast<double>(sums[stage])/totals[stage]:0;
+}
+
+uint64_t StageStatsSnapshot::valueAtPercentile(const int& stage, const double& percentile) const{
+	if(totals[stage]==0) return 0;
+	uint64_t target=std::max<uint64_t>(1, static_cast<uint64_t>(std::min(percentile, 100.0)/100.0*totals[stage]+0.5));
+	uint64_t seen=0;
+	for(size_t i=0;i<STAGE_BUCKETS;i++){
+		seen+=counts[stage][i];
+		if(seen>=target) return std::min(stageHighestValueOf(i), maxs[stage]);
+	}
+	return maxs[stage];
+}
+
+uint64_t StageStatsSnapshot::counter(const int& counter) const{
+	return counters[counter];
+}
+
+void StageStatsSnapshot::print(std::ostream& out) const{
+	std::ios::fmtflags flags=out.flags();
+	out<<std::fixed<<std::setprecision(3);
+	out<<"Order stages(us):"<<std::endl;
+	for(int s=0;s<STAGE_COUNT;s++){
+		out<<"	"<<stageName(s)<<": count "<<count(s)<<", mean "<<mean(s)/1000.0
+			<<", p50 "<<valueAtPercentile(s, 50)/1000.0<<", p90 "<<valueAtPercentile(s, 90)/1000.0
+			<<", p99 "<<valueAtPercentile(s, 99)/1000.0<<", p99.9 "<<valueAtPercentile(s, 99.9)/1000.0
+			<<", max "<<max(s)/1000.0<<std::endl;
+	}
+	out<<"	counters:";
+	for(int c=0;c<COUNTER_COUNT;c++){
+		out<<(c>0?", ":" ")<<counterName(c)<<" "<<counter(c);
+	}
+	out<<std::endl;
+	out.flags(flags);
+}
+#endif
@@ -0,0 +1,86 @@
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/*****************************************************************************************
+ * 订单处理各阶段的耗时统计与计数
+ * 每个线程首次记录时分配自己的统计块, 只有该线程写入(原子变量的relaxed读写, 不加锁),
+ * 查询时遍历全部线程的统计块合并, 合并结果是近似一致的
+ * 直方图按2的幂分区间, 每个区间再分8个子桶, 相对误差约12.5%
+ ****************************************************************************************/
+
+// 新订单经过的阶段
+enum OrderStage{
+	STAGE_READ=0,        // gRPC读到请求至进入撮合引擎
+	STAGE_VALIDATE,      // 合法性检查(checkRequest)与对敲检查
+	STAGE_ASSIGN_ID,     // 分配订单ID
+	STAGE_ORDER_INSERT,  // 存入订单容器
+	STAGE_JOURNAL,       // 写入事件日志
+	STAGE_MATCH,         // 与对手方挂单撮合
+	STAGE_BOOK_INSERT,   // 剩余数量挂入股票索引并计时
+	STAGE_REPORT_WRITE,  // 回报写入流至写完成
+	STAGE_COUNT
+};
+
+// 计数
+enum OrderCounter{
+	COUNTER_ORDERS=0,        // 接受的新订单
+	COUNTER_REJECTS,         // 拒绝的新订单
+	COUNTER_FILLS,           // 成交回报(含模拟撮合)
+	COUNTER_CANCELS,         // 撤单成功
+	COUNTER_CANCEL_REJECTS,  // 撤单拒绝
+	COUNTER_AMENDS,          // 改单成功
+	COUNTER_AMEND_REJECTS,   // 改单拒绝
+	COUNTER_STOP_TRIGGERS,   // 触发的止损单
+	COUNTER_QUOTES,          // 接受的报价
+	COUNTER_QUOTE_REJECTS,   // 拒绝的报价
+	COUNTER_COUNT
+};
+
+#define STAGE_SUB_BUCKET_BITS 4
+// 超过约68秒的值按最大值记录
+#define STAGE_MAX_VALUE ((1ULL<<36)-1)
+#define STAGE_BUCKETS ((36-STAGE_SUB_BUCKET_BITS+2)<<(STAGE_SUB_BUCKET_BITS-1))
+
+const char* stageName(const int&);
+const char* counterName(const int&);
+
+// 单调时钟(纳秒)
+inline uint64_t stageNanos(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 记录本线程一个阶段的耗时(纳秒)
+void recordStage(const OrderStage&, const uint64_t&);
+// 记录从start至今的耗时, 返回当前时刻, 便于连续记录相邻阶段
+uint64_t recordStageSince(const OrderStage&, const uint64_t&);
+// 累加本线程的计数
+void addCounter(const OrderCounter&, const uint64_t& n=1);
+
+// 全部线程合并后的统计
+class StageStatsSnapshot{
+public:
+	StageStatsSnapshot();
+	// 合并全部线程当前的统计
+	void collect();
+	uint64_t count(const int&) const;
+	uint64_t max(const int&) const;
+	double mean(const int&) const;
+	// 百分位(p取0~100)所在桶的上界
+	uint64_t valueAtPercentile(const int&, const double&) const;
+	uint64_t counter(const int&) const;
+	// 输出各阶段分位数(微秒)与计数
+	void print(std::ostream&) const;
+private:
+	uint64_t counts[STAGE_COUNT][STAGE_BUCKETS];
+	uint64_t totals[STAGE_COUNT];
+	uint64_t sums[STAGE_COUNT];
+	uint64_t maxs[STAGE_COUNT];
+	uint64_t counters[COUNTER_COUNT];
+};
+#endif
@@ -4,28 +4,69 @@
 #include "../timer/timer.h"
 
 // 构造函数
-SellAndBuyContainer::SellAndBuyContainer(){
-    sell_mutex_ptr=new std::mutex();
-    buy_mutex_ptr=new std::mutex();
-	sell.clear();
-	buy.clear();
-}
+template<typename LockPolicy>
+SellAndBuyContainer<LockPolicy>::SellAndBuyContainer(): sell(false, "SellAndBuyContainer::sell"), buy(true, "SellAndBuyContainer::buy"){}
 
-MarketSystem* MarketSystem::m_instance=new MarketSystem;
+// 获取实例
+template<typename LockPolicy>
+BasicMarketSystem<LockPolicy>* BasicMarketSystem<LockPolicy>::getInstance(){
+	static BasicMarketSystem* m_instance=new BasicMarketSystem();
+	return m_instance;
+}
 
 // 构造函数
-MarketSystem::MarketSystem(){
+template<typename LockPolicy>
+BasicMarketSystem<LockPolicy>::BasicMarketSystem(const bool& runTimer){
     id=0;
-	marketPrice=5.0;
-	timer=new Timer();
-	std::thread t(&Timer::run, timer);
-	t.detach();
+	stock_index.store(new StockIndex());
+	timer=new BasicTimer<LockPolicy>(this);
+	if(runTimer) startTimer();
+}
+
+// 析构函数
+template<typename LockPolicy>
+BasicMarketSystem<LockPolicy>::~BasicMarketSystem(){
+	stopTimer();
+	delete timer;
+	// 此时没有读者
+	StockIndex* index=stock_index.load();
+	for(auto& [stockID, container]:*index){
+		delete container;
+	}
+	delete index;
+	// 释放等待回收的旧股票索引
+	reclaimRetired();
+}
+
+// 启动计时器线程
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::startTimer(){
+	if constexpr(!LockPolicy::threadSafe){
+		LOG_ERROR("Single-threaded market system can not run the timer thread");
+		return;
+	}
+	if(!timerThread.joinable()){
+		timer->start();
+		timerThread=std::thread(&BasicTimer<LockPolicy>::run, timer);
+	}
+}
+
+// 停止计时器线程
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::stopTimer(){
+	if(timerThread.joinable()){
+		timer->stop();
+		timerThread.join();
+	}
 }
 
 // 创建订单
-uint64_t MarketSystem::createOrder(const NewOrderRequest& request, std::string& errorMessage){
+template<typename LockPolicy>
+uint64_t BasicMarketSystem<LockPolicy>::createOrder(const NewOrderRequest& request, std::string& errorMessage){
+	uint64_t stageStart=Instrument::now();
 	// 判断订单的合法性
 	if(!checkRequest(request, errorMessage)){
+		Instrument::recordStageSince(STAGE_VALIDATE, stageStart);
 		return 0;
 	}
 	// 获取订单的用户ID
@@ -35,27 +76,33 @@ uint64_t MarketSystem::createOrder(const NewOrderRequest& request, std::string&
 	// 判断是否是对敲
 	if(orderSystem.isImproperMatchedOrder(request)){
 		errorMessage="Improper Matched Order!";
+		Instrument::recordStageSince(STAGE_VALIDATE, stageStart);
 		return 0;
 	}
+	stageStart=Instrument::recordStageSince(STAGE_VALIDATE, stageStart);
 	{
 		// 加锁,保护订单编号动态增加,作用域结束自动解锁
-		std::unique_lock<std::mutex> w_(orderID_mutex);
+		std::unique_lock<Mutex> w_(orderID_mutex);
 		// 为订单分配ID
 		orderID=++id;
 	}
+	stageStart=Instrument::recordStageSince(STAGE_ASSIGN_ID, stageStart);
 	// 获取订单对应的股票ID
 	std::string stockID=request.stockid();
 	// 为stockID分配容器对象和锁
-	if(!isStockExistsInHash(stockID)){
-		insertStock(stockID);
+	Container* container=findStock(stockID);
+	if(container==nullptr){
+		container=insertStock(stockID);
 	}
-	// 将订单存入订单集合中
-    orderSystem.insertOrder(orderID, request);
+	// 将订单存入订单集合中, 并记下订单所属一侧的挂单簿
+    orderSystem.insertOrder(orderID, request, request.direction()==NewOrderRequest::SELL?&container->sell:&container->buy);
+	Instrument::recordStageSince(STAGE_ORDER_INSERT, stageStart);
 	return orderID;
 }
 
 // 创建订单并且保存执行结果
-uint64_t MarketSystem::processCreateOrder(const NewOrderRequest& request, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+template<typename LockPolicy>
+uint64_t BasicMarketSystem<LockPolicy>::processCreateOrder(const NewOrderRequest& request, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
 	// 错误信息
 	std::string errorMessage="";
 
@@ -70,310 +117,1431 @@ uint64_t MarketSystem::processCreateOrder(const NewOrderRequest& request, std::v
 		report.set_time(getTime());
 		report.set_errormessage(errorMessage);
 		reports.push_back(std::make_pair(0, report));
+		Instrument::addCounter(COUNTER_REJECTS);
 	}else{
 		// 输出订单创建成功的消息
 		report.set_stat(ExecutionReport::ORDER_ACCEPT);
 		report.set_orderid(orderID);
 		report.set_time(getTime());
-		reports.push_back(std::make_pair(orderID, report));
+		reports.push_back(std::make_pair(restsOnBook(request)?orderID:0, report));
+		Instrument::addCounter(COUNTER_ORDERS);
+		Instrument::traceOrder(TRACE_ACCEPTED, orderID);
 	}
 	// 将订单ID返回给服务器
 	return orderID;
 }
 
 // 根据新订单请求做出应答消息
-void MarketSystem::processNewOrder(const NewOrderRequest& request, const uint64_t& orderID, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processNewOrder(const NewOrderRequest& request, const uint64_t& orderID, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+	// 引擎读锁, 与快照互斥
+	std::shared_lock<SharedMutex> r(rw_engine_mutex);
+	// 股票在创建订单时已建好; 在事件锁内写日志并撮合, 包括由此触发的止损单
+	std::unique_lock<Mutex> event=lockEvents(findStock(request.stockid()));
+	// 写入日志
+	uint64_t stageStart=Instrument::now();
+	JournalRecord record=makeJournalRecord(EVENT_NEW_ORDER, orderID, request);
+	journal.append(record);
+	Instrument::recordStageSince(STAGE_JOURNAL, stageStart);
+	newOrder(request, orderID, reports);
+}
+
+// 撮合新订单
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::newOrder(const NewOrderRequest& request, const uint64_t& orderID, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+	std::vector<OrderType*> stops;
+	executeOrder(request, orderID, false, reports, stops);
+	activateStops(stops, reports);
+}
+
+// 撮合一个订单
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::executeOrder(const NewOrderRequest& request, const uint64_t& orderID, const bool& activated,
+		std::vector<std::pair<uint64_t, ExecutionReport> >& reports, std::vector<OrderType*>& stops){
 	// 获取订单对应的股票ID
 	auto stockID=request.stockid();
-	// 获取订单对应的用户ID
-	auto clientID=request.clientid();
-
-    // 自动撮合订单
-    if(isStockExistsInHash(stockID)){
+	// 市价单与IOC, FOK不挂单
+	bool immediate=!restsOnBook(request);
+	bool fillOrKill=request.timeinforce()==NewOrderRequest::FOK;
+	uint64_t stageStart=Instrument::now();
+	size_t reportsBefore=reports.size();
+	// 订单在挂单前只由本线程访问, 句柄保持有效
+	OrderType* order=orderSystem.findOrder(orderID);
+	Container* container=findStock(stockID);
+	// 止损单不撮合, 挂入止损簿等待触发; 最新成交价已穿过止损价时直接触发
+	if(request.stopprice()>0&&order!=nullptr&&container!=nullptr){
+		if(parkStop(order, container)){
+			Instrument::traceOrder(TRACE_STOP_PARKED, orderID);
+		}else{
+			stops.push_back(order);
+		}
+		Instrument::recordStageSince(STAGE_BOOK_INSERT, stageStart);
+		return;
+	}
+	TradeRange traded;
+    // 自动撮合订单; 集合竞价期间只收单(在对手方的锁内判断), 不挂单的订单直接撤销
+    if(order!=nullptr&&container!=nullptr){
         if(request.direction()==NewOrderRequest::SELL){
             // 存在该股票, 搜索买订单
-            sellOrders(orderID, stockID, clientID, reports);
+            sellOrders(order, container, reports, fillOrKill, traded);
         }else{
             // 存在该股票, 搜索卖订单
-            buyOrders(orderID, stockID, clientID, reports);
+            buyOrders(order, container, reports, fillOrKill, traded);
         }
     }
+	// 成交价穿过的止损单在本订单处理完后依次撮合
+	if(traded.high>0) collectStops(container, traded, stops);
+	stageStart=Instrument::recordStageSince(STAGE_MATCH, stageStart);
+	// 撮合产生的成交回报(限价单双方各一条, 市价单每档一条)
+	Instrument::addCounter(COUNTER_FILLS, reports.size()-reportsBefore);
+	// 不挂单的订单没有登记回报流, 自身的成交回报写回当前流; 已触发的止损单登记过回报流
+	if(immediate&&!activated){
+		for(size_t i=reportsBefore;i<reports.size();i++){
+			if(reports[i].first==orderID) reports[i].first=0;
+		}
+	}
 
-    // 订单信息
-    NewOrderRequest orderInfo;	
-    // 剩余待购买订单数不为0, 加入buy集合, 否则从订单集合中删除该订单
-	if(orderSystem.getOrderInfo(orderID, orderInfo)&&orderInfo.orderqty()>0){
-        // 将订单挂在股票索引上等待购买
-        if(request.direction()==NewOrderRequest::SELL){
-            addOrderToSell(stockID, orderID);
-        }else{
-            addOrderToBuy(stockID, orderID);
-        }
-        // 添加计时任务至计时器
-		timer->addTask(orderID);
+    // 订单剩余数量
+    uint32_t qty=0;
+    double price;
+    if(order!=nullptr) order->read(qty, price);
+    // 剩余数量不为0, 挂到价格档位, 否则从订单集合中删除该订单
+	if(qty>0&&!immediate){
+        Instrument::traceOrder(TRACE_RESTED, orderID, qty);
+        // 挂单并添加计时任务
+        addOrderToBook(order);
     }else{
+        // 不挂单的剩余数量直接撤销, 不经过挂单簿与计时器
+        if(qty>0){
+            ExecutionReport report;
+            initReport(report, request);
+            report.set_stat(ExecutionReport::CANCELED);
+            report.set_orderid(orderID);
+            report.set_leaveqty(qty);
+            report.set_time(getTime());
+            reports.push_back(std::make_pair(activated?orderID:0, report));
+            Instrument::traceOrder(TRACE_CANCELED, orderID, 0, qty);
+        }
         // 删除订单
         orderSystem.deleteOrder(orderID);
     }
+	Instrument::recordStageSince(STAGE_BOOK_INSERT, stageStart);
+}
+
+// 依次撮合被触发的止损单
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::activateStops(std::vector<OrderType*>& stops, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+	NewOrderRequest request;
+	// 撮合会向stops追加新触发的止损单, 按下标遍历
+	for(size_t i=0;i<stops.size();i++){
+		// 已从止损簿取出, 撤单找不到它, 与新订单一样只由本线程访问
+		OrderType* order=stops[i];
+		order->copyTo(request);
+		ExecutionReport report;
+		initReport(report, request);
+		report.set_stat(ExecutionReport::TRIGGERED);
+		report.set_orderid(order->id_);
+		report.set_leaveqty(request.orderqty());
+		report.set_time(getTime());
+		reports.push_back(std::make_pair(order->id_, report));
+		Instrument::addCounter(COUNTER_STOP_TRIGGERS);
+		Instrument::traceOrder(TRACE_TRIGGERED, order->id_);
+		// 触发后按普通的限价单或市价单撮合, 之后才计入对敲检查
+		orderSystem.activateOrder(*order);
+		request.set_stopprice(0);
+		executeOrder(request, order->id_, true, reports, stops);
+	}
 }
 
 // 根据撤销订单请求做出应答消息
-void MarketSystem::processCancelOrder(const CancelOrderRequest& request, ExecutionReport& report){
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processCancelOrder(const CancelOrderRequest& request, ExecutionReport& report){
 	// 错误信息
 	std::string errorMessage="";
 	uint64_t orderID=request.orderid();
     // 订单信息
 	NewOrderRequest orderInfo;
-	// 获取order信息
-	if(!orderSystem.getOrderInfo(orderID, orderInfo)){
-		errorMessage="Error: Can not find OrderID!";
-		report.set_time(getTime());
-		report.set_errormessage(errorMessage);
-		return;	
+	{
+		// 引擎读锁, 与快照互斥
+		std::shared_lock<SharedMutex> r(rw_engine_mutex);
+		Container* container=findOrderStock(orderID);
+		std::unique_lock<Mutex> event=lockEvents(container);
+		if(container==nullptr||!cancelOrder(orderID, orderInfo)){
+			errorMessage="Error: Can not find OrderID!";
+			report.set_time(getTime());
+			report.set_errormessage(errorMessage);
+			Instrument::addCounter(COUNTER_CANCEL_REJECTS);
+			return;
+		}
+		// 撤单成功写入日志
+		JournalRecord record=makeJournalRecord(EVENT_CANCEL_ORDER, orderID);
+		journal.append(record);
 	}
-	std::string stockID=orderInfo.stockid();
-	uint64_t clientID=orderInfo.clientid();
-	
-	// 从定时器中删除任务
-	timer->delTask(orderID);
 
-	if(orderInfo.direction()==NewOrderRequest::SELL){
-		// 从卖集合容器中删除订单
-		delOrderFromSell(stockID, orderID);
-	}else{
-		// 从买集合容器中删除订单
-		delOrderFromBuy(stockID, orderID);
-	}
+	report.set_stat(ExecutionReport::CANCELED);
+	report.set_clientid(orderInfo.clientid());
+	report.set_stockid(orderInfo.stockid());
+	report.set_orderqty(orderInfo.orderqty());
+	report.set_orderprice(orderInfo.price());
+	report.set_leaveqty(orderInfo.orderqty());
+	report.set_time(getTime());
+	Instrument::addCounter(COUNTER_CANCELS);
+	Instrument::traceOrder(TRACE_CANCELED, orderID);
+}
+
+// 撤销订单
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::cancelOrder(const uint64_t& orderID, NewOrderRequest& orderInfo){
+	// 订单系统的写锁内按句柄从价格档位与计时器中摘除, 只查找一次订单
+	return orderSystem.removeOrder(orderID, orderInfo, [this](OrderType& order){
+		return delOrderFromBook(order);
+	});
+}
+
+// 根据改单请求做出应答消息
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processAmendOrder(const AmendOrderRequest& request, ExecutionReport& report){
+	std::string errorMessage="";
+	uint64_t orderID=request.orderid();
+	// 改后的订单信息
+	NewOrderRequest orderInfo;
 	{
-		// 从订单容器中删除订单
-		if(!orderSystem.deleteOrder(orderID)){
+		// 引擎读锁, 与快照互斥
+		std::shared_lock<SharedMutex> r(rw_engine_mutex);
+		Container* container=findOrderStock(orderID);
+		std::unique_lock<Mutex> event=lockEvents(container);
+		if(container==nullptr){
 			errorMessage="Error: Can not find OrderID!";
+		}
+		if(container==nullptr||!amendOrder(orderID, request.orderqty(), request.price(), orderInfo, errorMessage)){
 			report.set_time(getTime());
 			report.set_errormessage(errorMessage);
-			return;	
+			Instrument::addCounter(COUNTER_AMEND_REJECTS);
+			return;
 		}
+		// 改单成功写入日志, 记录改后的剩余数量与价格
+		JournalRecord record=makeJournalRecord(EVENT_AMEND_ORDER, orderID);
+		record.orderQty=orderInfo.orderqty();
+		record.price=orderInfo.price();
+		journal.append(record);
 	}
 
-	report.set_stat(ExecutionReport::CANCELED);
+	report.set_stat(ExecutionReport::REPLACED);
 	report.set_clientid(orderInfo.clientid());
-	report.set_stockid(stockID);
+	report.set_stockid(orderInfo.stockid());
 	report.set_orderqty(orderInfo.orderqty());
 	report.set_orderprice(orderInfo.price());
 	report.set_leaveqty(orderInfo.orderqty());
 	report.set_time(getTime());
+	Instrument::addCounter(COUNTER_AMENDS);
+	Instrument::traceOrder(TRACE_AMENDED, orderID, static_cast<uint64_t>(orderInfo.price()), orderInfo.orderqty());
+}
+
+// 改单
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::amendOrder(const uint64_t& orderID, const uint32_t& qty, const double& price,
+		NewOrderRequest& orderInfo, std::string& errorMessage){
+	// 订单系统的写锁内按句柄修改, 只查找一次订单
+	return orderSystem.amendOrder(orderID, qty, price, orderInfo, errorMessage,
+		[this](OrderType& order, const uint32_t& newQty, const double& newPrice, std::string& error){
+			return amendOnBook(order, newQty, newPrice, error);
+		});
+}
+
+// 根据批量撤单请求做出应答消息
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processMassCancel(const MassCancelRequest& request, MassCancelReply& reply){
+	// 必须指定用户或股票, 避免误撤全部挂单
+	if(request.clientid()==0&&request.stockid().empty()){
+		reply.set_errormessage("Error: MassCancel needs clientID or stockID!");
+		reply.set_time(getTime());
+		Instrument::addCounter(COUNTER_CANCEL_REJECTS);
+		return;
+	}
+	// 日志中截断的股票ID回放时会撤销另一只股票的挂单
+	std::string errorMessage="";
+	if(!request.stockid().empty()&&!checkStockID(request.stockid(), errorMessage)){
+		reply.set_errormessage(errorMessage);
+		reply.set_time(getTime());
+		Instrument::addCounter(COUNTER_CANCEL_REJECTS);
+		return;
+	}
+	std::vector<std::pair<uint64_t, NewOrderRequest> > canceled;
+	{
+		// 引擎读锁, 与快照互斥
+		std::shared_lock<SharedMutex> r(rw_engine_mutex);
+		std::vector<Container*> containers;
+		std::unique_lock<Mutex> indexLock;
+		if(request.clientid()!=0){
+			// 按用户撤单可能涉及任意股票: 加全部股票的事件锁, 期间不新增股票, 之后新建的订单都排在本条日志之后
+			indexLock=std::unique_lock<Mutex>(stock_index_write_mutex);
+			for(const auto& [stockID, container]:*stock_index.load()){
+				containers.push_back(container);
+			}
+		}else{
+			containers.push_back(findStock(request.stockid()));
+		}
+		std::vector<std::unique_lock<Mutex> > events;
+		lockEvents(containers, events);
+		if(massCancelOrders(request.clientid(), request.stockid(), request.side(), canceled)>0){
+			// 整个请求写一条日志, 回放时按相同条件重新筛选
+			JournalRecord record=makeJournalRecord(request);
+			journal.append(record);
+		}
+	}
+	std::string time=getTime();
+	for(const auto& [orderID, orderInfo]:canceled){
+		ExecutionReport* report=reply.add_reports();
+		report->set_stat(ExecutionReport::CANCELED);
+		report->set_orderid(orderID);
+		report->set_clientid(orderInfo.clientid());
+		report->set_stockid(orderInfo.stockid());
+		report->set_orderqty(orderInfo.orderqty());
+		report->set_orderprice(orderInfo.price());
+		report->set_leaveqty(orderInfo.orderqty());
+		report->set_time(time);
+		Instrument::traceOrder(TRACE_CANCELED, orderID);
+	}
+	reply.set_canceled(canceled.size());
+	reply.set_time(time);
+	Instrument::addCounter(COUNTER_CANCELS, canceled.size());
+}
+
+// 批量撤单
+template<typename LockPolicy>
+size_t BasicMarketSystem<LockPolicy>::massCancelOrders(const uint64_t& clientID, const std::string& stockID,
+		const MassCancelRequest::Side& side, std::vector<std::pair<uint64_t, NewOrderRequest> >& canceled){
+	bool sell=side!=MassCancelRequest::BUY;
+	bool buy=side!=MassCancelRequest::SELL;
+	if(clientID!=0){
+		// 按用户的订单ID索引遍历, 耗时与该用户的订单数成正比
+		return orderSystem.removeClientOrders(clientID, [&](OrderType& order){
+			if(!stockID.empty()&&order.info_.stockid()!=stockID) return false;
+			if(!(order.info_.direction()==NewOrderRequest::SELL?sell:buy)) return false;
+			return delOrderFromBook(order);
+		}, canceled);
+	}
+	Container* container=findStock(stockID);
+	if(container==nullptr){
+		return 0;
+	}
+	// 按股票遍历所选一侧的全部档位, 耗时与该侧的挂单数成正比
+	return orderSystem.removeOrders([&](std::vector<OrderType*>& selected){
+		for(BookSide<LockPolicy>* bookSide:{sell?&container->sell:nullptr, buy?&container->buy:nullptr}){
+			if(bookSide==nullptr) continue;
+			std::unique_lock<Mutex> w(bookSide->mutex);
+			size_t first=selected.size();
+			for(auto& [price, level]:bookSide->levels()){
+				for(OrderType* order=level.head;order!=nullptr;order=order->next_){
+					selected.push_back(order);
+				}
+			}
+			// 等待触发的止损单一并撤销
+			for(const auto& [stopPrice, order]:bookSide->stops()){
+				selected.push_back(order);
+			}
+			// 摘除会删除空档位, 收集完再逐个摘除
+			for(size_t i=first;i<selected.size();i++){
+				if(!bookSide->remove(selected[i])) bookSide->unpark(selected[i]);
+				timer->delTask(selected[i]->task_);
+			}
+		}
+	}, canceled);
+}
+
+// 集合竞价
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processAuction(const AuctionRequest& request, AuctionReply& reply){
+	std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+	{
+		// 引擎读锁, 与快照互斥; 竞价状态在该股票两侧的锁内切换, 不影响其他股票的撮合
+		std::shared_lock<SharedMutex> r(rw_engine_mutex);
+		// 开盘前可能还没有订单: 持有事件锁时不新增股票, 先建好容器
+		std::string errorMessage="";
+		Container* container=findStock(request.stockid());
+		if(container==nullptr&&request.action()==AuctionRequest::CALL&&checkStockID(request.stockid(), errorMessage)){
+			container=insertStock(request.stockid());
+		}
+		std::unique_lock<Mutex> event=lockEvents(container);
+		if(!auction(request.stockid(), request.action(), reply, reports)){
+			reply.set_time(getTime());
+			return;
+		}
+		JournalRecord record=makeJournalRecord(request);
+		journal.append(record);
+	}
+	// 回报与模拟撮合一样推送给各订单的回报流, 包括触发的止损单
+	for(auto& [orderID, report]:reports){
+		matchReports.push(std::move(report));
+	}
+	// 触发的止损单的成交已在撮合时计数
+	Instrument::addCounter(COUNTER_FILLS, reply.fills());
+	reply.set_time(getTime());
+}
+
+// 开始或结束集合竞价
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::auction(const std::string& stockID, const AuctionRequest::Action& action,
+		AuctionReply& reply, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+	reply.set_stockid(stockID);
+	std::string errorMessage="";
+	if(!checkStockID(stockID, errorMessage)){
+		reply.set_errormessage(errorMessage);
+		return false;
+	}
+	Container* container=findStock(stockID);
+	if(action==AuctionRequest::CALL){
+		// 开盘前可能还没有订单
+		if(container==nullptr){
+			container=insertStock(stockID);
+		}
+		// 两侧的锁, 顺序与改单一致, 先卖后买; 撮合在对手方的锁内读竞价状态
+		std::unique_lock<Mutex> s(container->sell.mutex);
+		std::unique_lock<Mutex> b(container->buy.mutex);
+		if(container->auction.load(std::memory_order_relaxed)){
+			reply.set_errormessage("Error: Stock is already in auction!");
+			return false;
+		}
+		container->auction.store(true, std::memory_order_relaxed);
+		return true;
+	}
+	if(container==nullptr){
+		reply.set_errormessage("Error: Stock is not in auction!");
+		return false;
+	}
+	// 全部成交的订单, 释放集合锁后再从订单系统删除
+	std::vector<uint64_t> filled;
+	{
+		// 两侧的锁, 顺序与改单一致
+		std::unique_lock<Mutex> s(container->sell.mutex);
+		std::unique_lock<Mutex> b(container->buy.mutex);
+		if(!container->auction.load(std::memory_order_relaxed)){
+			reply.set_errormessage("Error: Stock is not in auction!");
+			return false;
+		}
+		size_t reportsBefore=reports.size();
+		uncross(container, reply, reports, filled);
+		// 只计竞价撮合的成交, 之后触发的止损单与其成交不计入
+		reply.set_fills(reports.size()-reportsBefore);
+		container->auction.store(false, std::memory_order_relaxed);
+	}
+	for(const auto& orderID:filled){
+		orderSystem.deleteOrder(orderID);
+	}
+	// 竞价成交价穿过的止损单按连续撮合依次处理
+	if(reply.volume()>0){
+		TradeRange traded;
+		traded.add(reply.price());
+		std::vector<OrderType*> stops;
+		collectStops(container, traded, stops);
+		activateStops(stops, reports);
+	}
+	return true;
+}
+
+// 集合竞价撮合
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::uncross(Container* container, AuctionReply& reply,
+		std::vector<std::pair<uint64_t, ExecutionReport> >& reports, std::vector<uint64_t>& filled){
+	auto& sells=container->sell.levels();
+	auto& buys=container->buy.levels();
+	if(sells.empty()||buys.empty()||sells.begin()->first>buys.begin()->first){
+		return;
+	}
+	double bestAsk=sells.begin()->first;
+	double bestBid=buys.begin()->first;
+	// 档位的有效数量, 不计等待删除的订单
+	auto levelQty=[](const PriceLevel<LockPolicy>& level){
+		uint64_t total=0;
+		for(const OrderType* order=level.head;order!=nullptr;order=order->next_){
+			uint32_t qty;
+			double price;
+			order->read(qty, price);
+			total+=qty;
+		}
+		return total;
+	};
+	// 交叉区间内各档位的数量, 按价格升序: 卖方不高于最优买价, 买方不低于最优卖价
+	std::vector<std::pair<double, uint64_t> > sellDepth, buyDepth;
+	for(auto level=sells.begin();level!=sells.end()&&level->first<=bestBid;++level){
+		sellDepth.emplace_back(level->first, levelQty(level->second));
+	}
+	uint64_t buyTotal=0;
+	for(auto level=buys.begin();level!=buys.end()&&level->first>=bestAsk;++level){
+		buyDepth.emplace_back(level->first, levelQty(level->second));
+		buyTotal+=buyDepth.back().second;
+	}
+	std::reverse(buyDepth.begin(), buyDepth.end());
+	// 参考价为最新成交价, 尚无成交时取最优买卖价的中点
+	double reference=container->lastPrice.load(std::memory_order_relaxed);
+	if(reference==0) reference=(bestAsk+bestBid)/2;
+	// 按价格升序归并两侧档位一遍: supply为不高于该价的卖量, demand为不低于该价的买量
+	// 取成交量最大的价格, 相同时取买卖不平衡量最小的, 再相同时取离参考价最近的
+	double price=0;
+	uint64_t volume=0, imbalance=0, supply=0, below=0;
+	for(size_t i=0, j=0;i<sellDepth.size()||j<buyDepth.size();){
+		double candidate=(j>=buyDepth.size()||(i<sellDepth.size()&&sellDepth[i].first<=buyDepth[j].first))?sellDepth[i].first:buyDepth[j].first;
+		while(i<sellDepth.size()&&sellDepth[i].first<=candidate) supply+=sellDepth[i++].second;
+		uint64_t demand=buyTotal-below;
+		uint64_t executable=std::min(supply, demand);
+		uint64_t diff=supply>demand?supply-demand:demand-supply;
+		if(executable>volume||(executable==volume&&executable>0&&(diff<imbalance
+				||(diff==imbalance&&std::abs(candidate-reference)<std::abs(price-reference))))){
+			price=candidate;
+			volume=executable;
+			imbalance=diff;
+		}
+		while(j<buyDepth.size()&&buyDepth[j].first<=candidate) below+=buyDepth[j++].second;
+	}
+	if(volume==0){
+		return;
+	}
+	// 参与成交的订单按价格优先, 时间优先排列; 成交会删除空档位, 先收集再撮合
+	// 对敲检查保证同一用户的买卖单不会交叉, 任意一对参与者都可以成交
+	std::vector<OrderType*> sellers, buyers;
+	for(auto level=sells.begin();level!=sells.end()&&level->first<=price;++level){
+		for(OrderType* order=level->second.head;order!=nullptr;order=order->next_) sellers.push_back(order);
+	}
+	for(auto level=buys.begin();level!=buys.end()&&level->first>=price;++level){
+		for(OrderType* order=level->second.head;order!=nullptr;order=order->next_) buyers.push_back(order);
+	}
+	// 成交后全部成交的订单摘除, 部分成交的重新计时; 返回订单是否全部成交
+	auto settle=[&](OrderType* order, BookSide<LockPolicy>& side){
+		uint32_t qty;
+		double orderPrice;
+		order->read(qty, orderPrice);
+		if(qty>0){
+			timer->addTask(order->id_, order->task_);
+			return false;
+		}
+		side.remove(order);
+		timer->delTask(order->task_);
+		filled.push_back(order->id_);
+		return true;
+	};
+	size_t s=0, b=0;
+	while(s<sellers.size()&&b<buyers.size()){
+		uint32_t sellQty, buyQty;
+		double orderPrice;
+		sellers[s]->read(sellQty, orderPrice);
+		buyers[b]->read(buyQty, orderPrice);
+		if(sellQty==0||buyQty==0){
+			// 等待删除的订单不参与
+			if(sellQty==0) ++s;
+			if(buyQty==0) ++b;
+			continue;
+		}
+		orderSystem.tradingOrders(sellers[s], buyers[b], true, reports, true, price);
+		if(settle(sellers[s], container->sell)) ++s;
+		if(settle(buyers[b], container->buy)) ++b;
+	}
+	container->lastPrice.store(price, std::memory_order_relaxed);
+	reply.set_price(price);
+	reply.set_volume(volume);
+}
+
+// 检查一条报价: 两侧都是限价当日有效的挂单, 有数量的一侧按新订单检查, 两侧都有时买价须低于卖价
+static bool checkQuote(const uint64_t& clientID, const QuoteEntry& quote, std::string& errorMessage){
+	if(!checkStockID(quote.stockid(), errorMessage)){
+	}else if(quote.bidqty()>0&&!checkRequest(MakeNewOrderRequest(TYPE_LIMIT, !DIRE_SELL, clientID, quote.stockid(), quote.bidqty(), quote.bidprice()), errorMessage)){
+	}else if(quote.askqty()>0&&!checkRequest(MakeNewOrderRequest(TYPE_LIMIT, DIRE_SELL, clientID, quote.stockid(), quote.askqty(), quote.askprice()), errorMessage)){
+	}else if(quote.bidqty()>0&&quote.askqty()>0&&quote.bidprice()>=quote.askprice()){
+		errorMessage="Error: Bid must be below ask!";
+	}
+	return errorMessage.empty();
+}
+
+// 根据批量报价请求替换用户的双边报价
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processMassQuote(const MassQuoteRequest& request, MassQuoteReply& reply){
+	uint64_t clientID=request.clientid();
+	reply.set_clientid(clientID);
+	if(clientID==0){
+		reply.set_errormessage("Error: ClientID is illegal!");
+		reply.set_time(getTime());
+		Instrument::addCounter(COUNTER_QUOTE_REJECTS, request.quotes_size());
+		return;
+	}
+	// 先检查各条报价并取得合法报价的股票容器, 订单系统的写锁内不再新增股票; 不合法的报价不新增股票
+	std::vector<std::string> stockIDs;
+	std::vector<Container*> containers;
+	std::vector<std::string> errors(request.quotes_size());
+	stockIDs.reserve(request.quotes_size());
+	containers.reserve(request.quotes_size());
+	for(int i=0;i<request.quotes_size();i++){
+		const QuoteEntry& quote=request.quotes(i);
+		Container* container=nullptr;
+		if(checkQuote(clientID, quote, errors[i])){
+			container=findStock(quote.stockid());
+			if(container==nullptr){
+				container=insertStock(quote.stockid());
+			}
+		}
+		stockIDs.push_back(quote.stockid());
+		containers.push_back(container);
+	}
+	uint64_t accepted=0;
+	{
+		// 引擎读锁, 与快照互斥
+		std::shared_lock<SharedMutex> r(rw_engine_mutex);
+		// 报价在两侧的锁内写日志, 各股票的事件锁保证其与该股票的其他事件按日志顺序执行
+		std::vector<std::unique_lock<Mutex> > events;
+		lockEvents(containers, events);
+		orderSystem.replaceQuotes(clientID, stockIDs, [&](const size_t& i, OrderType*& bid, OrderType*& ask,
+				const typename BasicOrderSystem<LockPolicy>::CreateQuote& create){
+			QuoteAck& ack=*reply.add_acks();
+			// 检查未通过的报价保留原报价
+			if(containers[i]==nullptr){
+				ack.set_stockid(request.quotes(i).stockid());
+				ack.set_errormessage(errors[i]);
+				return;
+			}
+			if(quoteEntry(containers[i], clientID, request.quotes(i), bid, ask, create, ack)){
+				++accepted;
+			}
+		});
+	}
+	reply.set_accepted(accepted);
+	reply.set_time(getTime());
+	Instrument::addCounter(COUNTER_QUOTES, accepted);
+	Instrument::addCounter(COUNTER_QUOTE_REJECTS, request.quotes_size()-accepted);
+}
+
+// 替换一只股票上的双边报价
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::quoteEntry(Container* container, const uint64_t& clientID, const QuoteEntry& quote,
+		OrderType*& bid, OrderType*& ask, const typename BasicOrderSystem<LockPolicy>::CreateQuote& create, QuoteAck& ack){
+	ack.set_stockid(quote.stockid());
+	// 报价已在加锁前检查过(checkQuote), 两侧都是限价当日有效的挂单
+	NewOrderRequest bidRequest=MakeNewOrderRequest(TYPE_LIMIT, !DIRE_SELL, clientID, quote.stockid(), quote.bidqty(), quote.bidprice());
+	NewOrderRequest askRequest=MakeNewOrderRequest(TYPE_LIMIT, DIRE_SELL, clientID, quote.stockid(), quote.askqty(), quote.askprice());
+	// 两侧的报价一起替换, 撮合看不到只替换了一侧的报价; 顺序与改单相同, 先卖后买
+	std::unique_lock<Mutex> s(container->sell.mutex);
+	std::unique_lock<Mutex> b(container->buy.mutex);
+	// 报价只挂单不成交: 新价格不得与对手方最优价交叉, 不计本用户即将被替换的报价(独占最优档位时取下一档)
+	// 该用户的其他挂单也在比较之内, 不会形成对敲; 集合竞价期间挂单簿可以交叉
+	if(!container->auction.load(std::memory_order_relaxed)){
+		auto best=[](const BookSide<LockPolicy>& side, const OrderType* own){
+			auto level=side.levels().begin();
+			if(level!=side.levels().end()&&own!=nullptr&&level->second.head==own&&level->second.tail==own) ++level;
+			return level==side.levels().end()?0:level->first;
+		};
+		double bestAsk=best(container->sell, ask);
+		double bestBid=best(container->buy, bid);
+		if((quote.bidqty()>0&&bestAsk>0&&bestAsk<=quote.bidprice())||(quote.askqty()>0&&bestBid>0&&bestBid>=quote.askprice())){
+			ack.set_errormessage("Error: Quote crosses the book!");
+			return false;
+		}
+	}
+	// 被替换前的剩余数量, 已成交或被撤销为0
+	auto leaves=[](const OrderType* order){
+		uint32_t qty=0;
+		double price;
+		if(order!=nullptr&&order->resting_) order->read(qty, price);
+		return qty;
+	};
+	ack.set_bidleaves(leaves(bid));
+	ack.set_askleaves(leaves(ask));
+	// 变化的一侧写一条日志, 记录替换后的报价订单, 回放时不再检查
+	for(auto [side, order, request]:{std::make_tuple(&container->buy, &bid, &bidRequest), std::make_tuple(&container->sell, &ask, &askRequest)}){
+		uint64_t oldID=*order==nullptr?0:(*order)->id_;
+		if(quoteSide(*side, *order, *request, 0, create)){
+			JournalRecord record=makeJournalRecord(EVENT_QUOTE, *order==nullptr?oldID:(*order)->id_, *request);
+			journal.append(record);
+		}
+	}
+	ack.set_bidorderid(bid==nullptr?0:bid->id_);
+	ack.set_askorderid(ask==nullptr?0:ask->id_);
+	return true;
+}
+
+// 修改报价的一侧
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::quoteSide(BookSide<LockPolicy>& side, OrderType*& order, const NewOrderRequest& request,
+		const uint64_t& orderID, const typename BasicOrderSystem<LockPolicy>::CreateQuote& create){
+	uint32_t qty=request.orderqty();
+	double price=request.price();
+	uint32_t oldQty=0;
+	double oldPrice=0;
+	if(order!=nullptr) order->read(oldQty, oldPrice);
+	bool resting=order!=nullptr&&order->resting_&&oldQty>0;
+	// 原报价仍在挂单: 复用订单原位修改
+	if(resting&&qty>0){
+		if(qty==oldQty&&price==oldPrice){
+			return false;
+		}
+		modifyOnBook(*order, qty, price);
+		Instrument::traceOrder(TRACE_AMENDED, order->id_, static_cast<uint64_t>(price), qty);
+		return true;
+	}
+	// 撤销该侧, 或原报价已成交(含被模拟撮合减为0等待删除): 摘除后由订单系统删除
+	if(order!=nullptr){
+		side.remove(order);
+		timer->delTask(order->task_);
+		if(resting) Instrument::traceOrder(TRACE_CANCELED, order->id_);
+		order=nullptr;
+	}
+	if(qty==0){
+		return resting;
+	}
+	uint64_t newID=orderID;
+	if(newID==0){
+		std::unique_lock<Mutex> w(orderID_mutex);
+		newID=++id;
+	}
+	order=create(newID, request, &side);
+	side.append(order);
+	timer->addTask(newID, order->task_);
+	Instrument::traceOrder(TRACE_RESTED, newID, qty);
+	return true;
+}
+
+// 复制一侧前levels档的深度(需持有该侧的锁); 剩余数量已被模拟撮合减为0, 等待删除的档位不输出
+template<typename LockPolicy, typename AddLevel>
+static void copyDepth(const PriceLevels<LockPolicy>& levels, const uint32_t& count, const AddLevel& addLevel){
+	uint32_t copied=0;
+	for(auto level=levels.begin();level!=levels.end()&&copied<count;++level){
+		if(level->second.qty==0) continue;
+		OPS::DepthLevel* depth=addLevel();
+		depth->set_price(level->first);
+		depth->set_qty(level->second.qty);
+		depth->set_orders(level->second.orders);
+		++copied;
+	}
+}
+
+// 档位深度快照
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processGetDepth(const DepthRequest& request, DepthUpdate& update){
+	update.Clear();
+	update.set_stockid(request.stockid());
+	update.set_time(getTime());
+	std::string errorMessage="";
+	if(!checkStockID(request.stockid(), errorMessage)){
+		update.set_errormessage(errorMessage);
+		return;
+	}
+	Container* container=findStock(request.stockid());
+	if(container==nullptr) return;
+	uint32_t levels=request.levels()==0?DEPTH_DEFAULT_LEVELS:std::min<uint32_t>(request.levels(), DEPTH_MAX_LEVELS);
+	// 按卖方, 买方的顺序同时持有两侧的锁, 两侧与版本号来自同一时刻, 不会看到撮合到一半的挂单簿
+	std::unique_lock<Mutex> sell(container->sell.mutex);
+	std::unique_lock<Mutex> buy(container->buy.mutex);
+	copyDepth<LockPolicy>(container->sell.levels(), levels, [&](){return update.add_asks();});
+	copyDepth<LockPolicy>(container->buy.levels(), levels, [&](){return update.add_bids();});
+	update.set_version(container->sell.version()+container->buy.version());
+	update.set_lastprice(container->lastPrice.load(std::memory_order_relaxed));
+}
+
+// 挂单簿的版本号
+template<typename LockPolicy>
+uint64_t BasicMarketSystem<LockPolicy>::depthVersion(const std::string& stockID){
+	Container* container=findStock(stockID);
+	return container==nullptr?0:container->sell.version()+container->buy.version();
 }
 
 // 根据查询订单请求做出应答消息
-void MarketSystem::processQueryOrder(const QueryOrderRequest& request, std::vector<OrderReport>& reports){
-	orderSystem.getAllOrders(reports);
-	std::sort(reports.begin(), reports.end(), [&](const OrderReport& a, const OrderReport& b){return a.orderid()<b.orderid();});
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processQueryOrder(const QueryOrderRequest& request, QueryOrderReply& reply){
+	uint64_t clientID=request.clientid();
+	const std::string& stockID=request.stockid();
+	bool sell=request.side()!=QueryOrderRequest::BUY;
+	bool buy=request.side()!=QueryOrderRequest::SELL;
+	QueryOrderRequest::Status status=request.status();
+	size_t limit=request.limit()==0?QUERY_DEFAULT_LIMIT:std::min<size_t>(request.limit(), QUERY_MAX_LIMIT);
+	std::vector<OrderReport> reports;
+	reports.reserve(limit);
+	uint64_t nextCursor=orderSystem.queryOrders(clientID, stockID, request.cursor(), limit, QUERY_MAX_SCAN, [&](OrderType& order){
+		// 遍历的索引只按用户或股票之一筛选, 两者都指定时另一个在此检查
+		if(clientID!=0&&order.info_.clientid()!=clientID) return false;
+		if(!stockID.empty()&&order.info_.stockid()!=stockID) return false;
+		if(!(order.info_.direction()==NewOrderRequest::SELL?sell:buy)) return false;
+		if(status==QueryOrderRequest::ANY) return true;
+		// 是否在簿上由所在一侧的锁保护; 尚未挂单(撮合中)的订单两种状态都不是
+		if(order.side_==nullptr) return false;
+		std::unique_lock<Mutex> w(order.side_->mutex);
+		return status==QueryOrderRequest::RESTING?order.resting_:order.pending_;
+	}, reports);
+	for(auto& report:reports){
+		*reply.add_orders()=std::move(report);
+	}
+	reply.set_nextcursor(nextCursor);
+	reply.set_time(getTime());
 }
 
 // 获取模拟撮合产生的消息
-void MarketSystem::getMathchReports(std::vector<ExecutionReport>& reports_){
-	std::unique_lock<std::mutex> w(matchReportsLock);
-	reports_=std::move(matchReports);
-	// matchReports.clear();
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::getMathchReports(std::vector<ExecutionReport>& reports_){
+	std::unique_lock<Mutex> w(matchReportsLock);
+	matchReports.drain(reports_);
+}
+
+// 等待新的模拟撮合消息
+template<typename LockPolicy>
+uint64_t BasicMarketSystem<LockPolicy>::waitMatchReports(const uint64_t& seen, const std::chrono::milliseconds& timeout){
+	return matchReports.wait(seen, timeout);
+}
+
+// 各阶段耗时, 计数, 每只股票的挂单数量与计时器任务数
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::processGetStats(const StatsRequest& request, StatsReport& report){
+	StageStatsSnapshot snapshot;
+	snapshot.collect();
+	report.set_orders(snapshot.counter(COUNTER_ORDERS));
+	report.set_rejects(snapshot.counter(COUNTER_REJECTS));
+	report.set_fills(snapshot.counter(COUNTER_FILLS));
+	report.set_cancels(snapshot.counter(COUNTER_CANCELS));
+	report.set_cancelrejects(snapshot.counter(COUNTER_CANCEL_REJECTS));
+	report.set_amends(snapshot.counter(COUNTER_AMENDS));
+	report.set_amendrejects(snapshot.counter(COUNTER_AMEND_REJECTS));
+	report.set_triggers(snapshot.counter(COUNTER_STOP_TRIGGERS));
+	report.set_quotes(snapshot.counter(COUNTER_QUOTES));
+	report.set_quoterejects(snapshot.counter(COUNTER_QUOTE_REJECTS));
+	for(int s=0;s<STAGE_COUNT;s++){
+		OPS::StageLatency* stage=report.add_stages();
+		stage->set_stage(stageName(s));
+		stage->set_count(snapshot.count(s));
+		stage->set_mean(snapshot.mean(s)/1000.0);
+		stage->set_p50(snapshot.valueAtPercentile(s, 50)/1000.0);
+		stage->set_p90(snapshot.valueAtPercentile(s, 90)/1000.0);
+		stage->set_p99(snapshot.valueAtPercentile(s, 99)/1000.0);
+		stage->set_p999(snapshot.valueAtPercentile(s, 99.9)/1000.0);
+		stage->set_max(snapshot.max(s)/1000.0);
+	}
+	report.set_timertasks(timer->size());
+	{
+		// 逐只股票加集合锁读取大小, 不阻塞其他股票的撮合
+		ReadGuard guard;
+		for(auto& [stockID, container]:*stock_index.load()){
+			OPS::SymbolBook* book=report.add_books();
+			book->set_stockid(stockID);
+			size_t stopOrders=0;
+			{
+				std::unique_lock<Mutex> w(container->sell.mutex);
+				book->set_sellorders(container->sell.size());
+				stopOrders+=container->sell.stops().size();
+			}
+			{
+				std::unique_lock<Mutex> w(container->buy.mutex);
+				book->set_buyorders(container->buy.size());
+				stopOrders+=container->buy.stops().size();
+			}
+			book->set_stoporders(stopOrders);
+			// 成交价与最优价由撮合逐档维护, 直接读取
+			book->set_lastprice(container->lastPrice.load(std::memory_order_relaxed));
+			book->set_bidprice(container->buy.best());
+			book->set_askprice(container->sell.best());
+		}
+	}
+	report.set_time(getTime());
 }
 
 // 模拟撮合
-bool MarketSystem::simulationMatch(const uint64_t& orderID){
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::simulationMatch(const uint64_t& orderID){
+	// 引擎读锁, 与快照互斥
+	std::shared_lock<SharedMutex> r(rw_engine_mutex);
+	// 订单已被撤销或成交时不写日志
+	Container* container=findOrderStock(orderID);
+	if(container==nullptr){
+		return false;
+	}
+	std::unique_lock<Mutex> event=lockEvents(container);
+	// 写入日志
+	JournalRecord record=makeJournalRecord(EVENT_SIMULATION_MATCH, orderID);
+	journal.append(record);
+	return matchOrder(orderID);
+}
+
+// 模拟撮合
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::matchOrder(const uint64_t& orderID){
     // 撮合消息
 	ExecutionReport report_;
     if(!orderSystem.simulationMatch(orderID, report_)){
         return false;
     }
+	Instrument::traceOrder(TRACE_SIMULATED_FILL, orderID, 0, report_.fillqty());
+	uint32_t leaveQty=report_.leaveqty();
     // 保存report
-	std::unique_lock<std::mutex> w(matchReportsLock);
-	matchReports.push_back(std::move(report_));
-	w.unlock();
+	matchReports.push(std::move(report_));
+	Instrument::addCounter(COUNTER_FILLS);
 
-	NewOrderRequest orderInfo;
-	// 订单不存在
-	if(!orderSystem.getOrderInfo(orderID, orderInfo)){
+	// 全部成交, 从挂单簿与计时器中摘除并删除订单
+	if(leaveQty==0){
+		NewOrderRequest orderInfo;
+		orderSystem.removeOrder(orderID, orderInfo, [this](OrderType& order){
+			return delOrderFromBook(order);
+		});
 		return false;
 	}
-	// 判断订单数量是否为0，为0删除订单
-	if(orderInfo.orderqty()==0){
-		if(orderInfo.direction()==NewOrderRequest::SELL){
-			// 从卖集合容器中删除订单
-			delOrderFromSell(orderInfo.stockid(), orderID);
-		}else{
-			// 从买集合容器中删除订单
-			delOrderFromBuy(orderInfo.stockid(), orderID);
+	// 仍在挂单簿上则重新计时; 集合锁保证订单此时没有被成交摘除
+	bool rearmed=false;
+	orderSystem.visitOrder(orderID, [&](OrderType& order){
+		std::unique_lock<Mutex> w(order.side_->mutex);
+		if(order.resting_){
+			timer->addTask(orderID, order.task_);
+			rearmed=true;
 		}
-        // 从订单系统中删除订单
-		orderSystem.deleteOrder(orderID);
+	});
+	return rearmed;
+}
+
+/***************************************************************************************
+                                    快照与日志相关操作
+****************************************************************************************/
+
+// 生成一致性快照
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::takeSnapshot(const std::string& fileName){
+	uint64_t startTs=getTimestamp();
+	SnapshotHeader header;
+	std::vector<SnapshotOrder> records;
+	std::vector<SnapshotSymbol> symbols;
+	{
+		// 引擎写锁, 等待进行中的撮合完成, 期间只做内存拷贝
+		std::unique_lock<SharedMutex> w(rw_engine_mutex);
+		{
+			std::unique_lock<Mutex> w_(orderID_mutex);
+			header.orderIDCounter=id;
+		}
+		header.journalSeq=journal.nextSeq();
+		header.createTimestamp=startTs;
+		// 计时任务时间戳
+		std::unordered_map<uint64_t, uint64_t> tasks;
+		timer->getAllTasks(tasks);
+		// 按价格档位顺序遍历挂单, 恢复时依次追加即保持时间优先
+		ReadGuard guard;
+		NewOrderRequest orderInfo;
+		for(const auto& [stockID, container]:*stock_index.load()){
+			SnapshotSymbol symbol;
+			memset(&symbol, 0, sizeof(symbol));
+			copyFixedString(symbol.stockID, sizeof(symbol.stockID), stockID);
+			symbol.lastPrice=container->lastPrice.load(std::memory_order_relaxed);
+			symbol.auction=container->auction.load(std::memory_order_relaxed)?1:0;
+			symbols.push_back(symbol);
+			for(const BookSide<LockPolicy>* side:{&container->sell, &container->buy}){
+				for(const auto& [price, level]:side->levels()){
+					for(const OrderType* order=level.head;order!=nullptr;order=order->next_){
+						order->copyTo(orderInfo);
+						// 已触发后挂单的止损单按普通挂单恢复
+						orderInfo.set_stopprice(0);
+						auto it=tasks.find(order->id_);
+						records.push_back(makeSnapshotOrder(order->id_, orderInfo, it==tasks.end()?0:it->second));
+						records.back().quote=order->quote_?1:0;
+					}
+				}
+				// 等待触发的止损单按止损簿顺序保存, 带止损价, 没有计时任务
+				for(const auto& [stopPrice, order]:side->stops()){
+					order->copyTo(orderInfo);
+					records.push_back(makeSnapshotOrder(order->id_, orderInfo, 0));
+				}
+			}
+		}
+	}
+	// 旧股票索引只在下次退休时才检查, 股票不再新增时由快照线程定期回收
+	reclaimRetired();
+	// 在锁外写文件
+	if(!writeSnapshot(fileName, header, records, symbols)){
+		LOG_ERROR("Snapshot failed: {}", fileName);
+		return false;
+	}
+	LOG_INFO("Snapshot saved: {} orders, journal seq {}, {} ms", records.size(), header.journalSeq, getTimestamp()-startTs);
+	return true;
+}
+
+// 载入快照并回放日志尾部
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::recover(const std::string& snapshotFile, const std::string& journalFile){
+	// 引擎写锁, 恢复期间阻塞计时器
+	std::unique_lock<SharedMutex> w(rw_engine_mutex);
+	auto startTime=std::chrono::steady_clock::now();
+	uint64_t journalSeq=0;
+	uint64_t orderCount=0;
+	SnapshotFile snapshot;
+	if(snapshot.open(snapshotFile)){
+		const SnapshotHeader& header=snapshot.header();
+		const SnapshotOrder* records=snapshot.orders();
+		orderCount=header.orderCount;
+		journalSeq=header.journalSeq;
+		id=header.orderIDCounter;
+		// 批量载入订单
+		std::vector<std::pair<uint64_t, NewOrderRequest> > orders(orderCount);
+		for(uint64_t i=0;i<orderCount;i++){
+			orders[i].first=records[i].orderID;
+			snapshotOrderToRequest(records[i], orders[i].second);
+		}
+		orderSystem.loadOrders(orders);
+		// 按快照中的顺序挂回价格档位, 止损单挂回止损簿
+		for(const auto& [orderID, request]:orders){
+			Container* container=insertStock(request.stockid());
+			OrderType* order=orderSystem.findOrder(orderID);
+			order->side_=request.direction()==NewOrderRequest::SELL?&container->sell:&container->buy;
+			if(request.stopprice()>0) order->side_->park(order);
+			else order->side_->append(order);
+		}
+		// 报价订单重新登记到用户的报价索引, 之后的批量报价继续复用
+		for(uint64_t i=0;i<orderCount;i++){
+			if(records[i].quote!=0) orderSystem.restoreQuote(records[i].orderID);
+		}
+		// 按时间戳顺序恢复计时任务, 未计时的挂单重新计时
+		uint64_t now=getTimestamp();
+		std::vector<std::pair<uint64_t, uint64_t> > tasks;
+		tasks.reserve(orderCount);
+		for(uint64_t i=0;i<orderCount;i++){
+			if(records[i].stopPrice>0) continue;
+			tasks.emplace_back(records[i].timerTimestamp>0?records[i].timerTimestamp:now, records[i].orderID);
+		}
+		std::sort(tasks.begin(), tasks.end());
+		for(const auto& [timestamp, orderID]:tasks){
+			timer->addTask(orderID, orderSystem.findOrder(orderID)->task_, timestamp);
+		}
+		// 股票的集合竞价状态与最新成交价
+		const SnapshotSymbol* symbols=snapshot.symbols();
+		for(uint64_t i=0;i<header.symbolCount;i++){
+			Container* container=insertStock(readFixedString(symbols[i].stockID, sizeof(symbols[i].stockID)));
+			container->lastPrice.store(symbols[i].lastPrice, std::memory_order_relaxed);
+			container->auction.store(symbols[i].auction!=0, std::memory_order_relaxed);
+		}
+	}
+	auto snapshotTime=std::chrono::steady_clock::now();
+	// 回放快照之后的日志
+	std::vector<JournalRecord> records;
+	if(Journal::readFrom(journalFile, journalSeq, records)){
+		std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+		for(const auto& record:records){
+			replayRecord(record, reports);
+			reports.clear();
+		}
+	}
+	{
+		// 恢复产生的消息无需推送
+		std::unique_lock<Mutex> w_(matchReportsLock);
+		matchReports.clear();
+	}
+	auto replayTime=std::chrono::steady_clock::now();
+	// 继续写入日志
+	uint64_t nextSeq=journalSeq+records.size();
+	bool rotated=false;
+	if(!journal.open(journalFile, nextSeq)){
+		// 日志不可读或版本不支持: 原文件移到一旁保留, 从当前序号新建日志
+		std::string badFile=journalFile+".bad."+std::to_string(getTimestamp());
+		if(std::rename(journalFile.c_str(), badFile.c_str())!=0||!journal.open(journalFile, nextSeq)){
+			LOG_ERROR("Can not open journal: {}", journalFile);
+			return false;
+		}
+		LOG_ERROR("Journal {} is unusable, moved to {}, new journal starts at seq {}", journalFile, badFile, nextSeq);
+		rotated=true;
+	}
+	auto ms=[](const std::chrono::steady_clock::duration& d){return std::chrono::duration<double, std::milli>(d).count();};
+	LOG_INFO("Recovery: snapshot {} orders in {} ms, replayed {} journal records in {} ms, total {} ms, next journal seq {}",
+		orderCount, ms(snapshotTime-startTime), records.size(), ms(replayTime-snapshotTime), ms(replayTime-startTime), journal.nextSeq());
+	w.unlock();
+	// 新日志不含旧日志中的事件, 立即生成快照, 之后的恢复不再依赖旧日志
+	if(rotated&&!takeSnapshot(snapshotFile)){
 		return false;
 	}
 	return true;
 }
 
+// 回放一条日志记录
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::replayRecord(const JournalRecord& record, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+	if(record.type==EVENT_NEW_ORDER){
+		NewOrderRequest request;
+		journalRecordToRequest(record, request);
+		// 日志中的订单均已通过检查, 直接创建
+		id=std::max(id, record.orderID);
+		Container* container=findStock(request.stockid());
+		if(container==nullptr){
+			container=insertStock(request.stockid());
+		}
+		orderSystem.insertOrder(record.orderID, request, request.direction()==NewOrderRequest::SELL?&container->sell:&container->buy);
+		newOrder(request, record.orderID, reports);
+	}else if(record.type==EVENT_CANCEL_ORDER){
+		NewOrderRequest orderInfo;
+		cancelOrder(record.orderID, orderInfo);
+	}else if(record.type==EVENT_AMEND_ORDER){
+		NewOrderRequest orderInfo;
+		std::string errorMessage;
+		amendOrder(record.orderID, record.orderQty, record.price, orderInfo, errorMessage);
+	}else if(record.type==EVENT_MASS_CANCEL){
+		MassCancelRequest request;
+		journalRecordToRequest(record, request);
+		std::vector<std::pair<uint64_t, NewOrderRequest> > canceled;
+		massCancelOrders(request.clientid(), request.stockid(), request.side(), canceled);
+	}else if(record.type==EVENT_AUCTION){
+		AuctionRequest request;
+		journalRecordToRequest(record, request);
+		AuctionReply reply;
+		auction(request.stockid(), request.action(), reply, reports);
+	}else if(record.type==EVENT_QUOTE){
+		NewOrderRequest request;
+		journalRecordToRequest(record, request);
+		id=std::max(id, record.orderID);
+		Container* container=findStock(request.stockid());
+		if(container==nullptr){
+			container=insertStock(request.stockid());
+		}
+		// 日志记录的是替换后的结果, 按记录的订单ID修改或新建该侧报价
+		bool sell=request.direction()==NewOrderRequest::SELL;
+		orderSystem.replaceQuotes(request.clientid(), {request.stockid()}, [&](const size_t&, OrderType*& bid, OrderType*& ask,
+				const typename BasicOrderSystem<LockPolicy>::CreateQuote& create){
+			std::unique_lock<Mutex> s(container->sell.mutex);
+			std::unique_lock<Mutex> b(container->buy.mutex);
+			quoteSide(sell?container->sell:container->buy, sell?ask:bid, request, record.orderID, create);
+		});
+	}else if(record.type==EVENT_SIMULATION_MATCH){
+		// 与计时器线程一致: 撮合后仍有剩余则重新计时
+		matchOrder(record.orderID);
+	}
+}
+
 /***************************************************************************************
                                     股票索引相关操作
 ****************************************************************************************/
 
 // 插入新股票
-void MarketSystem::insertStock(const std::string& stockID){
-	// 写锁
-	std::unique_lock<std::shared_mutex> w(rw_stock_index_mutex);
-	if(stock_index.find(stockID)==stock_index.end()){
-		SellAndBuyContainer container=SellAndBuyContainer();
-		stock_index.insert(std::make_pair(stockID, std::move(container)));
+template<typename LockPolicy>
+typename BasicMarketSystem<LockPolicy>::Container* BasicMarketSystem<LockPolicy>::insertStock(const std::string& stockID){
+	std::unique_lock<Mutex> w(stock_index_write_mutex);
+	StockIndex* index=stock_index.load();
+	auto it=index->find(stockID);
+	if(it!=index->end()){
+		return it->second;
 	}
+	Container* container=new Container();
+	// 单线程时没有并发的读者, 直接插入
+	if constexpr(!LockPolicy::threadSafe){
+		index->emplace(stockID, container);
+		return container;
+	}
+	// 复制旧索引, 加入新股票后替换, 旧索引交给纪元回收
+	StockIndex* newIndex=new StockIndex(*index);
+	newIndex->emplace(stockID, container);
+	stock_index.store(newIndex);
+	retire(index);
+	return container;
 }
 
-// 将订单加入至待售卖容器
-void MarketSystem::addOrderToSell(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stock_index_mutex);
-	// 获取锁
-	std::mutex* sell_mutex_ptr=stock_index.at(stockID).sell_mutex_ptr;
-	// 对stockID的卖订单集合加锁,作用域结束自动解锁
-	std::unique_lock<std::mutex> w(*sell_mutex_ptr);
-	stock_index.at(stockID).sell.emplace(orderID);
+// 查找股票的容器
+template<typename LockPolicy>
+typename BasicMarketSystem<LockPolicy>::Container* BasicMarketSystem<LockPolicy>::findStock(const std::string& stockID){
+	ReadGuard guard;
+	// 须为顺序一致的读: 只用acquire时可能先于纪元槽位的发布被写者看到, 写者会提前释放该索引
+	const StockIndex* index=stock_index.load(std::memory_order_seq_cst);
+	auto it=index->find(stockID);
+	return it==index->end()?nullptr:it->second;
 }
 
-// 将订单加入至待购买容器
-void MarketSystem::addOrderToBuy(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stock_index_mutex);
-	// 获取锁
-	std::mutex* buy_mutex_ptr=stock_index.at(stockID).buy_mutex_ptr;
-	// 对stockID的卖订单集合加锁,作用域结束自动解锁
-	std::unique_lock<std::mutex> w(*buy_mutex_ptr);
-	stock_index.at(stockID).buy.emplace(orderID);
+// 订单所属股票的容器
+template<typename LockPolicy>
+typename BasicMarketSystem<LockPolicy>::Container* BasicMarketSystem<LockPolicy>::findOrderStock(const uint64_t& orderID){
+	std::string stockID;
+	if(!orderSystem.visitOrder(orderID, [&](OrderType& order){ stockID=order.info_.stockid(); })){
+		return nullptr;
+	}
+	return findStock(stockID);
 }
 
-// 将订单从售卖容器中删除
-void MarketSystem::delOrderFromSell(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stock_index_mutex);
-	// 对stockID的卖订单集合加锁,作用域结束自动解锁
-	std::unique_lock<std::mutex> w(*stock_index.at(stockID).sell_mutex_ptr);
-	if(stock_index.at(stockID).sell.find(orderID)!=stock_index.at(stockID).sell.end()){
-		stock_index.at(stockID).sell.erase(orderID);
+// 对股票加事件锁, 股票不存在时返回不关联锁的对象
+template<typename LockPolicy>
+std::unique_lock<typename LockPolicy::Mutex> BasicMarketSystem<LockPolicy>::lockEvents(Container* container){
+	return container==nullptr?std::unique_lock<Mutex>():std::unique_lock<Mutex>(container->eventMutex);
+}
+
+// 对各股票加事件锁
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::lockEvents(std::vector<Container*> containers, std::vector<std::unique_lock<Mutex> >& locks){
+	// 固定按地址顺序, 同时锁多只股票的请求之间不会死锁
+	std::sort(containers.begin(), containers.end());
+	containers.erase(std::unique(containers.begin(), containers.end()), containers.end());
+	for(Container* container:containers){
+		if(container!=nullptr) locks.emplace_back(container->eventMutex);
 	}
 }
 
-// 将订单从购买容器中删除
-void MarketSystem::delOrderFromBuy(const std::string& stockID, const uint64_t& orderID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stock_index_mutex);
-	// 对stockID的卖订单集合加锁,作用域结束自动解锁
-	std::unique_lock<std::mutex> w(*stock_index.at(stockID).buy_mutex_ptr);
-	if(stock_index.at(stockID).buy.find(orderID)!=stock_index.at(stockID).buy.end()){
-		stock_index.at(stockID).buy.erase(orderID);
+// 将订单挂到价格档位
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::addOrderToBook(OrderType* order){
+	BookSide<LockPolicy>* side=order->side_;
+	// 对订单所属一侧加锁,作用域结束自动解锁
+	std::unique_lock<Mutex> w(side->mutex);
+	side->append(order);
+	// 在集合锁内添加计时任务, 成交摘除时同样在锁内删除, 任务不会指向已删除的订单
+	timer->addTask(order->id_, order->task_);
+}
+
+// 将止损单挂入止损簿
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::parkStop(OrderType* order, Container* container){
+	BookSide<LockPolicy>* side=order->side_;
+	// 成交在对手方的锁内更新最新成交价, 之后再加本侧的锁取出被触发的止损单
+	// 在本侧的锁内读最新成交价: 读到旧价格时挂入的止损单会被之后的取出看到, 不会漏触发
+	std::unique_lock<Mutex> w(side->mutex);
+	if(side->triggers(order->info_.stopprice(), container->lastPrice.load(std::memory_order_relaxed))){
+		return false;
 	}
+	side->park(order);
+	return true;
+}
+
+// 取出被成交触发的止损单
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::collectStops(Container* container, const TradeRange& traded, std::vector<OrderType*>& stops){
+	// 两侧依次加锁, 不同时持有
+	{
+		std::unique_lock<Mutex> w(container->buy.mutex);
+		container->buy.trigger(traded.high, stops);
+	}
+	{
+		std::unique_lock<Mutex> w(container->sell.mutex);
+		container->sell.trigger(traded.low, stops);
+	}
+}
+
+// 将订单从价格档位与计时器中摘除
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::delOrderFromBook(OrderType& order){
+	BookSide<LockPolicy>* side=order.side_;
+	if(side==nullptr){
+		return false;
+	}
+	// 对订单所属一侧加锁,作用域结束自动解锁
+	std::unique_lock<Mutex> w(side->mutex);
+	// 尚未挂单或已成交摘除; 等待触发的止损单没有计时任务
+	if(!side->remove(&order)){
+		return side->unpark(&order);
+	}
+	timer->delTask(order.task_);
+	return true;
+}
+
+// 修改挂单的剩余数量与价格
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::amendOnBook(OrderType& order, const uint32_t& qty, const double& price, std::string& errorMessage){
+	Container* container=order.side_==nullptr?nullptr:findStock(order.info_.stockid());
+	if(container==nullptr){
+		errorMessage="Error: Order is not resting!";
+		return false;
+	}
+	bool sell=order.side_==&container->sell;
+	// 改价需检查对手方最优价, 同时加两侧的锁, 顺序固定为先卖后买; 撮合只持有一侧的锁, 不会死锁
+	std::unique_lock<Mutex> s(container->sell.mutex);
+	std::unique_lock<Mutex> b(container->buy.mutex);
+	uint32_t oldQty;
+	double oldPrice;
+	order.read(oldQty, oldPrice);
+	// 尚未挂单, 或已被模拟撮合减为0等待删除
+	if(!order.resting_||oldQty==0){
+		errorMessage="Error: Order is not resting!";
+		return false;
+	}
+	if(price!=oldPrice&&!container->auction.load(std::memory_order_relaxed)){
+		// 改单只修改挂单, 不主动成交: 新价格与对手方最优价交叉时拒绝; 集合竞价期间挂单簿可以交叉
+		const auto& opposite=sell?container->buy.levels():container->sell.levels();
+		if(!opposite.empty()&&(sell?opposite.begin()->first>=price:opposite.begin()->first<=price)){
+			errorMessage="Error: Amended price crosses the book!";
+			return false;
+		}
+	}
+	modifyOnBook(order, qty, price);
+	return true;
+}
+
+// 按新的剩余数量与价格重新挂单
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::modifyOnBook(OrderType& order, const uint32_t& qty, const double& price){
+	uint32_t oldQty;
+	double oldPrice;
+	order.read(oldQty, oldPrice);
+	// 同价减量保留时间优先, 计时任务不变
+	bool keepPriority=price==oldPrice&&qty<oldQty;
+	if(!keepPriority) order.side_->remove(&order);
+	order.lockWrite();
+	order.qty_.store(qty, std::memory_order_relaxed);
+	order.price_.store(price, std::memory_order_relaxed);
+	order.unlockWrite();
+	if(keepPriority) order.side_->reduce(&order, oldQty-qty);
+	else order.side_->append(&order);
 }
 
 // 判断该股票订单是否在容器中
-bool MarketSystem::isStockExistsInHash(const std::string& stockID){
-	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_stock_index_mutex);
-	if(stock_index.find(stockID)!=stock_index.end()){
-		return true;
+template<typename LockPolicy>
+bool BasicMarketSystem<LockPolicy>::isStockExistsInHash(const std::string& stockID){
+	return findStock(stockID)!=nullptr;
+}
+
+// 统计与新订单交叉且不属于同一用户的挂单数量, 达到need即停止(需持有该侧的锁)
+// crosses(price)判断档位价格是否与新订单交叉; 档位按最优价排列, 第一个不交叉的档位之后都不交叉
+template<typename LockPolicy, typename Crosses>
+static uint64_t crossingQty(const PriceLevels<LockPolicy>& levels, const Crosses& crosses, const uint64_t& clientID, const uint64_t& need){
+	uint64_t total=0;
+	for(auto level=levels.begin();level!=levels.end()&&crosses(level->first)&&total<need;++level){
+		for(const Order<LockPolicy>* order=level->second.head;order!=nullptr&&total<need;order=order->next_){
+			uint32_t qty;
+			double price;
+			order->read(qty, price);
+			// 与撮合一致, 跳过同一用户的订单
+			if(order->info_.clientid()!=clientID) total+=qty;
+		}
 	}
-	return false;
+	return total;
+}
+
+// 市价单按档位合并的成交回报
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::levelFillReport(const OrderType& order, const uint32_t& before, const uint32_t& after,
+		const double& price, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+	ExecutionReport report;
+	initReport(report, order.info_);
+	report.set_stat(ExecutionReport::FILL);
+	report.set_orderid(order.id_);
+	report.set_orderqty(before);
+	report.set_fillqty(before-after);
+	report.set_fillprice(price);
+	report.set_leaveqty(after);
+	report.set_time(getTime());
+	reports.push_back(std::make_pair(order.id_, report));
 }
 
 // 卖订单操作
-void MarketSystem::sellOrders(const uint64_t& sellOrderID, const std::string& stockID, const uint64_t& clientID,
-		std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
-    // 加读锁
-    std::shared_lock<std::shared_mutex> r(rw_stock_index_mutex);
-    // 不存在股票ID则退出
-    if(stock_index.find(stockID)==stock_index.end()){
-        return;
-    }
-	// 获取买订单容器
-	auto& buyOrderSet=stock_index.at(stockID).buy;
-    // 获取买订单容器锁
-    auto& buyOrderSetLock=stock_index.at(stockID).buy_mutex_ptr;
-    r.unlock();
-	// 对buyOrderSet加锁,作用域结束自动解锁
-	std::unique_lock<std::mutex> w(*buyOrderSetLock);
-		// 遍历容器
-	for(auto it=buyOrderSet.begin(); it!=buyOrderSet.end();){
-		NewOrderRequest sellOrderInfo, buyOrderInfo;
-		// 卖订单数量为0，结束遍历
-		if(!orderSystem.getOrderInfo(sellOrderID, sellOrderInfo)||sellOrderInfo.orderqty()==0){
-			break;
-		} 
-		auto buyOrderID=*it;
-        if(!orderSystem.getOrderInfo(buyOrderID, buyOrderInfo)||buyOrderInfo.orderqty()==0){
-            // 无该买订单或该买订单数量为0
-            buyOrderSet.erase(it++);
-            orderSystem.deleteOrder(buyOrderID);
-            continue;
-        }else{
-            // 存在订单并符合交易价格
-            if(sellOrderInfo.clientid()!=buyOrderInfo.clientid()&&sellOrderInfo.price()<=buyOrderInfo.price()){
-                // 删除计时任务
-                timer->delTask(buyOrderID);
-                orderSystem.tradingOrders(sellOrderID, buyOrderID, true, reports);
-                // 再次检查订单剩余数量
-                if(!orderSystem.getOrderInfo(buyOrderID, buyOrderInfo)||buyOrderInfo.orderqty()==0){
-                    buyOrderSet.erase(it++);
-                    orderSystem.deleteOrder(buyOrderID);
-                    continue;
-                }else{
-                    // 添加计时任务
-                    timer->addTask(buyOrderID);
-                }
-            }
-            it++;
-        }
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::sellOrders(OrderType* sellOrder, Container* container,
+		std::vector<std::pair<uint64_t, ExecutionReport> >& reports, const bool& fillOrKill, TradeRange& traded){
+	uint64_t clientID=sellOrder->info_.clientid();
+	// 市价单逐档扫过买方, 每档合并为一条成交回报; 限价为保护价, 没有保护价时扫到买方为空
+	bool market=sellOrder->info_.ordertype()==NewOrderRequest::MARKET;
+	double limit=matchPrice(sellOrder->info_);
+	uint32_t sellQty;
+	double sellPrice;
+	sellOrder->read(sellQty, sellPrice);
+	// 全部成交的买订单, 释放集合锁后再从订单系统删除
+	std::vector<uint64_t> filled;
+	{
+		// 对买方加锁,作用域结束自动解锁
+		std::unique_lock<Mutex> w(container->buy.mutex);
+		// 集合竞价期间不撮合
+		if(container->auction.load(std::memory_order_relaxed)){
+			return;
+		}
+		auto& levels=container->buy.levels();
+		// FOK在同一把锁内先统计可成交数量, 不足则不成交
+		// 模拟撮合不持有集合锁, 可能在统计后减少对手方数量, 此时剩余部分与IOC一样撤销
+		if(fillOrKill&&crossingQty<LockPolicy>(levels, [&](const double& price){return price>=limit;}, clientID, sellQty)<sellQty){
+			return;
+		}
+		// 从最高买价开始, 直到买价低于限价或卖订单数量为0
+		for(auto level=levels.begin();level!=levels.end()&&level->first>=limit&&sellQty>0;){
+			// 档位可能因订单全部成交而删除, 先取下一档
+			auto nextLevel=std::next(level);
+			double levelPrice=level->first;
+			uint32_t levelQty=sellQty;
+			for(OrderType* buyOrder=level->second.head;buyOrder!=nullptr&&sellQty>0;){
+				OrderType* next=buyOrder->next_;
+				uint32_t buyQty;
+				double buyPrice;
+				buyOrder->read(buyQty, buyPrice);
+				// 跳过同一用户的订单, 以及数量已被模拟撮合减为0, 等待删除的订单
+				if(buyQty>0&&buyOrder->info_.clientid()!=clientID){
+					orderSystem.tradingOrders(sellOrder, buyOrder, true, reports, !market);
+					buyOrder->read(buyQty, buyPrice);
+					if(buyQty==0){
+						// 全部成交, 从档位与计时器中摘除
+						container->buy.remove(buyOrder);
+						timer->delTask(buyOrder->task_);
+						filled.push_back(buyOrder->id_);
+					}else{
+						// 重新计时
+						timer->addTask(buyOrder->id_, buyOrder->task_);
+					}
+					sellOrder->read(sellQty, sellPrice);
+				}
+				buyOrder=next;
+			}
+			// 本档有成交: 更新最新成交价并计入成交价区间, 市价单输出本档的合并回报
+			if(sellQty<levelQty){
+				container->lastPrice.store(levelPrice, std::memory_order_relaxed);
+				traded.add(levelPrice);
+				if(market) levelFillReport(*sellOrder, levelQty, sellQty, levelPrice, reports);
+			}
+			level=nextLevel;
+		}
+	}
+	for(const auto& orderID:filled){
+		orderSystem.deleteOrder(orderID);
 	}
 }
 
 // 买订单操作
-void MarketSystem::buyOrders(const uint64_t& buyOrderID, const std::string& stockID, const uint64_t& clientID,
-		std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
-    // 加读锁
-    std::shared_lock<std::shared_mutex> r(rw_stock_index_mutex);
-    // 不存在股票ID则退出
-    if(stock_index.find(stockID)==stock_index.end()){
-        return;
-    }
-	// 获取卖订单容器
-	auto& sellOrderSet=stock_index.at(stockID).sell;
-    // 获取买订单容器锁
-    auto sellOrderSetLock=stock_index.at(stockID).sell_mutex_ptr;
-    r.unlock();
-	// 对buyOrderSet加锁,作用域结束自动解锁
-	std::unique_lock<std::mutex> w(*sellOrderSetLock);
-		// 遍历容器
-	for(auto it=sellOrderSet.begin(); it!=sellOrderSet.end();){
-		NewOrderRequest sellOrderInfo, buyOrderInfo;
-		// 卖订单数量为0，结束遍历
-		if(!orderSystem.getOrderInfo(buyOrderID, buyOrderInfo)||buyOrderInfo.orderqty()==0){
-			break;
-		} 
-		auto sellOrderID=*it;
-        if(!orderSystem.getOrderInfo(sellOrderID, sellOrderInfo)||sellOrderInfo.orderqty()==0){
-            // 无该买订单或该买订单数量为0
-            sellOrderSet.erase(it++);
-            orderSystem.deleteOrder(sellOrderID);
-            continue;
-        }else{
-            // 存在订单并符合交易价格
-            if(sellOrderInfo.clientid()!=buyOrderInfo.clientid()&&sellOrderInfo.price()<=buyOrderInfo.price()){
-                // 删除计时任务
-                timer->delTask(sellOrderID);
-                orderSystem.tradingOrders(sellOrderID, buyOrderID, false, reports);
-                // 再次检查订单剩余数量
-                if(!orderSystem.getOrderInfo(sellOrderID, sellOrderInfo)||sellOrderInfo.orderqty()==0){
-                    sellOrderSet.erase(it++);
-                    orderSystem.deleteOrder(sellOrderID);
-                    continue;
-                }else{
-                    // 添加计时任务
-                    timer->addTask(sellOrderID);
-                }
-            }
-            it++;
-        }
+template<typename LockPolicy>
+void BasicMarketSystem<LockPolicy>::buyOrders(OrderType* buyOrder, Container* container,
+		std::vector<std::pair<uint64_t, ExecutionReport> >& reports, const bool& fillOrKill, TradeRange& traded){
+	uint64_t clientID=buyOrder->info_.clientid();
+	// 市价单逐档扫过卖方, 每档合并为一条成交回报; 限价为保护价, 没有保护价时扫到卖方为空
+	bool market=buyOrder->info_.ordertype()==NewOrderRequest::MARKET;
+	double limit=matchPrice(buyOrder->info_);
+	uint32_t buyQty;
+	double buyPrice;
+	buyOrder->read(buyQty, buyPrice);
+	// 全部成交的卖订单, 释放集合锁后再从订单系统删除
+	std::vector<uint64_t> filled;
+	{
+		// 对卖方加锁,作用域结束自动解锁
+		std::unique_lock<Mutex> w(container->sell.mutex);
+		// 集合竞价期间不撮合
+		if(container->auction.load(std::memory_order_relaxed)){
+			return;
+		}
+		auto& levels=container->sell.levels();
+		// FOK在同一把锁内先统计可成交数量, 不足则不成交
+		if(fillOrKill&&crossingQty<LockPolicy>(levels, [&](const double& price){return price<=limit;}, clientID, buyQty)<buyQty){
+			return;
+		}
+		// 从最低卖价开始, 直到卖价高于限价或买订单数量为0
+		for(auto level=levels.begin();level!=levels.end()&&level->first<=limit&&buyQty>0;){
+			// 档位可能因订单全部成交而删除, 先取下一档
+			auto nextLevel=std::next(level);
+			double levelPrice=level->first;
+			uint32_t levelQty=buyQty;
+			for(OrderType* sellOrder=level->second.head;sellOrder!=nullptr&&buyQty>0;){
+				OrderType* next=sellOrder->next_;
+				uint32_t sellQty;
+				double sellPrice;
+				sellOrder->read(sellQty, sellPrice);
+				// 跳过同一用户的订单, 以及数量已被模拟撮合减为0, 等待删除的订单
+				if(sellQty>0&&sellOrder->info_.clientid()!=clientID){
+					orderSystem.tradingOrders(sellOrder, buyOrder, false, reports, !market);
+					sellOrder->read(sellQty, sellPrice);
+					if(sellQty==0){
+						// 全部成交, 从档位与计时器中摘除
+						container->sell.remove(sellOrder);
+						timer->delTask(sellOrder->task_);
+						filled.push_back(sellOrder->id_);
+					}else{
+						// 重新计时
+						timer->addTask(sellOrder->id_, sellOrder->task_);
+					}
+					buyOrder->read(buyQty, buyPrice);
+				}
+				sellOrder=next;
+			}
+			// 本档有成交: 更新最新成交价并计入成交价区间, 市价单输出本档的合并回报
+			if(buyQty<levelQty){
+				container->lastPrice.store(levelPrice, std::memory_order_relaxed);
+				traded.add(levelPrice);
+				if(market) levelFillReport(*buyOrder, levelQty, buyQty, levelPrice, reports);
+			}
+			level=nextLevel;
+		}
+	}
+	for(const auto& orderID:filled){
+		orderSystem.deleteOrder(orderID);
 	}
 }
+
+template struct SellAndBuyContainer<ConcurrentLockPolicy>;
+template struct SellAndBuyContainer<SingleThreadLockPolicy>;
+template class BasicMarketSystem<ConcurrentLockPolicy>;
+template class BasicMarketSystem<SingleThreadLockPolicy>;
 #endif
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define MARKET_SYSTEM_H
 
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <string>
 #include <iostream>
 #include <unordered_map>
@@ -10,12 +12,31 @@
 #include <time.h>
 #include <mutex>
 #include <utility>
+#include <tuple>
 #include <shared_mutex>
 #include <thread>
+#include <chrono>
 #include <sys/timeb.h>
 #include "../helper/helper.h"
+#include "../helper/lock_policy.h"
+#include "../helper/stage_stats.h"
+#include "../helper/order_trace.h"
+#include "../helper/mpsc_queue.h"
+#include "../helper/epoch.h"
 #include "order_system.h"
-class Timer;
+#include "../persistence/journal.h"
+#include "../persistence/snapshot.h"
+template<typename LockPolicy> class BasicTimer;
+
+// 模拟撮合消息队列预分配的节点数
+#define MATCH_REPORT_NODES 4096
+// 深度快照每侧的默认档位数与最大档位数
+#define DEPTH_DEFAULT_LEVELS 5
+#define DEPTH_MAX_LEVELS 50
+// 订单查询每页的默认订单数与最大订单数; 一页最多检查的订单数, 限制筛选条件较严时一次读锁的持有时间
+#define QUERY_DEFAULT_LIMIT 100
+#define QUERY_MAX_LIMIT 1000
+#define QUERY_MAX_SCAN 10000
 
 #include <grpc/grpc.h>
 #include <grpcpp/server.h>
@@ -34,96 +55,214 @@ using grpc::Status;
 
 using OPS::NewOrderRequest;
 using OPS::CancelOrderRequest;
+using OPS::AmendOrderRequest;
+using OPS::MassCancelRequest;
+using OPS::MassCancelReply;
+using OPS::AuctionRequest;
+using OPS::AuctionReply;
+using OPS::QuoteEntry;
+using OPS::QuoteAck;
+using OPS::MassQuoteRequest;
+using OPS::MassQuoteReply;
+using OPS::DepthRequest;
+using OPS::DepthUpdate;
 using OPS::QueryOrderRequest;
+using OPS::QueryOrderReply;
 using OPS::ExecutionReport;
 using OPS::OrderReport;
 using OPS::OrderService;
+using OPS::StatsRequest;
+using OPS::StatsReport;
 
 // 售卖容器和购买容器结构体
+// 每侧按价格档位排列挂单, 各自加锁
+template<typename LockPolicy>
 struct SellAndBuyContainer{
-	std::set<uint64_t> sell;
-	std::set<uint64_t> buy;
-	std::mutex* sell_mutex_ptr; // 对卖集合加锁
-	std::mutex* buy_mutex_ptr; // 对买集合加锁
+	BookSide<LockPolicy> sell;
+	BookSide<LockPolicy> buy;
+	// 最新成交价, 在对手方一侧的锁内逐档更新, 读者不加锁; 尚无成交为0, 模拟撮合不计入
+	typename LockPolicy::template Atomic<double> lastPrice{0};
+	// 是否处于集合竞价: 只收单不连续撮合, 挂单簿可以交叉; 同时持有两侧的锁才切换, 读者持有任意一侧的锁即可读取
+	typename LockPolicy::template Atomic<bool> auction{false};
+	// 事件锁: 写日志的事件在该锁内分配日志序号并执行完毕, 同一股票的日志顺序即执行顺序
+	// 在引擎锁之后, 订单系统的锁之前获取; 持有时不新增股票, 多只股票按容器地址顺序加锁
+	typename LockPolicy::Mutex eventMutex{"SellAndBuyContainer::eventMutex"};
     SellAndBuyContainer();
 };
 
-// 市场系统 单例模式 饿汉模式
-class MarketSystem{
-public:
-        // 获取实例
-	static MarketSystem* getInstance(){
-		//if(m_instance==NULL) m_instance=new TradingMarket();
-		return m_instance;
+// 一次撮合的最低与最高成交价, 没有成交时均为0; 据此取出被触发的止损单
+struct TradeRange{
+	double low;
+	double high;
+	TradeRange(): low(0), high(0){}
+	void add(const double& price){
+		low=high==0?price:std::min(low, price);
+		high=std::max(high, price);
 	}
+};
+
+// 市场系统 服务端使用单例, 回放与测试工具可创建独立实例
+// 锁策略见lock_policy.h; 单线程策略的实例不能启动计时器线程
+template<typename LockPolicy>
+class BasicMarketSystem{
+public:
+	typedef SellAndBuyContainer<LockPolicy> Container;
+	// 股票索引: <stockID, sell and buy container>, 发布后不再修改
+	typedef std::unordered_map<std::string, Container*> StockIndex;
+	typedef Order<LockPolicy> OrderType;
+        // 获取实例(首次调用时创建, 并启动计时器线程)
+	static BasicMarketSystem* getInstance();
+	// 构造函数, runTimer为false时不启动计时器线程
+	explicit BasicMarketSystem(const bool& runTimer=true);
+	// 析构函数, 停止计时器线程
+	~BasicMarketSystem();
+	// 启动与停止计时器线程
+	void startTimer();
+	void stopTimer();
 	// 创建订单并且保存执行结果
+	// 不挂单的订单(市价单与IOC, FOK)不登记回报流, 其自身的回报以0为键, 由服务端写回提交该订单的流
 	uint64_t processCreateOrder(const NewOrderRequest&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
 	// 根据新订单请求做出应答消息
 	void processNewOrder(const NewOrderRequest&, const uint64_t&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
 	// 根据撤销订单请求做出应答消息
 	void processCancelOrder(const CancelOrderRequest&, ExecutionReport&);
-	// 根据查询订单请求做出应答消息
-	void processQueryOrder(const QueryOrderRequest&, std::vector<OrderReport>&);
+	// 根据改单请求修改挂单的剩余数量与价格, 一条改单回报
+	void processAmendOrder(const AmendOrderRequest&, ExecutionReport&);
+	// 根据批量撤单请求撤销全部匹配的挂单, 每个订单一条撤单回报
+	void processMassCancel(const MassCancelRequest&, MassCancelReply&);
+	// 集合竞价: 开始时该股票只收单; 撮合时一次成交全部交叉订单, 成交回报经模拟撮合的消息队列推送
+	void processAuction(const AuctionRequest&, AuctionReply&);
+	// 批量报价: 逐只股票整体替换用户的双边报价, 整批一次订单系统写锁, 每只股票一个确认, 不产生执行回报
+	void processMassQuote(const MassQuoteRequest&, MassQuoteReply&);
+	// 档位深度快照: 短暂持有两侧的锁复制前若干档的数量与订单数, 不遍历订单; 股票尚无订单时为空
+	void processGetDepth(const DepthRequest&, DepthUpdate&);
+	// 股票挂单簿的版本号, 档位每变化一次加一, 不加锁; 订阅者据此判断是否需要新的快照, 股票不存在时为0
+	uint64_t depthVersion(const std::string&);
+	// 按用户, 股票, 方向与状态筛选订单, 按订单ID升序返回一页; 从用户或股票的索引中按游标继续, 不排序, 读锁只在一页之内持有
+	void processQueryOrder(const QueryOrderRequest&, QueryOrderReply&);
 	// 获取模拟撮合产生的消息
 	void getMathchReports(std::vector<ExecutionReport>&);
+	// 等待新的模拟撮合消息, 返回累计产生的消息数; seen为上次的返回值, timeout小于0时一直等待
+	uint64_t waitMatchReports(const uint64_t&, const std::chrono::milliseconds&);
 	// 模拟撮合.订单数量为0返回false
 	bool simulationMatch(const uint64_t&);
-private:
+	// 各阶段耗时, 计数, 每只股票的挂单数量与计时器任务数
+	void processGetStats(const StatsRequest&, StatsReport&);
 	/***************************************************************************************
-                                			构造函数
+                                			快照与日志
 	****************************************************************************************/
-	MarketSystem();
-	/***************************************************************************************
-                                			单例对象
-	****************************************************************************************/
-	static MarketSystem* m_instance;
+	// 生成一致性快照
+	bool takeSnapshot(const std::string&);
+	// 载入快照并回放日志尾部, 之后的事件追加写入该日志; 日志无法写入时返回false, 不应继续接收订单
+	bool recover(const std::string&, const std::string&);
+	// 回放一条日志记录(不加引擎锁, 调用方需保证没有并发操作)
+	void replayRecord(const JournalRecord&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+private:
+	typedef typename LockPolicy::Mutex Mutex;
+	typedef typename LockPolicy::SharedMutex SharedMutex;
+	typedef typename LockPolicy::Instrument Instrument;
+	typedef typename LockPolicy::ReadGuard ReadGuard;
     /***************************************************************************************
                                 			订单系统
 	****************************************************************************************/
     // 订单ID，动态增加，增加需要互斥
 	uint64_t id;
 	// 订单ID增加的互斥锁
-	std::mutex orderID_mutex;
+	Mutex orderID_mutex{"MarketSystem::orderID_mutex"};
     // 创建订单
     uint64_t createOrder(const NewOrderRequest&, std::string&);
     // 订单系统
-    OrderSystem orderSystem;
-    // 市场价格
-    double marketPrice;
+    BasicOrderSystem<LockPolicy> orderSystem;
     /***************************************************************************************
                                 			计时器与模拟撮合
 	****************************************************************************************/
-	Timer* timer;
-    // 订单撮合消息
-	std::vector<ExecutionReport> matchReports;
-	// 存储订单撮合消息互斥锁
-	std::mutex matchReportsLock;
+	BasicTimer<LockPolicy>* timer;
+	// 计时器线程
+	std::thread timerThread;
+    // 订单撮合消息, 计时器线程写入不加锁
+	typename LockPolicy::template Queue<ExecutionReport> matchReports{MATCH_REPORT_NODES};
+	// 取出撮合消息的互斥锁, 保证队列只有一个消费者
+	Mutex matchReportsLock{"MarketSystem::matchReportsLock"};
     /***************************************************************************************
                                 		    股票索引
 	****************************************************************************************/
-	// 索引：股票ID对应需要被售卖或购买的容器，<stockID, sell and buy container>, 插入与删除需要互斥
-	std::unordered_map<std::string, SellAndBuyContainer> stock_index;
-	// 插入，删除和访问股票索引的读写锁
-	std::shared_mutex rw_stock_index_mutex;
+	// 索引：股票ID对应需要被售卖或购买的容器, 读者在纪元临界区内直接读取, 不加锁
+	// 新增股票时复制一份加入后原子替换, 旧索引等读者离开后回收; 容器本身不会删除, 取到的指针一直有效
+	// 单线程策略下为普通指针
+	typename LockPolicy::template Atomic<StockIndex*> stock_index;
+	// 新增股票的互斥锁, 写者之间互斥
+	Mutex stock_index_write_mutex{"MarketSystem::stock_index_write_mutex"};
+    /***************************************************************************************
+                                			快照与日志
+	****************************************************************************************/
+	// 事件日志
+	BasicJournal<LockPolicy> journal;
+	// 引擎状态读写锁: 撮合, 撤单与模拟撮合加读锁, 快照与恢复加写锁
+	SharedMutex rw_engine_mutex{"MarketSystem::rw_engine_mutex"};
+	// 撮合新订单, 并依次撮合由此触发的止损单(不加引擎锁, 不写日志)
+	void newOrder(const NewOrderRequest&, const uint64_t&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	// 撮合一个订单: 止损单挂入止损簿, 其余订单撮合后挂单或撤销剩余部分, 被触发的止损单追加到stops
+	// activated为true表示已触发的止损单, 回报流已登记, 自身的回报都以订单ID为键
+	void executeOrder(const NewOrderRequest&, const uint64_t&, const bool&, std::vector<std::pair<uint64_t, ExecutionReport> >&,
+		std::vector<OrderType*>&);
+	// 依次撮合被触发的止损单, 撮合中再触发的止损单追加到末尾
+	void activateStops(std::vector<OrderType*>&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	// 撤销订单(不加引擎锁, 不写日志)
+	bool cancelOrder(const uint64_t&, NewOrderRequest&);
+	// 改单(不加引擎锁, 不写日志), 数量或价格为0表示不变
+	bool amendOrder(const uint64_t&, const uint32_t&, const double&, NewOrderRequest&, std::string&);
+	// 批量撤单: 按用户, 股票与方向筛选挂单, 一次订单系统写锁内全部摘除(不加引擎锁, 不写日志)
+	size_t massCancelOrders(const uint64_t&, const std::string&, const MassCancelRequest::Side&, std::vector<std::pair<uint64_t, NewOrderRequest> >&);
+	// 开始或结束集合竞价(不加引擎锁, 不写日志), 请求不合法返回false
+	bool auction(const std::string&, const AuctionRequest::Action&, AuctionReply&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	// 集合竞价撮合: 按最大成交量的价格成交全部交叉订单(需持有两侧的锁)
+	void uncross(Container*, AuctionReply&, std::vector<std::pair<uint64_t, ExecutionReport> >&, std::vector<uint64_t>&);
+	// 替换一只股票上的双边报价(在订单系统的写锁内调用, 报价需已通过检查), 变化的一侧写入日志; 与对手方交叉返回false, 原有报价不变
+	bool quoteEntry(Container*, const uint64_t&, const QuoteEntry&, OrderType*&, OrderType*&,
+		const typename BasicOrderSystem<LockPolicy>::CreateQuote&, QuoteAck&);
+	// 修改报价的一侧(需持有两侧的锁): 数量为0时摘除, 仍在挂单则原位修改, 否则新建; orderID为0时分配新ID, 该侧有变化返回true
+	bool quoteSide(BookSide<LockPolicy>&, OrderType*&, const NewOrderRequest&, const uint64_t&,
+		const typename BasicOrderSystem<LockPolicy>::CreateQuote&);
+	// 模拟撮合(不加引擎锁, 不写日志)
+	bool matchOrder(const uint64_t&);
     /***************************************************************************************
                                 	        股票索引操作相关
 	****************************************************************************************/
-	// 插入新股票
-	void insertStock(const std::string&);
-	// 将订单加入至待售卖容器
-	void addOrderToSell(const std::string&, const uint64_t&);
-	// 将订单加入至待购买容器
-	void addOrderToBuy(const std::string&, const uint64_t&);
-	// 将订单从售卖容器中删除
-	void delOrderFromSell(const std::string&, const uint64_t&);
-	// 将订单从购买容器中删除
-	void delOrderFromBuy(const std::string&, const uint64_t&);
+	// 插入新股票, 返回该股票的容器
+	Container* insertStock(const std::string&);
+	// 订单所属股票的容器, 订单不存在返回nullptr
+	Container* findOrderStock(const uint64_t&);
+	// 对股票加事件锁, container为nullptr时不加锁
+	std::unique_lock<Mutex> lockEvents(Container*);
+	// 按容器地址顺序对各股票加事件锁, 跳过nullptr与重复的容器
+	void lockEvents(std::vector<Container*>, std::vector<std::unique_lock<Mutex> >&);
+	// 查找股票的容器, 不存在返回nullptr
+	Container* findStock(const std::string&);
+	// 将订单挂到所属一侧的价格档位, 并添加计时任务
+	void addOrderToBook(OrderType*);
+	// 将止损单挂入所属一侧的止损簿; 最新成交价已穿过止损价时不挂入, 返回false由调用方直接触发
+	bool parkStop(OrderType*, Container*);
+	// 取出被本次成交触发的止损单: 买方按最高成交价, 卖方按最低成交价, 只访问止损簿中被触发的部分
+	void collectStops(Container*, const TradeRange&, std::vector<OrderType*>&);
+	// 将订单从价格档位与计时器中摘除, 等待触发的止损单从止损簿摘除; 都不在返回false(需在订单系统的写锁内调用)
+	bool delOrderFromBook(OrderType&);
+	// 修改挂单的剩余数量与价格: 同价减量原位修改, 改价或加量排到新价位末尾(需在订单系统的写锁内调用)
+	bool amendOnBook(OrderType&, const uint32_t&, const double&, std::string&);
+	// 按新的剩余数量与价格重新挂单: 同价减量保留时间优先, 否则排到新价位末尾(需持有该侧的锁)
+	void modifyOnBook(OrderType&, const uint32_t&, const double&);
 	// 判断该股票订单是否在容器中
 	bool isStockExistsInHash(const std::string&);
-    // 卖订单
-	void sellOrders(const uint64_t&, const std::string&, const uint64_t&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
-	// 买订单
-	void buyOrders(const uint64_t&, const std::string&, const uint64_t&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	// 市价单按档位合并的成交回报: 该档成交前后的剩余数量与档位价格
+	void levelFillReport(const OrderType&, const uint32_t&, const uint32_t&, const double&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+    // 卖订单: 按价格优先, 时间优先与买方档位撮合; fillOrKill为true时可成交数量不足则不成交, 成交价计入traded
+	void sellOrders(OrderType*, Container*, std::vector<std::pair<uint64_t, ExecutionReport> >&, const bool&, TradeRange&);
+	// 买订单: 按价格优先, 时间优先与卖方档位撮合; fillOrKill为true时可成交数量不足则不成交, 成交价计入traded
+	void buyOrders(OrderType*, Container*, std::vector<std::pair<uint64_t, ExecutionReport> >&, const bool&, TradeRange&);
 };
 
+// 多线程市场系统(服务端与压测)
+typedef BasicMarketSystem<ConcurrentLockPolicy> MarketSystem;
+// 单线程市场系统(回放, 按股票分片)
+typedef BasicMarketSystem<SingleThreadLockPolicy> SingleThreadMarketSystem;
+
 #endif
\ No newline at end of file
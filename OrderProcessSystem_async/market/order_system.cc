@@ -3,165 +3,599 @@
 #include "order_system.h"
 
 // 订单索引构造函数
-OrderIndex::OrderIndex(){
-    rw_lock_=new std::mutex();
+template<typename LockPolicy>
+OrderIndex<LockPolicy>::OrderIndex(){
+    rw_lock_=new typename LockPolicy::Mutex("OrderIndex::rw_lock_");
     sellOrderIndex.clear();
     buyOrderIndex.clear();
 }
 
 // 订单构造函数
-Order::Order(const NewOrderRequest& info){
-    info_=info;
-    rw_lock_=new std::shared_mutex();
+template<typename LockPolicy>
+Order<LockPolicy>::Order(const uint64_t& id, const NewOrderRequest& info): id_(id), info_(info), seq_(0), qty_(info.orderqty()), price_(info.price()),
+    side_(nullptr), resting_(false), pending_(false), quote_(false), prev_(nullptr), next_(nullptr), task_(nullptr){}
+
+// 读取一致的剩余数量与价格, 版本号为奇数或前后不同时重读
+template<typename LockPolicy>
+void Order<LockPolicy>::read(uint32_t& qty, double& price) const{
+    if constexpr(!LockPolicy::threadSafe){
+        qty=qty_.load();
+        price=price_.load();
+    }else{
+        while(true){
+            uint32_t seq=seq_.load(std::memory_order_acquire);
+            if(seq&1){
+                cpuRelax();
+                continue;
+            }
+            qty=qty_.load(std::memory_order_relaxed);
+            price=price_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(seq_.load(std::memory_order_relaxed)==seq) return;
+        }
+    }
+}
+
+// 复制订单信息并填入当前的剩余数量与价格
+template<typename LockPolicy>
+void Order<LockPolicy>::copyTo(NewOrderRequest& orderInfo) const{
+    uint32_t qty;
+    double price;
+    read(qty, price);
+    orderInfo=info_;
+    orderInfo.set_orderqty(qty);
+    orderInfo.set_price(price);
+}
+
+// 写者加锁
+template<typename LockPolicy>
+void Order<LockPolicy>::lockWrite(){
+    // 单线程引擎没有并发读者, 无需版本号
+    if constexpr(LockPolicy::threadSafe){
+        uint32_t seq=seq_.load(std::memory_order_relaxed);
+        while(true){
+            if(!(seq&1)&&seq_.compare_exchange_weak(seq, seq+1, std::memory_order_acquire, std::memory_order_relaxed)){
+                break;
+            }
+            cpuRelax();
+            seq=seq_.load(std::memory_order_relaxed);
+        }
+        // 之后的字段写入不会被重排到版本号之前
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+}
+
+// 写者解锁
+template<typename LockPolicy>
+void Order<LockPolicy>::unlockWrite(){
+    if constexpr(LockPolicy::threadSafe){
+        seq_.store(seq_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+}
+
+// 挂单簿一侧的构造函数
+template<typename LockPolicy>
+BookSide<LockPolicy>::BookSide(const bool& descending, const char* name): mutex(name), levels_(PriceOrder{descending}),
+    stops_(PriceOrder{!descending}), buy_(descending), count(0), best_(0), version_(0){}
+
+// 挂到所在价格档位的末尾
+template<typename LockPolicy>
+void BookSide<LockPolicy>::append(Order<LockPolicy>* order){
+    auto level=levels_.try_emplace(order->price_.load(std::memory_order_relaxed)).first;
+    if(level==levels_.begin()) best_.store(level->first, std::memory_order_relaxed);
+    order->level_=level;
+    order->prev_=level->second.tail;
+    order->next_=nullptr;
+    if(level->second.tail!=nullptr) level->second.tail->next_=order;
+    else level->second.head=order;
+    level->second.tail=order;
+    level->second.qty+=order->qty_.load(std::memory_order_relaxed);
+    ++level->second.orders;
+    order->resting_=true;
+    ++count;
+    touch();
+}
+
+// 从价格档位中摘除
+template<typename LockPolicy>
+bool BookSide<LockPolicy>::remove(Order<LockPolicy>* order){
+    if(!order->resting_) return false;
+    PriceLevel<LockPolicy>& level=order->level_->second;
+    if(order->prev_!=nullptr) order->prev_->next_=order->next_;
+    else level.head=order->next_;
+    if(order->next_!=nullptr) order->next_->prev_=order->prev_;
+    else level.tail=order->prev_;
+    level.qty-=order->qty_.load(std::memory_order_relaxed);
+    --level.orders;
+    // 档位为空则删除, 删除的是最优档位时更新最优价格
+    if(level.head==nullptr){
+        bool best=order->level_==levels_.begin();
+        levels_.erase(order->level_);
+        if(best) best_.store(levels_.empty()?0:levels_.begin()->first, std::memory_order_relaxed);
+    }
+    order->prev_=nullptr;
+    order->next_=nullptr;
+    order->resting_=false;
+    --count;
+    touch();
+    return true;
+}
+
+// 原地减少剩余数量后扣减档位数量
+template<typename LockPolicy>
+void BookSide<LockPolicy>::reduce(Order<LockPolicy>* order, const uint32_t& qty){
+    if(!order->resting_||qty==0) return;
+    order->level_->second.qty-=qty;
+    touch();
+}
+
+// 最新成交价是否触发止损单
+template<typename LockPolicy>
+bool BookSide<LockPolicy>::triggers(const double& stop, const double& last) const{
+    return last>0&&(buy_?last>=stop:last<=stop);
+}
+
+// 加入止损簿
+template<typename LockPolicy>
+void BookSide<LockPolicy>::park(Order<LockPolicy>* order){
+    order->stop_=stops_.emplace(order->info_.stopprice(), order);
+    order->pending_=true;
+}
+
+// 从止损簿中摘除
+template<typename LockPolicy>
+bool BookSide<LockPolicy>::unpark(Order<LockPolicy>* order){
+    if(!order->pending_) return false;
+    stops_.erase(order->stop_);
+    order->pending_=false;
+    return true;
+}
+
+// 取出被触发的止损单: 止损簿按离触发由近及远排列, 从头取到第一个未触发的为止
+template<typename LockPolicy>
+void BookSide<LockPolicy>::trigger(const double& last, std::vector<Order<LockPolicy>*>& triggered){
+    while(!stops_.empty()&&triggers(stops_.begin()->first, last)){
+        Order<LockPolicy>* order=stops_.begin()->second;
+        stops_.erase(stops_.begin());
+        order->pending_=false;
+        triggered.push_back(order);
+    }
 }
 
 // 订单系统构造函数
-OrderSystem::OrderSystem(){}
+template<typename LockPolicy>
+BasicOrderSystem<LockPolicy>::BasicOrderSystem(){}
+
+// 用户索引中与订单同方向的价格计数
+template<typename LockPolicy>
+static std::map<double, uint32_t>& clientPrices(OrderIndex<LockPolicy>& orderIndex, const Order<LockPolicy>& order){
+    return order.info_.direction()==NewOrderRequest::SELL?orderIndex.sellOrderIndex:orderIndex.buyOrderIndex;
+}
+
+// 该价格的订单数加一
+template<typename LockPolicy>
+static void addClientPrice(OrderIndex<LockPolicy>& orderIndex, Order<LockPolicy>& order, const double& price){
+    order.clientPrice_=clientPrices(orderIndex, order).try_emplace(price, 0).first;
+    ++order.clientPrice_->second;
+}
+
+// 订单所在价格的订单数减一, 为0则删除; 未计入的订单不做修改
+template<typename LockPolicy>
+static void removeClientPrice(OrderIndex<LockPolicy>& orderIndex, Order<LockPolicy>& order){
+    std::map<double, uint32_t>& prices=clientPrices(orderIndex, order);
+    if(order.clientPrice_==prices.end()){
+        return;
+    }
+    if(--order.clientPrice_->second==0){
+        prices.erase(order.clientPrice_);
+    }
+    order.clientPrice_=prices.end();
+}
 
 // 插入新订单
-void OrderSystem::insertOrder(const uint64_t& orderID, const NewOrderRequest& request){
-    // 创建新订单
-    Order newOrder(request);
+template<typename LockPolicy>
+Order<LockPolicy>* BasicOrderSystem<LockPolicy>::insertOrder(const uint64_t& orderID, const NewOrderRequest& request, BookSide<LockPolicy>* side){
     // 获取用户ID
     uint64_t clientID=request.clientid();
-    // 获取订单价格
-    double price=request.price();
-    // 获取订单类型
-    bool type=(request.direction()==NewOrderRequest::SELL)?true:false;
     {
 	    // 加锁,保护hash表的增删
-	    std::unique_lock<std::shared_mutex> w(rw_lock);
+	    std::unique_lock<SharedMutex> w(rw_lock);
         // 更新用户索引
-        if(!client_index.count(clientID)){
-            OrderIndex orderIndex;
-            client_index.insert(std::make_pair(clientID, std::move(orderIndex)));
-        }
+        OrderIndex<LockPolicy>& orderIndex=client_index[clientID];
         // 同一用户互斥
-        std::unique_lock<std::mutex> w_(*client_index.at(clientID).rw_lock_);
-        // 订单信息插入容器
-	    orders.insert(std::make_pair(orderID, std::move(newOrder)));
-        // 添加订单ID至用户索引
-        if(type) client_index.at(clientID).sellOrderIndex[price].emplace(orderID);
-        else client_index.at(clientID).buyOrderIndex[price].emplace(orderID);
+        std::unique_lock<Mutex> w_(*orderIndex.rw_lock_);
+        return &emplaceOrder(orderIndex, orderID, request, side);
     }
 }
 
-// 删除订单
-bool OrderSystem::deleteOrder(const uint64_t& orderID){
-    // 删除结果
-    bool delRes=false;
-    // 订单信息
-    NewOrderRequest orderInfo;
-    if(!getOrderInfo(orderID, orderInfo)){
-        return delRes;
+// 插入订单并更新用户索引
+template<typename LockPolicy>
+Order<LockPolicy>& BasicOrderSystem<LockPolicy>::emplaceOrder(OrderIndex<LockPolicy>& orderIndex, const uint64_t& orderID,
+        const NewOrderRequest& request, BookSide<LockPolicy>* side){
+    // 订单信息插入容器
+    Order<LockPolicy>& order=orders.try_emplace(orderID, orderID, request).first->second;
+    order.side_=side;
+    // 用户索引中该价格的订单数加一; 等待触发的止损单与不限价的市价单不会停在某个价格上, 不计入对敲检查
+    order.clientPrice_=clientPrices(orderIndex, order).end();
+    if(request.stopprice()==0&&!(request.ordertype()==NewOrderRequest::MARKET&&request.price()==0)){
+        addClientPrice(orderIndex, order, request.price());
     }
-    // 获取用户ID
-    uint64_t clientID=orderInfo.clientid();
-    // 获取订单价格
-    double price=orderInfo.price();
-    // 获取订单类型
-    bool type;
-    if(orderInfo.direction()==NewOrderRequest::SELL) type=true;
-    else type=false;
+    linkOrder(orderIndex, order);
+    return order;
+}
+
+// 批量载入订单
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::loadOrders(const std::vector<std::pair<uint64_t, NewOrderRequest> >& requests){
+    // 加锁一次完成全部插入
+    std::unique_lock<SharedMutex> w(rw_lock);
+    orders.reserve(orders.size()+requests.size());
+    for(const auto& [orderID, request]:requests){
+        emplaceOrder(client_index[request.clientid()], orderID, request, nullptr);
+    }
+}
 
+// 删除订单
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::deleteOrder(const uint64_t& orderID){
 	// 加锁,保护hash表的增删
-	std::unique_lock<std::shared_mutex> w(rw_lock);
-    // 同一用户互斥
-    std::unique_lock<std::mutex> w_(*client_index.at(clientID).rw_lock_);
-	// 如果订单存在则删除成功
-	if(orders.find(orderID)!=orders.end()){
-		orders.erase(orderID);
-        delRes=true;
-	}
-    if(client_index.find(clientID)!=client_index.end()){
-        // 从用户索引中删除订单ID
-        if(type){
-            if(client_index.at(clientID).sellOrderIndex.count(price)&&client_index.at(clientID).sellOrderIndex.at(price).count(orderID)){
-                client_index.at(clientID).sellOrderIndex.at(price).erase(orderID);
-                // 为空则删除
-                if(client_index.at(clientID).sellOrderIndex.at(price).size()==0){
-                    client_index.at(clientID).sellOrderIndex.erase(price);
-                }
-            }
-        }else{
-            if(client_index.at(clientID).buyOrderIndex.count(price)&&client_index.at(clientID).buyOrderIndex.at(price).count(orderID)){
-                client_index.at(clientID).buyOrderIndex.at(price).erase(orderID);
-                // 为空则删除
-                if(client_index.at(clientID).buyOrderIndex.at(price).size()==0){
-                    client_index.at(clientID).buyOrderIndex.erase(price);
-                }
-            }
+	std::unique_lock<SharedMutex> w(rw_lock);
+    auto it=orders.find(orderID);
+    if(it==orders.end()){
+        return false;
+    }
+    eraseOrder(it);
+	return true;
+}
+
+// 摘除并删除订单
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::removeOrder(const uint64_t& orderID, NewOrderRequest& orderInfo,
+        const std::function<bool(Order<LockPolicy>&)>& unlink){
+	// 写锁期间订单不会被其他线程删除
+	std::unique_lock<SharedMutex> w(rw_lock);
+    auto it=orders.find(orderID);
+    if(it==orders.end()||!unlink(it->second)){
+        return false;
+    }
+    it->second.copyTo(orderInfo);
+    eraseOrder(it);
+    return true;
+}
+
+// 改单
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::amendOrder(const uint64_t& orderID, const uint32_t& qty, const double& price,
+        NewOrderRequest& orderInfo, std::string& errorMessage,
+        const std::function<bool(Order<LockPolicy>&, const uint32_t&, const double&, std::string&)>& amend){
+	// 写锁期间订单与用户索引不会被其他线程修改
+	std::unique_lock<SharedMutex> w(rw_lock);
+    auto it=orders.find(orderID);
+    if(it==orders.end()){
+        errorMessage="Error: Can not find OrderID!";
+        return false;
+    }
+    Order<LockPolicy>& order=it->second;
+    uint32_t oldQty;
+    double oldPrice;
+    order.read(oldQty, oldPrice);
+    uint32_t newQty=qty>0?qty:oldQty;
+    double newPrice=price>0?price:oldPrice;
+    if(newQty==oldQty&&newPrice==oldPrice){
+        errorMessage="Error: Nothing to amend!";
+        return false;
+    }
+    OrderIndex<LockPolicy>& orderIndex=client_index.at(order.info_.clientid());
+    bool sell=order.info_.direction()==NewOrderRequest::SELL;
+    // 与新订单相同的对敲检查: 新价格不得与该用户对手方的挂单交叉
+    if(newPrice!=oldPrice&&(sell?orderIndex.buyOrderIndex.lower_bound(newPrice)!=orderIndex.buyOrderIndex.end()
+            :orderIndex.sellOrderIndex.upper_bound(newPrice)!=orderIndex.sellOrderIndex.begin())){
+        errorMessage="Improper Matched Order!";
+        return false;
+    }
+    if(!amend(order, newQty, newPrice, errorMessage)){
+        return false;
+    }
+    moveClientPrice(orderIndex, order);
+    order.copyTo(orderInfo);
+    return true;
+}
+
+// 把用户索引中的计数移到订单的新价格, 价格未变或订单未计入时不做修改
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::moveClientPrice(OrderIndex<LockPolicy>& orderIndex, Order<LockPolicy>& order){
+    double price=order.price_.load(std::memory_order_relaxed);
+    if(order.clientPrice_==clientPrices(orderIndex, order).end()||order.clientPrice_->first==price){
+        return;
+    }
+    removeClientPrice(orderIndex, order);
+    addClientPrice(orderIndex, order, price);
+}
+
+// 止损单触发后按限价计入对敲检查
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::activateOrder(Order<LockPolicy>& order){
+    if(order.info_.ordertype()==NewOrderRequest::MARKET&&order.info_.price()==0){
+        return;
+    }
+    // 读锁下订单不会被删除, 同一用户互斥, 与对敲检查的加锁方式相同
+    std::shared_lock<SharedMutex> r(rw_lock);
+    OrderIndex<LockPolicy>& orderIndex=client_index.at(order.info_.clientid());
+    std::unique_lock<Mutex> w(*orderIndex.rw_lock_);
+    if(order.clientPrice_==clientPrices(orderIndex, order).end()){
+        addClientPrice(orderIndex, order, order.price_.load(std::memory_order_relaxed));
+    }
+}
+
+// 批量替换用户的双边报价
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::replaceQuotes(const uint64_t& clientID, const std::vector<std::string>& stockIDs,
+        const std::function<void(const size_t&, Order<LockPolicy>*&, Order<LockPolicy>*&, const CreateQuote&)>& quote){
+	// 整批在一次写锁内完成, 其他请求看不到替换了一半的报价
+	std::unique_lock<SharedMutex> w(rw_lock);
+    OrderIndex<LockPolicy>& orderIndex=client_index[clientID];
+    CreateQuote create=[&](const uint64_t& orderID, const NewOrderRequest& request, BookSide<LockPolicy>* side){
+        Order<LockPolicy>& order=emplaceOrder(orderIndex, orderID, request, side);
+        order.quote_=true;
+        return &order;
+    };
+    // 报价订单可能已成交删除或被撤销, 按ID重新查找
+    auto find=[&](const uint64_t& orderID){
+        auto it=orders.find(orderID);
+        return it==orders.end()?nullptr:&it->second;
+    };
+    for(size_t i=0;i<stockIDs.size();i++){
+        std::pair<uint64_t, uint64_t>& ids=orderIndex.quotes[stockIDs[i]];
+        Order<LockPolicy>* old[2]={find(ids.first), find(ids.second)};
+        Order<LockPolicy>* current[2]={old[0], old[1]};
+        quote(i, current[0], current[1], create);
+        for(int k=0;k<2;k++){
+            if(old[k]!=nullptr&&old[k]!=current[k]) eraseOrder(orders.find(old[k]->id_));
+            if(current[k]!=nullptr) moveClientPrice(orderIndex, *current[k]);
+        }
+        ids.first=current[0]==nullptr?0:current[0]->id_;
+        ids.second=current[1]==nullptr?0:current[1]->id_;
+        if(ids.first==0&&ids.second==0){
+            orderIndex.quotes.erase(stockIDs[i]);
+        }
+    }
+}
+
+// 将订单登记为用户在该股票上的报价
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::restoreQuote(const uint64_t& orderID){
+	std::unique_lock<SharedMutex> w(rw_lock);
+    auto it=orders.find(orderID);
+    if(it==orders.end()){
+        return;
+    }
+    Order<LockPolicy>& order=it->second;
+    order.quote_=true;
+    std::pair<uint64_t, uint64_t>& ids=client_index[order.info_.clientid()].quotes[order.info_.stockid()];
+    (order.info_.direction()==NewOrderRequest::SELL?ids.second:ids.first)=orderID;
+}
+
+// 从用户索引与订单容器中删除
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::eraseOrder(typename std::unordered_map<uint64_t, Order<LockPolicy> >::iterator it){
+    Order<LockPolicy>& order=it->second;
+    // 写锁下没有其他访问用户索引的线程, 按句柄减少该价格的订单数, 为0则删除
+    OrderIndex<LockPolicy>& orderIndex=client_index.at(order.info_.clientid());
+    removeClientPrice(orderIndex, order);
+    // 报价订单成交或撤销后, 该侧不再有报价
+    if(order.quote_){
+        auto quote=orderIndex.quotes.find(order.info_.stockid());
+        if(quote!=orderIndex.quotes.end()){
+            if(quote->second.first==order.id_) quote->second.first=0;
+            if(quote->second.second==order.id_) quote->second.second=0;
+        }
+    }
+    // 从用户与股票的订单ID索引中摘除
+    orderIndex.orderIDs.erase(order.clientOrder_);
+    symbol_index.at(order.info_.stockid()).erase(order.symbolOrder_);
+    orders.erase(it);
+}
+
+// 加入用户与股票的订单ID索引(需持有写锁)
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::linkOrder(OrderIndex<LockPolicy>& orderIndex, Order<LockPolicy>& order){
+    order.clientOrder_=orderIndex.orderIDs.emplace_hint(orderIndex.orderIDs.end(), order.id_, &order);
+    OrderIDIndex<LockPolicy>& symbolOrders=symbol_index[order.info_.stockid()];
+    order.symbolOrder_=symbolOrders.emplace_hint(symbolOrders.end(), order.id_, &order);
+}
+
+// 批量删除用户的订单
+template<typename LockPolicy>
+size_t BasicOrderSystem<LockPolicy>::removeClientOrders(const uint64_t& clientID, const std::function<bool(Order<LockPolicy>&)>& unlink,
+        std::vector<std::pair<uint64_t, NewOrderRequest> >& removed){
+	// 一次写锁完成全部删除
+	std::unique_lock<SharedMutex> w(rw_lock);
+    auto index=client_index.find(clientID);
+    if(index==client_index.end()){
+        return 0;
+    }
+    size_t count=0;
+    OrderIDIndex<LockPolicy>& orderIDs=index->second.orderIDs;
+    for(auto it=orderIDs.begin();it!=orderIDs.end();){
+        // 删除会摘除当前位置, 先取下一个
+        Order<LockPolicy>* order=it->second;
+        ++it;
+        if(unlink(*order)){
+            removed.emplace_back(order->id_, NewOrderRequest());
+            order->copyTo(removed.back().second);
+            eraseOrder(orders.find(order->id_));
+            ++count;
         }
     }
-	return delRes;
+    return count;
+}
+
+// 批量删除选出的订单
+template<typename LockPolicy>
+size_t BasicOrderSystem<LockPolicy>::removeOrders(const std::function<void(std::vector<Order<LockPolicy>*>&)>& select,
+        std::vector<std::pair<uint64_t, NewOrderRequest> >& removed){
+	// 一次写锁完成全部删除
+	std::unique_lock<SharedMutex> w(rw_lock);
+    std::vector<Order<LockPolicy>*> selected;
+    select(selected);
+    for(Order<LockPolicy>* order:selected){
+        removed.emplace_back(order->id_, NewOrderRequest());
+        order->copyTo(removed.back().second);
+        eraseOrder(orders.find(order->id_));
+    }
+    return selected.size();
+}
+
+// 查找订单
+template<typename LockPolicy>
+Order<LockPolicy>* BasicOrderSystem<LockPolicy>::findOrder(const uint64_t& orderID){
+	// 读锁
+	std::shared_lock<SharedMutex> r(rw_lock);
+	auto it=orders.find(orderID);
+	return it==orders.end()?nullptr:&it->second;
+}
+
+// 在读锁内访问订单
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::visitOrder(const uint64_t& orderID, const std::function<void(Order<LockPolicy>&)>& visit){
+	// 读锁
+	std::shared_lock<SharedMutex> r(rw_lock);
+	auto it=orders.find(orderID);
+	if(it==orders.end()){
+		return false;
+	}
+	visit(it->second);
+	return true;
 }
 
 // 查询订单信息
-bool OrderSystem::getOrderInfo(const uint64_t& orderID, NewOrderRequest& orderInfo){
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::getOrderInfo(const uint64_t& orderID, NewOrderRequest& orderInfo){
 	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_lock);
+	std::shared_lock<SharedMutex> r(rw_lock);
 	// 订单不存在
 	if(orders.find(orderID)==orders.end()){
 		return false;
 	}
-    Order& order=orders.at(orderID);
 	// 订单存在
-	std::shared_lock<std::shared_mutex> r_(*order.rw_lock_);
-	orderInfo=order.info_;
+	orders.at(orderID).copyTo(orderInfo);
 	return true;
 }
 
-// 获取所有订单信息
-void OrderSystem::getAllOrders(std::vector<OrderReport>& reports){
-    // 订单信息
-    NewOrderRequest orderInfo;
+// 查询订单的用户, 剩余数量与价格
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::getOrderState(const uint64_t& orderID, OrderState& state){
 	// 读锁
-	std::shared_lock<std::shared_mutex> r(rw_lock);
-	for(const auto& [orderID, order]:orders){
-        {
-		    // 对订单加读锁
-		    std::shared_lock<std::shared_mutex> r_(*order.rw_lock_);
-            orderInfo=order.info_;
-        }
-		OrderReport report;
-		initReport(report, orderInfo, orderID);
-		reports.push_back(report);
+	std::shared_lock<SharedMutex> r(rw_lock);
+	auto it=orders.find(orderID);
+	if(it==orders.end()){
+		return false;
 	}
+	state.clientID=it->second.info_.clientid();
+	it->second.read(state.qty, state.price);
+	return true;
+}
+
+// 按订单ID顺序查询一页订单
+template<typename LockPolicy>
+uint64_t BasicOrderSystem<LockPolicy>::queryOrders(const uint64_t& clientID, const std::string& stockID, const uint64_t& cursor,
+        const size_t& limit, const size_t& maxScan, const std::function<bool(Order<LockPolicy>&)>& select, std::vector<OrderReport>& reports){
+    typedef typename OrderIDIndex<LockPolicy>::const_iterator Iterator;
+    // 各索引中尚未检查的部分
+    std::vector<std::pair<Iterator, Iterator> > ranges;
+    auto addRange=[&](const OrderIDIndex<LockPolicy>& index){
+        auto first=index.upper_bound(cursor);
+        if(first!=index.end()) ranges.emplace_back(first, index.end());
+    };
+    NewOrderRequest orderInfo;
+	// 读锁只在一页之内持有, 翻页之间插入与删除照常进行
+	std::shared_lock<SharedMutex> r(rw_lock);
+    const OrderIDIndex<LockPolicy>* clientOrders=nullptr;
+    const OrderIDIndex<LockPolicy>* symbolOrders=nullptr;
+    if(clientID!=0){
+        auto it=client_index.find(clientID);
+        if(it==client_index.end()) return 0;
+        clientOrders=&it->second.orderIDs;
+    }
+    if(!stockID.empty()){
+        auto it=symbol_index.find(stockID);
+        if(it==symbol_index.end()) return 0;
+        symbolOrders=&it->second;
+    }
+    if(clientOrders!=nullptr&&(symbolOrders==nullptr||clientOrders->size()<=symbolOrders->size())) addRange(*clientOrders);
+    else if(symbolOrders!=nullptr) addRange(*symbolOrders);
+    else for(const auto& [symbol, index]:symbol_index) addRange(index);
+    // 小顶堆按各索引的下一个订单ID归并, 只有一个索引时即顺序遍历
+    auto later=[](const std::pair<Iterator, Iterator>& a, const std::pair<Iterator, Iterator>& b){
+        return a.first->first>b.first->first;
+    };
+    std::make_heap(ranges.begin(), ranges.end(), later);
+    uint64_t last=0;
+    size_t scanned=0;
+    while(!ranges.empty()){
+        if(reports.size()>=limit||scanned>=maxScan) return last;
+        std::pop_heap(ranges.begin(), ranges.end(), later);
+        auto& range=ranges.back();
+        Order<LockPolicy>& order=*range.first->second;
+        last=order.id_;
+        ++scanned;
+        if(select(order)){
+            order.copyTo(orderInfo);
+            reports.emplace_back();
+            initReport(reports.back(), orderInfo, order.id_);
+        }
+        if(++range.first==range.second) ranges.pop_back();
+        else std::push_heap(ranges.begin(), ranges.end(), later);
+    }
+    return 0;
 }
 
 // 买卖订单交易
-void OrderSystem::tradingOrders(const uint64_t& sellOrderID, const uint64_t& buyOrderID, const bool& direction, std::vector<std::pair<uint64_t, ExecutionReport> >& reports){
+template<typename LockPolicy>
+void BasicOrderSystem<LockPolicy>::tradingOrders(Order<LockPolicy>* sellOrderPtr, Order<LockPolicy>* buyOrderPtr, const bool& direction,
+		std::vector<std::pair<uint64_t, ExecutionReport> >& reports, const bool& aggressorReport, const double& auctionPrice){
     // 成交价格
-	double fillPrice=0.0;
+	double fillPrice=auctionPrice;
     // 成交数量
     uint32_t tradeNum=0;
     // 订单信息
     NewOrderRequest sellOrderInfo, buyOrderInfo;
+    uint64_t sellOrderID=sellOrderPtr->id_;
+    uint64_t buyOrderID=buyOrderPtr->id_;
     {
-	    // 对orders加读锁
-	    std::shared_lock<std::shared_mutex> r(rw_lock);
-        // 判断两订单是否都存在
-        if(!orders.count(sellOrderID)||!orders.count(buyOrderID)) return;
-	    Order& sellOrder=orders.at(sellOrderID);
-	    Order& buyOrder=orders.at(buyOrderID);
-        // 获取订单信息
+	    Order<LockPolicy>& sellOrder=*sellOrderPtr;
+	    Order<LockPolicy>& buyOrder=*buyOrderPtr;
+        // 对买卖订单加写锁, 按订单ID顺序避免死锁
+        Order<LockPolicy>& first=sellOrderID<buyOrderID?sellOrder:buyOrder;
+        Order<LockPolicy>& second=sellOrderID<buyOrderID?buyOrder:sellOrder;
+        first.lockWrite();
+        second.lockWrite();
+        uint32_t sellQty=sellOrder.qty_.load(std::memory_order_relaxed);
+        uint32_t buyQty=buyOrder.qty_.load(std::memory_order_relaxed);
+        double sellPrice=sellOrder.price_.load(std::memory_order_relaxed);
+        double buyPrice=buyOrder.price_.load(std::memory_order_relaxed);
+        // 计算可卖出的数量
+        tradeNum=std::min(buyQty, sellQty);
+        // 从数据库中修改两订单的库存量
+        buyOrder.qty_.store(buyQty-tradeNum, std::memory_order_relaxed);
+        sellOrder.qty_.store(sellQty-tradeNum, std::memory_order_relaxed);
+        second.unlockWrite();
+        first.unlockWrite();
+        // 挂单方所在档位的深度, 调用方持有其所在一侧的锁; 主动方尚未挂单
+        if(sellOrder.side_!=nullptr) sellOrder.side_->reduce(&sellOrder, tradeNum);
+        if(buyOrder.side_!=nullptr) buyOrder.side_->reduce(&buyOrder, tradeNum);
+        // 获取订单信息(成交前的数量)
         sellOrderInfo=sellOrder.info_;
+        sellOrderInfo.set_orderqty(sellQty);
+        sellOrderInfo.set_price(sellPrice);
         buyOrderInfo=buyOrder.info_;
-        {
-	        // 对买卖订单加写锁
-	        std::unique_lock<std::shared_mutex> w1(*sellOrder.rw_lock_);
-	        std::unique_lock<std::shared_mutex> w2(*buyOrder.rw_lock_);
-	        // 计算可卖出的数量
-	        tradeNum=std::min(buyOrderInfo.orderqty(), sellOrderInfo.orderqty());
-            // 从数据库中修改两订单的库存量
-	        buyOrder.info_.set_orderqty(buyOrderInfo.orderqty()-tradeNum);
-	        sellOrder.info_.set_orderqty(sellOrderInfo.orderqty()-tradeNum);
-        }
+        buyOrderInfo.set_orderqty(buyQty);
+        buyOrderInfo.set_price(buyPrice);
     }
-    // 获取交易价格
-    if(direction==true){ // 卖
+    // 获取交易价格, 集合竞价按给定价格成交
+    if(fillPrice==0&&direction==true){ // 卖
 	    fillPrice=buyOrderInfo.price();
-	}else{ // 买
+	}else if(fillPrice==0){ // 买
 	    fillPrice=sellOrderInfo.price();
 	}
 	// 设置sell订单交易成功的应答
@@ -182,65 +616,16 @@ void OrderSystem::tradingOrders(const uint64_t& sellOrderID, const uint64_t& buy
 	buyReport.set_fillprice(fillPrice);
 	buyReport.set_leaveqty(buyOrderInfo.orderqty()-tradeNum);
 	buyReport.set_time(getTime());
-	// 存储report
-	reports.push_back(std::make_pair(sellOrderID, sellReport));
-	reports.push_back(std::make_pair(buyOrderID, buyReport));
-}
-
-// 将市价单的价格更新为市价
-void OrderSystem::updateToMarketPrice(const uint64_t& orderID, const double& marketPrice){
-    // 订单信息
-    NewOrderRequest orderInfo;
-	// 对orders加读锁
-	std::shared_lock<std::shared_mutex> r1(rw_lock);
-    if(!orders.count(orderID)) return;
-	{
-		// 对订单加读锁
-		std::shared_lock<std::shared_mutex> r_(*orders.at(orderID).rw_lock_);
-		if(orders.at(orderID).info_.ordertype()==NewOrderRequest::LIMIT){
-			return;
-		}
-        orderInfo=orders.at(orderID).info_;
-	}
-    uint64_t clientID=orderInfo.clientid();
-    bool type=(orderInfo.direction()==NewOrderRequest::SELL)?true:false;
-    double price=orderInfo.price();
-    if(!client_index.count(clientID)){
-        return;
-    }
-    // 同一用户互斥
-    std::unique_lock<std::mutex> w_(*client_index.at(clientID).rw_lock_);
-    {
-        // 对订单加写锁
-	    std::unique_lock<std::shared_mutex> w_(*orders.at(orderID).rw_lock_);
-	    orders.at(orderID).info_.set_price(marketPrice);
-    }
-    {
-        // 修改用户索引
-        if(type){
-            if(client_index.at(clientID).sellOrderIndex.count(price)&&client_index.at(clientID).sellOrderIndex.at(price).count(orderID)){
-                client_index.at(clientID).sellOrderIndex.at(price).erase(orderID);
-                // 为空则删除
-                if(client_index.at(clientID).sellOrderIndex.at(price).size()==0){
-                    client_index.at(clientID).sellOrderIndex.erase(price);
-                }
-            }
-            client_index.at(clientID).sellOrderIndex[marketPrice].emplace(orderID);
-        }else{
-            if(client_index.at(clientID).buyOrderIndex.count(price)&&client_index.at(clientID).buyOrderIndex.at(price).count(orderID)){
-                client_index.at(clientID).buyOrderIndex.at(price).erase(orderID);
-                // 为空则删除
-                if(client_index.at(clientID).buyOrderIndex.at(price).size()==0){
-                     client_index.at(clientID).buyOrderIndex.erase(price);
-                  }
-            }
-            client_index.at(clientID).buyOrderIndex[marketPrice].emplace(orderID);
-        }
-    }
+	// 存储report, 主动方的回报可由调用方合并
+	if(aggressorReport||!direction) reports.push_back(std::make_pair(sellOrderID, sellReport));
+	if(aggressorReport||direction) reports.push_back(std::make_pair(buyOrderID, buyReport));
+	Instrument::traceOrder(TRACE_MATCHED, sellOrderID, buyOrderID, tradeNum);
+	Instrument::traceOrder(TRACE_MATCHED, buyOrderID, sellOrderID, tradeNum);
 }
 
 // 模拟撮合
-bool OrderSystem::simulationMatch(const uint64_t& orderID, ExecutionReport& report_){
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::simulationMatch(const uint64_t& orderID, ExecutionReport& report_){
 	// 订单信息
 	NewOrderRequest orderInfo;
     // 原订单数量和撮合数量
@@ -248,25 +633,30 @@ bool OrderSystem::simulationMatch(const uint64_t& orderID, ExecutionReport& repo
 	uint64_t matchQty;
 	// 对orders加读锁
 	{
-		std::shared_lock<std::shared_mutex> r(rw_lock);
+		std::shared_lock<SharedMutex> r(rw_lock);
 		// 订单已被删除
 		if(orders.find(orderID)==orders.end()){
 			return false;
 		}
 		// 订单
-		Order& order=orders.at(orderID);
-		{
-			// 对订单加写锁
-			std::unique_lock<std::shared_mutex> w(*order.rw_lock_);
-			// 获取订单信息
-			orderInfo=order.info_;
-			// 获取订单数量
-			originQty=orderInfo.orderqty();
-			// 匹配的数量
-			matchQty=(originQty/2-(originQty/2)%100)==0?originQty:(originQty/2-(originQty/2)%100);
-			if(matchQty==0) return false;
-			orders.at(orderID).info_.set_orderqty(originQty-matchQty);
-		}
+		Order<LockPolicy>& order=orders.at(orderID);
+		// 加所在一侧的锁以同步扣减档位深度, 再对订单加写锁
+		std::unique_lock<Mutex> side;
+		if(order.side_!=nullptr) side=std::unique_lock<Mutex>(order.side_->mutex);
+		order.lockWrite();
+		// 获取订单数量
+		originQty=order.qty_.load(std::memory_order_relaxed);
+		// 匹配的数量
+		matchQty=(originQty/2-(originQty/2)%100)==0?originQty:(originQty/2-(originQty/2)%100);
+		if(matchQty>0) order.qty_.store(originQty-matchQty, std::memory_order_relaxed);
+		double price=order.price_.load(std::memory_order_relaxed);
+		order.unlockWrite();
+		if(order.side_!=nullptr) order.side_->reduce(&order, matchQty);
+		if(side.owns_lock()) side.unlock();
+		if(matchQty==0) return false;
+		// 获取订单信息
+		orderInfo=order.info_;
+		orderInfo.set_price(price);
 	}
 
 	// 初始化应答消息
@@ -283,21 +673,26 @@ bool OrderSystem::simulationMatch(const uint64_t& orderID, ExecutionReport& repo
 }
 
 // 判断是否是对敲订单
-bool OrderSystem::isImproperMatchedOrder(const NewOrderRequest& request){
+template<typename LockPolicy>
+bool BasicOrderSystem<LockPolicy>::isImproperMatchedOrder(const NewOrderRequest& request){
+    // 止损单触发前不撮合, 不与该用户的挂单对敲, 也不阻止该用户之后的反向订单; 触发后撮合跳过该用户自己的挂单
+    if(request.stopprice()>0){
+        return false;
+    }
 	// 获取用户ID
 	uint64_t clientID=request.clientid();
-    // 获取订单价格
-    double price=request.price();
+    // 获取撮合限价, 不限价的市价单与该用户任意反向挂单对敲
+    double price=matchPrice(request);
 	// 判断订单类型并遍历判断是否对敲
 	if(request.direction()==NewOrderRequest::BUY){
         // 读锁
-	    std::shared_lock<std::shared_mutex> r(rw_lock);
+	    std::shared_lock<SharedMutex> r(rw_lock);
         // 存在该用户
         if(client_index.count(clientID)){
             // 获取卖订单ID集合
-		    OrderIndex& orderIndex=client_index.at(clientID);
+		    OrderIndex<LockPolicy>& orderIndex=client_index.at(clientID);
             // 互斥锁
-	        std::unique_lock<std::mutex> w_(*orderIndex.rw_lock_);
+	        std::unique_lock<Mutex> w_(*orderIndex.rw_lock_);
             // 判断是否存在价格比buy订单一样或更小的sell订单
             if(orderIndex.sellOrderIndex.size()>0&&orderIndex.sellOrderIndex.upper_bound(price)!=orderIndex.sellOrderIndex.begin()){
                 return true;
@@ -305,13 +700,13 @@ bool OrderSystem::isImproperMatchedOrder(const NewOrderRequest& request){
         }
 	}else{
 		// 读锁
-	    std::shared_lock<std::shared_mutex> r(rw_lock);
+	    std::shared_lock<SharedMutex> r(rw_lock);
         // 存在该用户
         if(client_index.count(clientID)){
 		    // 获取卖订单ID集合
-		    OrderIndex& orderIndex=client_index.at(clientID);
+		    OrderIndex<LockPolicy>& orderIndex=client_index.at(clientID);
             // 互斥锁
-	        std::unique_lock<std::mutex> w_(*orderIndex.rw_lock_);
+	        std::unique_lock<Mutex> w_(*orderIndex.rw_lock_);
             // 判断是否存在价格比sell订单一样或更大的buy订单
             if(orderIndex.buyOrderIndex.size()>0&&orderIndex.buyOrderIndex.lower_bound(price)!=orderIndex.buyOrderIndex.end()){
                 return true;
@@ -320,4 +715,13 @@ bool OrderSystem::isImproperMatchedOrder(const NewOrderRequest& request){
 	}
 	return false;
 }
+
+template struct Order<ConcurrentLockPolicy>;
+template struct Order<SingleThreadLockPolicy>;
+template struct OrderIndex<ConcurrentLockPolicy>;
+template struct OrderIndex<SingleThreadLockPolicy>;
+template class BookSide<ConcurrentLockPolicy>;
+template class BookSide<SingleThreadLockPolicy>;
+template class BasicOrderSystem<ConcurrentLockPolicy>;
+template class BasicOrderSystem<SingleThreadLockPolicy>;
 #endif
\ No newline at end of file
@@ -7,13 +7,19 @@
 #include <unordered_map>
 #include <queue>
 #include <set>
+#include <map>
+#include <vector>
+#include <functional>
 #include <time.h>
 #include <mutex>
+#include <atomic>
 #include <utility>
 #include <shared_mutex>
 #include <thread>
 #include <sys/timeb.h>
 #include "../helper/helper.h"
+#include "../helper/lock_policy.h"
+#include "../helper/order_trace.h"
 
 #include <grpc/grpc.h>
 #include <grpcpp/server.h>
@@ -37,41 +43,192 @@ using OPS::ExecutionReport;
 using OPS::OrderReport;
 using OPS::OrderService;
 
-// 售卖容器和购买容器结构体
+struct TaskNode;
+template<typename LockPolicy> struct Order;
+template<typename LockPolicy> class BookSide;
+
+// 按订单ID排列的订单索引: 订单ID大致递增, 插入时以末尾为提示, 均摊常数时间; 按ID分页查询时从游标处继续
+template<typename LockPolicy>
+using OrderIDIndex=std::map<uint64_t, Order<LockPolicy>*>;
+
+// 用户索引: 每个价格上的挂单数用于对敲检查, 订单ID索引用于按用户批量撤单与查询
+template<typename LockPolicy>
 struct OrderIndex{
-    std::map<double, std::set<uint64_t>> sellOrderIndex; // 卖容器索引
-    std::map<double, std::set<uint64_t>> buyOrderIndex; //买容器索引
-	std::mutex* rw_lock_; // 对买卖集合均加锁
+    std::map<double, uint32_t> sellOrderIndex; // 卖单价格 -> 订单数
+    std::map<double, uint32_t> buyOrderIndex; // 买单价格 -> 订单数
+    OrderIDIndex<LockPolicy> orderIDs; // 该用户的订单, 插入与删除都在订单系统的写锁内
+    std::unordered_map<std::string, std::pair<uint64_t, uint64_t> > quotes; // 股票 -> 买卖报价订单ID, 0表示该侧没有报价
+	typename LockPolicy::Mutex* rw_lock_; // 对买卖集合均加锁
     OrderIndex();
 };
 
+// 订单的可变状态
+struct OrderState{
+	uint64_t clientID; // 用户ID
+	uint32_t qty; // 剩余数量
+	double price; // 价格
+};
+
+// 价格档位: 同一价格的挂单按到达顺序组成侵入式双向链表
+// 档位深度随挂单, 成交与撤单增量维护, 读取深度不必遍历订单
+template<typename LockPolicy>
+struct PriceLevel{
+	Order<LockPolicy>* head;
+	Order<LockPolicy>* tail;
+	uint64_t qty; // 档位内挂单的剩余数量之和
+	uint32_t orders; // 档位内的挂单数
+	PriceLevel(): head(nullptr), tail(nullptr), qty(0), orders(0){}
+};
+
+// 档位排序: 卖方价格升序, 买方价格降序, 两侧的begin()都是最优价
+struct PriceOrder{
+	bool descending;
+	bool operator()(const double& a, const double& b) const{ return descending?a>b:a<b; }
+};
+
+template<typename LockPolicy>
+using PriceLevels=std::map<double, PriceLevel<LockPolicy>, PriceOrder>;
+
+// 止损簿: 止损价 -> 等待触发的止损单, 按离触发由近及远排列(买方升序, 卖方降序), 同价按到达顺序
+template<typename LockPolicy>
+using StopOrders=std::multimap<double, Order<LockPolicy>*, PriceOrder>;
+
 // 订单结构体
+// 订单信息插入后不再修改, 剩余数量与价格放在版本号保护的原子字段中:
+// 写者把版本号改为奇数后修改, 完成后再加一; 读者读到前后相同的偶数版本号即为一致的值, 不加锁也不阻塞写者
+// 单线程锁策略下字段为普通变量, 不使用版本号
+// 订单同时带有指向价格档位, 计时任务与用户索引的句柄, 撤单与成交时直接摘除, 不再按订单ID查找
+template<typename LockPolicy>
 struct Order{
-	NewOrderRequest info_; // 订单信息
-	std::shared_mutex* rw_lock_; // 读写锁
-    Order(const NewOrderRequest&); // 构造函数
+	template<typename T> using Atomic=typename LockPolicy::template Atomic<T>;
+	uint64_t id_; // 订单ID
+	NewOrderRequest info_; // 订单信息, 数量与价格以下面的字段为准
+	Atomic<uint32_t> seq_; // 版本号, 奇数表示正在修改
+	Atomic<uint32_t> qty_; // 剩余数量
+	Atomic<double> price_; // 价格
+	// 所在一侧的挂单簿, 插入订单时确定; 以下六个字段由该侧的锁保护
+	BookSide<LockPolicy>* side_;
+	bool resting_; // 是否挂在价格档位上
+	bool pending_; // 是否在止损簿中等待触发
+	bool quote_; // 是否为做市报价订单, 插入时确定
+	typename StopOrders<LockPolicy>::iterator stop_; // 在止损簿中的位置
+	typename PriceLevels<LockPolicy>::iterator level_; // 所在价格档位
+	Order* prev_; // 同一档位的前一个订单
+	Order* next_; // 同一档位的后一个订单
+	TaskNode* task_; // 计时任务, 由计时器的锁保护
+	std::map<double, uint32_t>::iterator clientPrice_; // 用户索引中该价格的计数, 未计入对敲检查时为该方向计数的end()
+	typename OrderIDIndex<LockPolicy>::iterator clientOrder_; // 在用户的订单ID索引中的位置
+	typename OrderIDIndex<LockPolicy>::iterator symbolOrder_; // 在股票的订单ID索引中的位置
+    Order(const uint64_t&, const NewOrderRequest&); // 构造函数
+	// 读取一致的剩余数量与价格
+	void read(uint32_t&, double&) const;
+	// 复制订单信息并填入当前的剩余数量与价格
+	void copyTo(NewOrderRequest&) const;
+	// 写者之间互斥: 等到版本号为偶数后加一
+	void lockWrite();
+	void unlockWrite();
 };
 
-class OrderSystem{
+// 一侧的挂单簿: 价格优先, 同价位时间优先; 除构造外的操作都需持有mutex
+template<typename LockPolicy>
+class BookSide{
+public:
+	typedef typename LockPolicy::Mutex Mutex;
+	// descending: 买方为true
+	BookSide(const bool&, const char*);
+	// 挂到所在价格档位的末尾
+	void append(Order<LockPolicy>*);
+	// 从价格档位中摘除, 档位为空时删除; 订单不在簿上返回false
+	bool remove(Order<LockPolicy>*);
+	// 挂单的剩余数量原地减少qty后(成交或同价减量)扣减所在档位的数量, 订单不在簿上时不变
+	void reduce(Order<LockPolicy>*, const uint32_t&);
+	// 最新成交价last是否触发该侧止损价为stop的止损单: 买方last不低于stop, 卖方last不高于stop; 尚无成交不触发
+	bool triggers(const double&, const double&) const;
+	// 加入止损簿等待触发
+	void park(Order<LockPolicy>*);
+	// 从止损簿中摘除; 订单不在止损簿中返回false
+	bool unpark(Order<LockPolicy>*);
+	// 取出被成交价触发的止损单追加到triggered, 只访问被触发的部分与第一个未触发的止损单
+	void trigger(const double&, std::vector<Order<LockPolicy>*>&);
+	// 全部等待触发的止损单
+	const StopOrders<LockPolicy>& stops() const{ return stops_; }
+	// 全部档位
+	PriceLevels<LockPolicy>& levels(){ return levels_; }
+	const PriceLevels<LockPolicy>& levels() const{ return levels_; }
+	// 挂单数
+	size_t size() const{ return count; }
+	// 最优价格, 读者不加锁; 本侧为空时为0
+	double best() const{ return best_.load(std::memory_order_relaxed); }
+	// 档位变化次数, 读者不加锁, 据此判断深度是否变化
+	uint64_t version() const{ return version_.load(std::memory_order_acquire); }
+	// 保护本侧的档位与订单的档位句柄
+	Mutex mutex;
+private:
+	PriceLevels<LockPolicy> levels_;
+	StopOrders<LockPolicy> stops_;
+	bool buy_;
+	size_t count;
+	// 最优档位变化时在锁内更新
+	typename LockPolicy::template Atomic<double> best_;
+	// 档位变化时在锁内加一
+	typename LockPolicy::template Atomic<uint64_t> version_;
+	void touch(){ version_.store(version_.load(std::memory_order_relaxed)+1, std::memory_order_release); }
+};
+
+// 订单系统, 锁策略见lock_policy.h
+template<typename LockPolicy>
+class BasicOrderSystem{
 public:
     /***************************************************************************************
                                 		订单的增删改
 	****************************************************************************************/
-    // 插入新订单
-	void insertOrder(const uint64_t&, const NewOrderRequest&);
-	// 删除订单(删除成功返回true)
+    // 插入新订单, 返回订单的句柄; side为订单所属一侧的挂单簿
+	Order<LockPolicy>* insertOrder(const uint64_t&, const NewOrderRequest&, BookSide<LockPolicy>* side=nullptr);
+	// 批量载入订单(从快照恢复)
+	void loadOrders(const std::vector<std::pair<uint64_t, NewOrderRequest> >&);
+	// 删除订单(删除成功返回true), 订单需已从挂单簿与计时器摘除
 	bool deleteOrder(const uint64_t&);
-	// 修改订单价格，将市价单的价格更新为市场价
-	void updateToMarketPrice(const uint64_t&, const double& marketPrice);
+	// 在写锁内找到订单后调用unlink将其从挂单簿与计时器摘除, 成功则复制订单信息并删除订单
+	// unlink可获取挂单簿的锁, 但不能再访问订单系统
+	bool removeOrder(const uint64_t&, NewOrderRequest&, const std::function<bool(Order<LockPolicy>&)>&);
+	// 改单: 在写锁内做对敲检查后调用amend修改挂单, 成功后按新价格更新用户索引并复制订单信息
+	// 数量或价格为0表示不变; amend的参数为订单与改后的剩余数量和价格, 失败时填写错误信息
+	bool amendOrder(const uint64_t&, const uint32_t&, const double&, NewOrderRequest&, std::string&,
+		const std::function<bool(Order<LockPolicy>&, const uint32_t&, const double&, std::string&)>&);
+	// 批量删除用户的订单: 在写锁内对该用户的每个订单调用unlink, 成功摘除的订单复制信息后删除
+	size_t removeClientOrders(const uint64_t&, const std::function<bool(Order<LockPolicy>&)>&, std::vector<std::pair<uint64_t, NewOrderRequest> >&);
+	// 批量删除: 在写锁内由select摘除订单并放入给定的数组, 之后复制信息并删除
+	size_t removeOrders(const std::function<void(std::vector<Order<LockPolicy>*>&)>&, std::vector<std::pair<uint64_t, NewOrderRequest> >&);
+	// 新建报价订单: 参数为订单ID, 订单信息与所属一侧的挂单簿
+	typedef std::function<Order<LockPolicy>*(const uint64_t&, const NewOrderRequest&, BookSide<LockPolicy>*)> CreateQuote;
+	// 批量替换用户的双边报价: 一次写锁内对每只股票调用quote, 参数为股票的序号, 该用户在该股票上现有的买卖报价订单(没有为nullptr)与新建函数
+	// quote在挂单簿上修改, 新建或摘除报价订单并改写两个指针; 返回后按订单的新价格更新用户索引, 被替换的订单从订单系统删除
+	void replaceQuotes(const uint64_t&, const std::vector<std::string>&,
+		const std::function<void(const size_t&, Order<LockPolicy>*&, Order<LockPolicy>*&, const CreateQuote&)>&);
+	// 将订单登记为用户在该股票上的报价(从快照恢复)
+	void restoreQuote(const uint64_t&);
+	// 止损单触发后计入用户索引的对敲检查; 订单需已从止损簿取出, 由调用方负责
+	void activateOrder(Order<LockPolicy>&);
     /***************************************************************************************
                                 		订单容器操作相关
 	****************************************************************************************/
+	// 查找订单, 不存在返回nullptr; 返回的订单在挂单簿上或由调用方负责删除时才保持有效
+	Order<LockPolicy>* findOrder(const uint64_t&);
+	// 在读锁内对订单调用visit, 订单不存在返回false
+	bool visitOrder(const uint64_t&, const std::function<void(Order<LockPolicy>&)>&);
 	// 查询订单信息
 	bool getOrderInfo(const uint64_t&, NewOrderRequest&);
-	// 获取所有订单
-	void getAllOrders(std::vector<OrderReport>&);
-	// 订单交易
-	void tradingOrders(const uint64_t&, const uint64_t&, const bool&, std::vector<std::pair<uint64_t, ExecutionReport> >&);
+	// 查询订单的用户, 剩余数量与价格(不复制订单信息)
+	bool getOrderState(const uint64_t&, OrderState&);
+	// 按订单ID顺序查询一页订单: 指定clientID或stockID时遍历该用户或该股票的索引(都指定时取较小的一个), 都未指定时归并全部股票的索引
+	// 在读锁内从订单ID大于cursor处开始对每个订单调用select, 选中的复制到reports, 选满limit个或检查了maxScan个订单即停止
+	// 返回最后检查的订单ID作为下一页的游标, 已没有更多订单时返回0; select可获取挂单簿的锁, 但不能再访问订单系统
+	uint64_t queryOrders(const uint64_t&, const std::string&, const uint64_t&, const size_t&, const size_t&,
+		const std::function<bool(Order<LockPolicy>&)>&, std::vector<OrderReport>&);
+	// 订单交易, 调用方保证两订单有效; direction为true时卖方主动, 按被动方的价格成交
+	// aggressorReport为false时不生成主动方的回报, 由调用方按档位合并; fillPrice不为0时按该价格成交(集合竞价)
+	void tradingOrders(Order<LockPolicy>*, Order<LockPolicy>*, const bool&, std::vector<std::pair<uint64_t, ExecutionReport> >&,
+		const bool& aggressorReport=true, const double& fillPrice=0);
     // 模拟撮合.订单数量为0返回false
 	bool simulationMatch(const uint64_t&, ExecutionReport&);
 	/***************************************************************************************
@@ -82,22 +239,38 @@ public:
     /***************************************************************************************
                                 		构造函数
 	****************************************************************************************/
-    OrderSystem();
+    BasicOrderSystem();
 private:
+	typedef typename LockPolicy::Mutex Mutex;
+	typedef typename LockPolicy::SharedMutex SharedMutex;
+	typedef typename LockPolicy::Instrument Instrument;
 	/***************************************************************************************
                                 		订单容器
 	****************************************************************************************/
 	// 存放订单的容器<orderID, Order>, 插入与删除需要互斥
-	std::unordered_map<uint64_t, Order> orders; 
+	std::unordered_map<uint64_t, Order<LockPolicy> > orders; 
+	// 从用户索引与订单容器中删除(需持有写锁)
+	void eraseOrder(typename std::unordered_map<uint64_t, Order<LockPolicy> >::iterator);
+	// 加入用户与股票的订单ID索引(需持有写锁)
+	void linkOrder(OrderIndex<LockPolicy>&, Order<LockPolicy>&);
+	// 插入订单并更新用户索引(需持有写锁)
+	Order<LockPolicy>& emplaceOrder(OrderIndex<LockPolicy>&, const uint64_t&, const NewOrderRequest&, BookSide<LockPolicy>*);
+	// 订单价格变化后把用户索引中的计数移到新价格(需持有写锁)
+	void moveClientPrice(OrderIndex<LockPolicy>&, Order<LockPolicy>&);
 	/***************************************************************************************
                                 		用户索引
 	****************************************************************************************/
 	// 用户id下的所有订单
-	std::unordered_map<uint64_t, OrderIndex> client_index;
+	std::unordered_map<uint64_t, OrderIndex<LockPolicy> > client_index;
+	// 股票的所有订单(含等待触发的止损单), 与挂单簿不同, 按订单ID排列, 由订单系统的读写锁保护
+	std::unordered_map<std::string, OrderIDIndex<LockPolicy> > symbol_index;
     /***************************************************************************************
                                 		读写锁
 	****************************************************************************************/
     // 访问容器的读写锁
-    std::shared_mutex rw_lock;
+    SharedMutex rw_lock{"OrderSystem::rw_lock"};
 };
+
+// 多线程订单系统
+typedef BasicOrderSystem<ConcurrentLockPolicy> OrderSystem;
 #endif
\ No newline at end of file
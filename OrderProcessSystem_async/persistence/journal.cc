@@ -0,0 +1,208 @@
+#ifndef JOURNAL_CC
+#define JOURNAL_CC
+#include "journal.h"
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// 根据新订单请求生成日志记录
+JournalRecord makeJournalRecord(const uint8_t& type, const uint64_t& orderID, const NewOrderRequest& request){
+    JournalRecord record=makeJournalRecord(type, orderID);
+    record.clientID=request.clientid();
+    record.price=request.price();
+    record.stopPrice=request.stopprice();
+    record.orderQty=request.orderqty();
+    record.direction=static_cast<uint8_t>(request.direction());
+    record.orderType=static_cast<uint8_t>(request.ordertype());
+    record.timeInForce=static_cast<uint8_t>(request.timeinforce());
+    copyFixedString(record.stockID, sizeof(record.stockID), request.stockid());
+    copyFixedString(record.time, sizeof(record.time), request.time());
+    return record;
+}
+
+// 根据订单ID生成日志记录
+JournalRecord makeJournalRecord(const uint8_t& type, const uint64_t& orderID){
+    JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type=type;
+    record.orderID=orderID;
+    return record;
+}
+
+// 根据批量撤单请求生成日志记录
+JournalRecord makeJournalRecord(const MassCancelRequest& request){
+    JournalRecord record=makeJournalRecord(EVENT_MASS_CANCEL, 0);
+    record.clientID=request.clientid();
+    record.direction=static_cast<uint8_t>(request.side());
+    copyFixedString(record.stockID, sizeof(record.stockID), request.stockid());
+    copyFixedString(record.time, sizeof(record.time), request.time());
+    return record;
+}
+
+// 根据集合竞价请求生成日志记录
+JournalRecord makeJournalRecord(const AuctionRequest& request){
+    JournalRecord record=makeJournalRecord(EVENT_AUCTION, 0);
+    record.orderType=static_cast<uint8_t>(request.action());
+    copyFixedString(record.stockID, sizeof(record.stockID), request.stockid());
+    copyFixedString(record.time, sizeof(record.time), request.time());
+    return record;
+}
+
+// 从日志记录还原新订单请求
+void journalRecordToRequest(const JournalRecord& record, NewOrderRequest& request){
+    request.set_clientid(record.clientID);
+    request.set_direction(record.direction==NewOrderRequest::SELL?NewOrderRequest::SELL:NewOrderRequest::BUY);
+    request.set_stockid(readFixedString(record.stockID, sizeof(record.stockID)));
+    request.set_orderqty(record.orderQty);
+    request.set_price(record.price);
+    request.set_stopprice(record.stopPrice);
+    request.set_ordertype(record.orderType==NewOrderRequest::LIMIT?NewOrderRequest::LIMIT:NewOrderRequest::MARKET);
+    request.set_timeinforce(NewOrderRequest::TimeInForce_IsValid(record.timeInForce)?
+        static_cast<NewOrderRequest::TimeInForce>(record.timeInForce):NewOrderRequest::DAY);
+    request.set_time(readFixedString(record.time, sizeof(record.time)));
+}
+
+// 从日志记录还原批量撤单请求
+void journalRecordToRequest(const JournalRecord& record, MassCancelRequest& request){
+    request.set_clientid(record.clientID);
+    request.set_side(MassCancelRequest::Side_IsValid(record.direction)?static_cast<MassCancelRequest::Side>(record.direction):MassCancelRequest::BOTH);
+    request.set_stockid(readFixedString(record.stockID, sizeof(record.stockID)));
+    request.set_time(readFixedString(record.time, sizeof(record.time)));
+}
+
+// 从日志记录还原集合竞价请求
+void journalRecordToRequest(const JournalRecord& record, AuctionRequest& request){
+    request.set_action(record.orderType==AuctionRequest::UNCROSS?AuctionRequest::UNCROSS:AuctionRequest::CALL);
+    request.set_stockid(readFixedString(record.stockID, sizeof(record.stockID)));
+    request.set_time(readFixedString(record.time, sizeof(record.time)));
+}
+
+// 校验文件头; 版本不同的日志记录格式或事件类型不同, 既不回放也不追加写入
+static bool checkHeader(const JournalHeader& header, const std::string& fileName){
+    if(header.magic!=JOURNAL_MAGIC) return false;
+    if(header.version!=JOURNAL_VERSION){
+        LOG_ERROR("Journal version {} is not supported (expected {}): {}", header.version, JOURNAL_VERSION, fileName);
+        return false;
+    }
+    return header.recordSize==sizeof(JournalRecord);
+}
+
+// 构造函数
+template<typename LockPolicy>
+BasicJournal<LockPolicy>::BasicJournal():fd(-1), seq(0), required(false){}
+
+template<typename LockPolicy>
+BasicJournal<LockPolicy>::~BasicJournal(){
+    if(fd>=0) close(fd);
+}
+
+// 打开日志文件
+template<typename LockPolicy>
+bool BasicJournal<LockPolicy>::open(const std::string& fileName, const uint64_t& baseSeq){
+    std::unique_lock<Mutex> w(journalMutex);
+    required=true;
+    if(fd>=0) close(fd);
+    fd=::open(fileName.c_str(), O_RDWR|O_CREAT|O_APPEND, 0644);
+    if(fd<0) return false;
+    struct stat st;
+    fstat(fd, &st);
+    JournalHeader header;
+    if(st.st_size<static_cast<off_t>(sizeof(header))){
+        // 新文件, 写入文件头
+        header.magic=JOURNAL_MAGIC;
+        header.version=JOURNAL_VERSION;
+        header.recordSize=sizeof(JournalRecord);
+        header.baseSeq=baseSeq;
+        if(ftruncate(fd, 0)!=0||write(fd, &header, sizeof(header))!=sizeof(header)){
+            close(fd);
+            fd=-1;
+            return false;
+        }
+        seq=baseSeq;
+        return true;
+    }
+    if(pread(fd, &header, sizeof(header), 0)!=sizeof(header)||!checkHeader(header, fileName)){
+        close(fd);
+        fd=-1;
+        return false;
+    }
+    // 丢弃崩溃时写了一半的记录
+    uint64_t count=(st.st_size-sizeof(header))/sizeof(JournalRecord);
+    if(ftruncate(fd, sizeof(header)+count*sizeof(JournalRecord))!=0){
+        close(fd);
+        fd=-1;
+        return false;
+    }
+    seq=header.baseSeq+count;
+    return true;
+}
+
+template<typename LockPolicy>
+bool BasicJournal<LockPolicy>::isOpen(){
+    std::unique_lock<Mutex> w(journalMutex);
+    return fd>=0;
+}
+
+// 写入一条记录
+template<typename LockPolicy>
+bool BasicJournal<LockPolicy>::append(JournalRecord& record){
+    std::unique_lock<Mutex> w(journalMutex);
+    record.seq=seq;
+    if(fd<0){
+        // 压测与回放不打开日志; 打开失败后仍有事件写入则逐条报错, 不静默丢弃
+        if(required) LOG_ERROR("Journal is not open, record dropped: seq {}", seq);
+        return !required;
+    }
+    ssize_t n=write(fd, &record, sizeof(record));
+    if(n!=sizeof(record)){
+        LOG_ERROR("Journal write failed: seq {}, errno {}", seq, errno);
+        // 截掉写了一半的记录, 保持定长记录对齐; 序号不前进, 日志中不留空洞
+        struct stat st;
+        if(n>0&&(fstat(fd, &st)!=0||ftruncate(fd, st.st_size-n)!=0)){
+            LOG_ERROR("Journal truncate failed: seq {}, errno {}", seq, errno);
+        }
+        return false;
+    }
+    seq++;
+    return true;
+}
+
+template<typename LockPolicy>
+uint64_t BasicJournal<LockPolicy>::nextSeq(){
+    std::unique_lock<Mutex> w(journalMutex);
+    return seq;
+}
+
+// 读取序号不小于fromSeq的所有记录
+template<typename LockPolicy>
+bool BasicJournal<LockPolicy>::readFrom(const std::string& fileName, const uint64_t& fromSeq, std::vector<JournalRecord>& records){
+    int fd_=::open(fileName.c_str(), O_RDONLY);
+    if(fd_<0) return false;
+    JournalHeader header;
+    if(pread(fd_, &header, sizeof(header), 0)!=sizeof(header)||!checkHeader(header, fileName)){
+        close(fd_);
+        return false;
+    }
+    struct stat st;
+    fstat(fd_, &st);
+    uint64_t count=(st.st_size-sizeof(header))/sizeof(JournalRecord);
+    // 定长记录, 直接跳到需要回放的位置
+    uint64_t skip=fromSeq>header.baseSeq?std::min(fromSeq-header.baseSeq, count):0;
+    records.resize(count-skip);
+    size_t bytes=records.size()*sizeof(JournalRecord);
+    size_t done=0;
+    while(done<bytes){
+        ssize_t n=pread(fd_, reinterpret_cast<char*>(records.data())+done, bytes-done, sizeof(header)+skip*sizeof(JournalRecord)+done);
+        if(n<=0) break;
+        done+=n;
+    }
+    close(fd_);
+    records.resize(done/sizeof(JournalRecord));
+    return true;
+}
+
+template class BasicJournal<ConcurrentLockPolicy>;
+template class BasicJournal<SingleThreadLockPolicy>;
+#endif
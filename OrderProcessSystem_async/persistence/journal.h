@@ -0,0 +1,93 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include "../helper/helper.h"
+#include "../helper/lock_policy.h"
+
+#define JOURNAL_MAGIC 0x4c4e524a5350304fULL
+#define JOURNAL_VERSION 2
+
+// 日志事件类型
+enum JournalEventType : uint8_t{
+    EVENT_NEW_ORDER=1,        // 新订单进入撮合
+    EVENT_CANCEL_ORDER=2,     // 撤单
+    EVENT_SIMULATION_MATCH=3, // 计时器触发的模拟撮合
+    EVENT_MASS_CANCEL=4,      // 批量撤单, 记录筛选条件
+    EVENT_AMEND_ORDER=5,      // 改单, 记录改后的剩余数量与价格
+    EVENT_AUCTION=6,          // 集合竞价, 记录股票与竞价动作
+    EVENT_QUOTE=7             // 报价的一侧, 记录替换后的报价订单, 数量为0表示撤销该侧报价
+};
+
+// 日志文件头
+struct JournalHeader{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    // 文件中第一条记录的序号
+    uint64_t baseSeq;
+};
+
+// 定长日志记录, 可直接按偏移定位
+struct JournalRecord{
+    uint64_t seq;       // 日志序号
+    uint64_t orderID;   // 订单ID
+    uint64_t clientID;  // 客户ID
+    double price;       // 报单价格
+    double stopPrice;   // 止损价, 0表示普通订单
+    uint32_t orderQty;  // 订单数量
+    uint8_t type;       // 事件类型
+    uint8_t direction;  // 买卖方向(批量撤单时为撤单的一侧)
+    uint8_t orderType;  // 订单类型(集合竞价时为竞价动作)
+    uint8_t timeInForce; // 有效期类型
+    char stockID[16];   // 股票ID
+    char time[32];      // 报单时间
+};
+
+// 根据新订单请求生成日志记录
+JournalRecord makeJournalRecord(const uint8_t&, const uint64_t&, const NewOrderRequest&);
+// 根据订单ID生成日志记录(撤单与模拟撮合)
+JournalRecord makeJournalRecord(const uint8_t&, const uint64_t&);
+// 根据批量撤单请求生成日志记录
+JournalRecord makeJournalRecord(const MassCancelRequest&);
+// 根据集合竞价请求生成日志记录
+JournalRecord makeJournalRecord(const AuctionRequest&);
+// 从日志记录还原新订单请求
+void journalRecordToRequest(const JournalRecord&, NewOrderRequest&);
+// 从日志记录还原批量撤单请求
+void journalRecordToRequest(const JournalRecord&, MassCancelRequest&);
+// 从日志记录还原集合竞价请求
+void journalRecordToRequest(const JournalRecord&, AuctionRequest&);
+
+// 追加写入的事件日志; 写日志互斥锁随锁策略, 单线程引擎写日志不加锁
+template<typename LockPolicy>
+class BasicJournal{
+public:
+    BasicJournal();
+    ~BasicJournal();
+    // 打开日志文件, 不存在则以baseSeq创建
+    bool open(const std::string&, const uint64_t& baseSeq=0);
+    // 是否已打开
+    bool isOpen();
+    // 写入一条记录并分配序号; 未打开过日志时不写入, 打开失败或写入失败返回false
+    bool append(JournalRecord&);
+    // 下一条记录的序号
+    uint64_t nextSeq();
+    // 读取序号不小于fromSeq的所有记录, 按序号直接定位
+    static bool readFrom(const std::string&, const uint64_t&, std::vector<JournalRecord>&);
+private:
+    typedef typename LockPolicy::Mutex Mutex;
+    int fd;
+    uint64_t seq;
+    // 调用过open后为true, 此后写不进日志的记录都要报错
+    bool required;
+    // 写日志互斥锁
+    Mutex journalMutex{"Journal::journalMutex"};
+};
+
+// 多线程引擎使用的日志
+typedef BasicJournal<ConcurrentLockPolicy> Journal;
+#endif
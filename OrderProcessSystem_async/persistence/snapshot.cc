@@ -0,0 +1,122 @@
+#ifndef SNAPSHOT_CC
+#define SNAPSHOT_CC
+#include "snapshot.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// 根据订单信息生成快照记录
+SnapshotOrder makeSnapshotOrder(const uint64_t& orderID, const NewOrderRequest& request, const uint64_t& timerTimestamp){
+    SnapshotOrder record;
+    memset(&record, 0, sizeof(record));
+    record.orderID=orderID;
+    record.clientID=request.clientid();
+    record.price=request.price();
+    record.stopPrice=request.stopprice();
+    record.timerTimestamp=timerTimestamp;
+    record.orderQty=request.orderqty();
+    record.direction=static_cast<uint8_t>(request.direction());
+    record.orderType=static_cast<uint8_t>(request.ordertype());
+    record.timeInForce=static_cast<uint8_t>(request.timeinforce());
+    copyFixedString(record.stockID, sizeof(record.stockID), request.stockid());
+    copyFixedString(record.time, sizeof(record.time), request.time());
+    return record;
+}
+
+// 从快照记录还原订单信息
+void snapshotOrderToRequest(const SnapshotOrder& record, NewOrderRequest& request){
+    request.set_clientid(record.clientID);
+    request.set_direction(record.direction==NewOrderRequest::SELL?NewOrderRequest::SELL:NewOrderRequest::BUY);
+    request.set_stockid(readFixedString(record.stockID, sizeof(record.stockID)));
+    request.set_orderqty(record.orderQty);
+    request.set_price(record.price);
+    request.set_stopprice(record.stopPrice);
+    request.set_ordertype(record.orderType==NewOrderRequest::LIMIT?NewOrderRequest::LIMIT:NewOrderRequest::MARKET);
+    request.set_timeinforce(NewOrderRequest::TimeInForce_IsValid(record.timeInForce)?
+        static_cast<NewOrderRequest::TimeInForce>(record.timeInForce):NewOrderRequest::DAY);
+    request.set_time(readFixedString(record.time, sizeof(record.time)));
+}
+
+// 写完整个缓冲区
+static bool writeFully(const int& fd, const char* buf, const size_t& bytes){
+    size_t done=0;
+    while(done<bytes){
+        ssize_t n=write(fd, buf+done, bytes-done);
+        if(n<=0) return false;
+        done+=n;
+    }
+    return true;
+}
+
+// 写入快照
+bool writeSnapshot(const std::string& fileName, SnapshotHeader& header, const std::vector<SnapshotOrder>& orders,
+        const std::vector<SnapshotSymbol>& symbols){
+    header.magic=SNAPSHOT_MAGIC;
+    header.version=SNAPSHOT_VERSION;
+    header.recordSize=sizeof(SnapshotOrder);
+    header.orderCount=orders.size();
+    header.symbolCount=symbols.size();
+    std::string tmpName=fileName+".tmp";
+    int fd=::open(tmpName.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(fd<0) return false;
+    bool ok=write(fd, &header, sizeof(header))==sizeof(header);
+    // 挂单记录与股票状态各一次性写入
+    ok=ok&&writeFully(fd, reinterpret_cast<const char*>(orders.data()), orders.size()*sizeof(SnapshotOrder));
+    ok=ok&&writeFully(fd, reinterpret_cast<const char*>(symbols.data()), symbols.size()*sizeof(SnapshotSymbol));
+    // 落盘后再替换旧快照
+    ok=ok&&fsync(fd)==0;
+    close(fd);
+    if(!ok||rename(tmpName.c_str(), fileName.c_str())!=0){
+        unlink(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 构造函数
+SnapshotFile::SnapshotFile():data(MAP_FAILED), size(0){}
+
+SnapshotFile::~SnapshotFile(){
+    if(data!=MAP_FAILED) munmap(data, size);
+}
+
+// 映射快照文件
+bool SnapshotFile::open(const std::string& fileName){
+    int fd=::open(fileName.c_str(), O_RDONLY);
+    if(fd<0) return false;
+    struct stat st;
+    if(fstat(fd, &st)!=0||st.st_size<static_cast<off_t>(sizeof(SnapshotHeader))){
+        close(fd);
+        return false;
+    }
+    size=st.st_size;
+    data=mmap(nullptr, size, PROT_READ, MAP_PRIVATE|MAP_POPULATE, fd, 0);
+    close(fd);
+    if(data==MAP_FAILED) return false;
+    // 校验文件头与长度; 版本不同的快照不载入
+    const SnapshotHeader& h=header();
+    if(h.magic==SNAPSHOT_MAGIC&&h.version!=SNAPSHOT_VERSION){
+        LOG_ERROR("Snapshot version {} is not supported (expected {}): {}", h.version, SNAPSHOT_VERSION, fileName);
+    }
+    if(h.magic!=SNAPSHOT_MAGIC||h.version!=SNAPSHOT_VERSION||h.recordSize!=sizeof(SnapshotOrder)
+            ||size<sizeof(SnapshotHeader)+h.orderCount*sizeof(SnapshotOrder)+h.symbolCount*sizeof(SnapshotSymbol)){
+        munmap(data, size);
+        data=MAP_FAILED;
+        return false;
+    }
+    return true;
+}
+
+const SnapshotHeader& SnapshotFile::header() const{
+    return *static_cast<const SnapshotHeader*>(data);
+}
+
+const SnapshotOrder* SnapshotFile::orders() const{
+    return reinterpret_cast<const SnapshotOrder*>(static_cast<const char*>(data)+sizeof(SnapshotHeader));
+}
+
+const SnapshotSymbol* SnapshotFile::symbols() const{
+    return reinterpret_cast<const SnapshotSymbol*>(orders()+header().orderCount);
+}
+#endif
@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "../helper/helper.h"
+
+#define SNAPSHOT_MAGIC 0x50414e53535053ULL
+#define SNAPSHOT_VERSION 3
+
+// 快照文件头
+struct SnapshotHeader{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    // 已分配的最大订单ID
+    uint64_t orderIDCounter;
+    // 快照对应的日志序号, 回放从该序号开始
+    uint64_t journalSeq;
+    // 挂单数量
+    uint64_t orderCount;
+    // 股票状态数量, 紧随挂单记录存放
+    uint64_t symbolCount;
+    // 快照生成时间戳
+    uint64_t createTimestamp;
+};
+
+// 定长挂单记录, 紧随文件头连续存放
+struct SnapshotOrder{
+    uint64_t orderID;          // 订单ID
+    uint64_t clientID;         // 客户ID
+    double price;              // 报单价格
+    double stopPrice;          // 等待触发的止损单的止损价, 挂单为0
+    uint64_t timerTimestamp;   // 计时任务时间戳, 0表示未计时
+    uint32_t orderQty;         // 剩余数量
+    uint8_t direction;         // 买卖方向
+    uint8_t orderType;         // 订单类型
+    uint8_t timeInForce;       // 有效期类型(止损单触发后使用)
+    uint8_t quote;             // 是否为做市报价订单
+    char stockID[16];          // 股票ID
+    char time[32];             // 报单时间
+};
+
+// 定长股票状态记录: 集合竞价状态与最新成交价
+struct SnapshotSymbol{
+    char stockID[16];          // 股票ID
+    double lastPrice;          // 最新成交价
+    uint8_t auction;           // 是否处于集合竞价
+    uint8_t reserved[7];
+};
+
+// 根据订单信息生成快照记录
+SnapshotOrder makeSnapshotOrder(const uint64_t&, const NewOrderRequest&, const uint64_t&);
+// 从快照记录还原订单信息
+void snapshotOrderToRequest(const SnapshotOrder&, NewOrderRequest&);
+
+// 写入快照: 先写临时文件再原子重命名
+bool writeSnapshot(const std::string&, SnapshotHeader&, const std::vector<SnapshotOrder>&, const std::vector<SnapshotSymbol>&);
+
+// 以内存映射方式只读打开的快照
+class SnapshotFile{
+public:
+    SnapshotFile();
+    ~SnapshotFile();
+    // 映射快照文件
+    bool open(const std::string&);
+    // 文件头
+    const SnapshotHeader& header() const;
+    // 挂单记录数组
+    const SnapshotOrder* orders() const;
+    // 股票状态数组
+    const SnapshotSymbol* symbols() const;
+private:
+    void* data;
+    size_t size;
+};
+#endif
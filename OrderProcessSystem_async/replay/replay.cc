@@ -0,0 +1,193 @@
+#ifndef REPLAY_CC
+#define REPLAY_CC
+#include "replay.h"
+
+FillChecksum::FillChecksum():hash(1469598103934665603ULL), fillCount(0){}
+
+void FillChecksum::mix(const void* data, const size_t& size){
+    const unsigned char* p=static_cast<const unsigned char*>(data);
+    for(size_t i=0;i<size;i++){
+        hash^=p[i];
+        hash*=1099511628211ULL;
+    }
+}
+
+// 累加一条成交回报, 时间字段不参与计算
+void FillChecksum::add(const ExecutionReport& report){
+    if(report.stat()!=ExecutionReport::FILL) return;
+    uint64_t orderID=report.orderid();
+    uint64_t clientID=report.clientid();
+    uint32_t fillQty=report.fillqty();
+    uint32_t leaveQty=report.leaveqty();
+    double fillPrice=report.fillprice();
+    mix(&orderID, sizeof(orderID));
+    mix(&clientID, sizeof(clientID));
+    mix(&fillQty, sizeof(fillQty));
+    mix(&leaveQty, sizeof(leaveQty));
+    mix(&fillPrice, sizeof(fillPrice));
+    mix(report.stockid().data(), report.stockid().size());
+    ++fillCount;
+}
+
+uint64_t FillChecksum::value() const{
+    return hash;
+}
+
+uint64_t FillChecksum::fills() const{
+    return fillCount;
+}
+
+// 判断文件是否为服务端日志
+bool isJournalFile(const std::string& fileName){
+    std::ifstream fin(fileName, std::ios::binary);
+    JournalHeader header;
+    if(!fin.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    return header.magic==JOURNAL_MAGIC;
+}
+
+// 回放服务端日志
+template<typename Market>
+bool replayJournal(Market& market, const std::string& fileName, FillChecksum& checksum, ReplayStats& stats){
+    std::vector<JournalRecord> records;
+    if(!Journal::readFrom(fileName, 0, records)){
+        return false;
+    }
+    stats.latencies.reserve(records.size());
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    std::vector<ExecutionReport> matchReports;
+    for(const auto& record:records){
+        auto start=std::chrono::steady_clock::now();
+        market.replayRecord(record, reports);
+        auto end=std::chrono::steady_clock::now();
+        stats.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count());
+        for(const auto& [orderID, report]:reports){
+            checksum.add(report);
+        }
+        reports.clear();
+        if(record.type==EVENT_NEW_ORDER){
+            ++stats.newOrders;
+        }else if(record.type==EVENT_CANCEL_ORDER||record.type==EVENT_MASS_CANCEL){
+            ++stats.cancels;
+        }else if(record.type==EVENT_AMEND_ORDER){
+            ++stats.amends;
+        }else if(record.type==EVENT_AUCTION){
+            ++stats.auctions;
+        }else if(record.type==EVENT_QUOTE){
+            ++stats.quotes;
+        }else if(record.type==EVENT_SIMULATION_MATCH){
+            ++stats.matches;
+            // 模拟撮合的回报存放在市场系统中
+            market.getMathchReports(matchReports);
+            for(const auto& report:matchReports){
+                checksum.add(report);
+            }
+            matchReports.clear();
+        }
+    }
+    return true;
+}
+
+// 回放报单文件
+template<typename Market>
+bool replayOrderFile(Market& market, const std::string& fileName, FillChecksum& checksum, ReplayStats& stats){
+    // 先解析全部请求, 避免解析计入撮合耗时
+    std::vector<OrderFileRecord> records;
+    if(!loadOrderRecords(fileName, records)){
+        return false;
+    }
+    std::string time=getTime();
+    std::vector<NewOrderRequest> requests(records.size());
+    for(size_t i=0;i<records.size();i++){
+        if(records[i].kind!=RECORD_NEW_ORDER) continue;
+        orderRecordToRequest(records[i], requests[i]);
+        requests[i].set_time(time);
+    }
+    // 文件序号到订单ID, 用于解析撤单记录
+    std::vector<uint64_t> orderIDs(records.size(), 0);
+    stats.latencies.reserve(records.size());
+    std::vector<std::pair<uint64_t, ExecutionReport> > reports;
+    for(size_t i=0;i<records.size();i++){
+        const OrderFileRecord& record=records[i];
+        if(record.kind==RECORD_CANCEL_ORDER){
+            if(record.target>=i||orderIDs[record.target]==0){
+                ++stats.rejects;
+                continue;
+            }
+            CancelOrderRequest request=MakeCancelOrderRequest(orderIDs[record.target]);
+            ExecutionReport report;
+            initReport(report, request);
+            auto start=std::chrono::steady_clock::now();
+            market.processCancelOrder(request, report);
+            auto end=std::chrono::steady_clock::now();
+            stats.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count());
+            ++stats.cancels;
+            checksum.add(report);
+            continue;
+        }
+        auto start=std::chrono::steady_clock::now();
+        uint64_t orderID=market.processCreateOrder(requests[i], reports);
+        if(orderID>0){
+            market.processNewOrder(requests[i], orderID, reports);
+        }
+        auto end=std::chrono::steady_clock::now();
+        stats.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count());
+        orderIDs[i]=orderID;
+        if(orderID>0) ++stats.newOrders;
+        else ++stats.rejects;
+        for(const auto& [orderID, report]:reports){
+            checksum.add(report);
+        }
+        reports.clear();
+    }
+    return true;
+}
+
+// 计算分位数(纳秒)
+static uint64_t percentile(const std::vector<uint64_t>& sorted, const double& p){
+    if(sorted.empty()) return 0;
+    size_t index=static_cast<size_t>(p*(sorted.size()-1));
+    return sorted[index];
+}
+
+// 回放整个文件
+template<typename Market>
+bool replayFile(const std::string& fileName, FillChecksum& checksum, ReplayStats& stats){
+    // 不启动计时器线程, 只回放记录中的事件, 保证结果确定
+    Market market(false);
+    return isJournalFile(fileName)?replayJournal(market, fileName, checksum, stats)
+        :replayOrderFile(market, fileName, checksum, stats);
+}
+
+int main(int argc, char* argv[]){
+    if(argc<2){
+        std::cout<<"usage: ./Replay <journal file | orders file> [locked]"<<std::endl;
+        return 1;
+    }
+    std::string fileName=argv[1];
+    // 默认使用单线程引擎, locked时使用服务端的多线程引擎以便比较
+    bool locked=argc>2&&std::string(argv[2])=="locked";
+    FillChecksum checksum;
+    ReplayStats stats;
+    auto start=std::chrono::steady_clock::now();
+    bool ok=locked?replayFile<MarketSystem>(fileName, checksum, stats)
+        :replayFile<SingleThreadMarketSystem>(fileName, checksum, stats);
+    auto end=std::chrono::steady_clock::now();
+    if(!ok){
+        std::cout<<"Can not read: "<<fileName<<std::endl;
+        return 1;
+    }
+    double seconds=std::chrono::duration<double>(end-start).count();
+    std::vector<uint64_t> sorted=stats.latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto us=[&](const double& p){return percentile(sorted, p)/1000.0;};
+    std::cout<<std::fixed<<std::setprecision(3);
+    std::cout<<"Replay: "<<fileName<<", "<<(locked?"concurrent":"single-threaded")<<" engine"<<std::endl;
+    std::cout<<"	events: "<<sorted.size()<<" (new "<<stats.newOrders<<", cancel "<<stats.cancels
+        <<", amend "<<stats.amends<<", auction "<<stats.auctions<<", quote "<<stats.quotes<<", match "<<stats.matches<<", reject "<<stats.rejects<<")"<<std::endl;
+    std::cout<<"	elapsed: "<<seconds*1000<<" ms, throughput: "<<(seconds>0?sorted.size()/seconds:0)<<" events/s"<<std::endl;
+    std::cout<<"	latency(us): p50 "<<us(0.5)<<", p90 "<<us(0.9)<<", p99 "<<us(0.99)
+        <<", p99.9 "<<us(0.999)<<", max "<<us(1.0)<<std::endl;
+    std::cout<<"	fills: "<<checksum.fills()<<", checksum: "<<std::hex<<checksum.value()<<std::dec<<std::endl;
+    return 0;
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "../helper/helper.h"
+#include "../market/market_system.h"
+#include "../persistence/journal.h"
+
+// 成交回报校验和(FNV-1a), 用于比较两次回放的撮合结果是否一致
+class FillChecksum{
+public:
+    FillChecksum();
+    // 累加一条成交回报
+    void add(const ExecutionReport&);
+    uint64_t value() const;
+    uint64_t fills() const;
+private:
+    void mix(const void*, const size_t&);
+    uint64_t hash;
+    uint64_t fillCount;
+};
+
+// 回放统计
+struct ReplayStats{
+    uint64_t newOrders=0;
+    uint64_t cancels=0;
+    uint64_t amends=0;
+    uint64_t auctions=0;
+    uint64_t quotes=0;
+    uint64_t matches=0;
+    uint64_t rejects=0;
+    // 每个事件的处理耗时(纳秒)
+    std::vector<uint64_t> latencies;
+};
+
+// 判断文件是否为服务端日志
+bool isJournalFile(const std::string&);
+// 回放服务端日志, Market为MarketSystem或SingleThreadMarketSystem
+template<typename Market>
+bool replayJournal(Market&, const std::string&, FillChecksum&, ReplayStats&);
+// 回放报单文件(生成器的文本或二进制格式)
+template<typename Market>
+bool replayOrderFile(Market&, const std::string&, FillChecksum&, ReplayStats&);
+#endif
@@ -1,35 +1,200 @@
 #ifndef GENERATE_REQUESTS_CC
 #define GENERATE_REQUESTS_CC
 #include "generate_requests.h"
-int main(){
-    srand((unsigned)time(NULL));
-    uint64_t clientID, requestNum;
-    std::string fileName;
-    std::cout<<"请输入用户ID以及输出文本文件名!"<<std::endl;
-    std::cin>>clientID>>fileName;
-    std::cout<<"请输入生成的条数"<<std::endl;
-    std::cin>>requestNum;
-    std::ofstream out(fileName);
-    if(out.is_open()){
-        out<<requestNum<<std::endl;
-        for(int i=0;i<requestNum;i++){
-            out<<"LIMIT"<<" ";
-            int type=rand();
-            if(type&1) out<<"SELL"<<" ";
-            else out<<"BUY"<<" ";
-            out<<clientID<<" ";
-            std::string stockID="600030";
-            // for(int j=0;j<6;j++){
-            //     int rand_num=rand()%10;
-            //     stockID.push_back('0'+rand_num);
-            // }
-            out<<stockID<<" ";
-            uint64_t num=rand()%10000+1;
-            out<<num<<" ";
-            double price=static_cast<double>(rand())/(static_cast<double>(RAND_MAX/100))+1;
-            out<<price<<std::endl;
+
+// 文件名是否以.bin结尾
+bool isBinaryFileName(const std::string& fileName){
+    return fileName.size()>=4&&fileName.compare(fileName.size()-4, 4, ".bin")==0;
+}
+
+// 股票的初始状态, 由种子和股票序号确定
+struct SymbolState{
+    double mid;           // 中间价
+    int spreadTicks;      // 买卖价差(最小变动单位数)
+};
+
+// 按数据块并行执行, 块号由原子计数器分配
+template<typename Func>
+static void parallelBlocks(const int& threads, const uint64_t& blocks, Func func){
+    std::atomic<uint64_t> nextBlock(0);
+    std::vector<std::thread> workers;
+    for(int t=0;t<threads;t++){
+        workers.emplace_back([&](){
+            for(uint64_t b=nextBlock++;b<blocks;b=nextBlock++) func(b);
+        });
+    }
+    for(auto& worker:workers) worker.join();
+}
+
+// 按最小变动单位取整, 先取整数再相除, 结果与文本格式解析出的价格完全一致
+static double roundToTick(const double& price){
+    return std::round(price*GENERATOR_TICKS_PER_UNIT)/GENERATOR_TICKS_PER_UNIT;
+}
+
+// 生成全部记录
+// 第一阶段按数据块并行: 确定每条记录的类型, 客户, 股票, 方向, 数量, 撤单目标以及价格的随机量
+// 第二阶段按股票并行: 沿记录顺序推进每只股票的随机游走, 计算报单价格
+void generateRecords(const GeneratorConfig& config, std::vector<OrderFileRecord>& records){
+    records.assign(config.count, OrderFileRecord());
+    memset(records.data(), 0, records.size()*sizeof(OrderFileRecord));
+    // 第二阶段需要的中间量
+    std::vector<uint32_t> symbolOf(config.count, 0);
+    std::vector<float> steps(config.count, 0);
+    std::vector<int16_t> offsets(config.count, 0);
+
+    // Zipf分布的累积概率, 序号越小越活跃
+    std::vector<double> cdf(config.symbols);
+    double total=0;
+    for(uint32_t k=0;k<config.symbols;k++){
+        total+=1.0/std::pow(k+1, config.zipfExponent);
+        cdf[k]=total;
+    }
+    for(auto& c:cdf) c/=total;
+    std::vector<std::string> stockIDs(config.symbols);
+    for(uint32_t k=0;k<config.symbols;k++){
+        stockIDs[k]=std::to_string(GENERATOR_FIRST_STOCK+k);
+    }
+
+    uint64_t blocks=(config.count+GENERATOR_BLOCK_SIZE-1)/GENERATOR_BLOCK_SIZE;
+    parallelBlocks(config.threads, blocks, [&](const uint64_t& b){
+        std::seed_seq seq{config.seed, b};
+        std::mt19937_64 rng(seq);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        std::geometric_distribution<int> lots(0.15);
+        std::geometric_distribution<int> depth(0.35);
+        uint64_t begin=b*GENERATOR_BLOCK_SIZE;
+        uint64_t end=std::min<uint64_t>(begin+GENERATOR_BLOCK_SIZE, config.count);
+        // 本块内尚未撤销的限价单
+        std::vector<uint64_t> live;
+        for(uint64_t i=begin;i<end;i++){
+            OrderFileRecord& record=records[i];
+            if(!live.empty()&&uniform(rng)<config.cancelRatio){
+                size_t pick=rng()%live.size();
+                const OrderFileRecord& target=records[live[pick]];
+                record.kind=RECORD_CANCEL_ORDER;
+                record.target=live[pick];
+                record.clientID=target.clientID;
+                memcpy(record.stockID, target.stockID, sizeof(record.stockID));
+                live[pick]=live.back();
+                live.pop_back();
+                continue;
+            }
+            uint32_t symbol=std::lower_bound(cdf.begin(), cdf.end(), uniform(rng))-cdf.begin();
+            symbol=std::min(symbol, config.symbols-1);
+            record.kind=RECORD_NEW_ORDER;
+            record.clientID=config.firstClientID+rng()%config.clients;
+            record.direction=rng()&1;
+            record.orderType=uniform(rng)<config.marketRatio?1:0;
+            record.orderQty=100*(1+std::min(lots(rng), 99));
+            strncpy(record.stockID, stockIDs[symbol].c_str(), sizeof(record.stockID)-1);
+            symbolOf[i]=symbol;
+            steps[i]=normal(rng);
+            if(record.orderType==0){
+                // 多数挂在最优价附近, 少数越过价差主动成交
+                offsets[i]=uniform(rng)<0.1?-(1+static_cast<int>(rng()%4)):std::min(depth(rng), 50);
+                live.push_back(i);
+            }
         }
+    });
+
+    // 第二阶段, 每个线程负责一部分股票, 保证每只股票的游走按记录顺序进行
+    int threads=std::max(1, std::min<int>(config.threads, config.symbols));
+    std::vector<std::thread> workers;
+    for(int t=0;t<threads;t++){
+        workers.emplace_back([&, t](){
+            std::vector<SymbolState> states(config.symbols);
+            for(uint32_t k=t;k<config.symbols;k+=threads){
+                std::seed_seq seq{config.seed, static_cast<uint64_t>(k), static_cast<uint64_t>(0x5354)};
+                std::mt19937_64 rng(seq);
+                states[k].mid=roundToTick(5.0+std::uniform_real_distribution<double>(0.0, 95.0)(rng));
+                states[k].spreadTicks=1+rng()%4;
+            }
+            for(uint64_t i=0;i<config.count;i++){
+                OrderFileRecord& record=records[i];
+                if(record.kind!=RECORD_NEW_ORDER||symbolOf[i]%threads!=static_cast<uint32_t>(t)) continue;
+                SymbolState& state=states[symbolOf[i]];
+                state.mid=std::max(1.0, state.mid*std::exp(0.0005*steps[i]));
+                double bid=roundToTick(state.mid-state.spreadTicks*GENERATOR_TICK/2);
+                double ask=bid+state.spreadTicks*GENERATOR_TICK;
+                bool sell=record.direction==0;
+                if(record.orderType==1){
+                    // 市价单带保护价
+                    record.price=roundToTick(sell?bid*0.98:ask*1.02);
+                }else{
+                    double price=sell?ask+offsets[i]*GENERATOR_TICK:bid-offsets[i]*GENERATOR_TICK;
+                    record.price=std::max(GENERATOR_TICK, roundToTick(price));
+                }
+            }
+        });
+    }
+    for(auto& worker:workers) worker.join();
+}
+
+// 写入文本或二进制文件
+bool writeRecords(const GeneratorConfig& config, const std::vector<OrderFileRecord>& records){
+    if(isBinaryFileName(config.fileName)){
+        OrderFileWriter writer;
+        if(!writer.open(config.fileName)) return false;
+        for(const auto& record:records){
+            if(!writer.append(record)) return false;
+        }
+        return writer.close();
+    }
+    // 文本格式按数据块并行格式化后顺序写出
+    uint64_t blocks=(records.size()+GENERATOR_BLOCK_SIZE-1)/GENERATOR_BLOCK_SIZE;
+    std::vector<std::string> texts(blocks);
+    parallelBlocks(config.threads, blocks, [&](const uint64_t& b){
+        std::ostringstream out;
+        out<<std::fixed<<std::setprecision(2);
+        uint64_t end=std::min<uint64_t>((b+1)*GENERATOR_BLOCK_SIZE, records.size());
+        for(uint64_t i=b*GENERATOR_BLOCK_SIZE;i<end;i++){
+            const OrderFileRecord& record=records[i];
+            if(record.kind==RECORD_CANCEL_ORDER){
+                out<<"CANCEL "<<record.clientID<<" "<<record.target<<"\n";
+                continue;
+            }
+            out<<(record.orderType==0?"LIMIT":"MARKET")<<" "<<(record.direction==0?"SELL":"BUY")<<" "
+                <<record.clientID<<" "<<record.stockID<<" "<<record.orderQty<<" "<<record.price<<"\n";
+        }
+        texts[b]=out.str();
+    });
+    std::ofstream out(config.fileName);
+    if(!out.is_open()) return false;
+    out<<records.size()<<std::endl;
+    for(const auto& text:texts) out<<text;
+    return static_cast<bool>(out);
+}
+
+// ./Generator <输出文件> <条数> [客户数] [股票数] [Zipf指数] [市价单比例] [撤单比例] [种子] [线程数]
+// 不带参数时沿用交互方式, 生成单一客户单只股票的限价单
+int main(int argc, char* argv[]){
+    GeneratorConfig config;
+    if(argc<3){
+        std::cout<<"请输入用户ID以及输出文件名(以.bin结尾则输出二进制格式)!"<<std::endl;
+        std::cin>>config.firstClientID>>config.fileName;
+        std::cout<<"请输入生成的条数"<<std::endl;
+        std::cin>>config.count;
+        config.seed=time(NULL);
+    }else{
+        config.fileName=argv[1];
+        config.count=std::stoull(argv[2]);
+        if(argc>3) config.clients=std::max<uint64_t>(1, std::stoull(argv[3]));
+        if(argc>4) config.symbols=std::max<uint32_t>(1, std::stoul(argv[4]));
+        if(argc>5) config.zipfExponent=std::max(0.0, std::stod(argv[5]));
+        if(argc>6) config.marketRatio=std::min(std::max(std::stod(argv[6]), 0.0), 1.0);
+        if(argc>7) config.cancelRatio=std::min(std::max(std::stod(argv[7]), 0.0), 1.0);
+        if(argc>8) config.seed=std::stoull(argv[8]);
+        config.threads=std::thread::hardware_concurrency();
+        if(argc>9) config.threads=std::stoi(argv[9]);
+        config.threads=std::max(1, config.threads);
+    }
+    std::vector<OrderFileRecord> records;
+    generateRecords(config, records);
+    if(!writeRecords(config, records)){
+        std::cout<<"Can not write: "<<config.fileName<<std::endl;
+        return 1;
     }
     return 0;
 }
-#endif
\ No newline at end of file
+#endif
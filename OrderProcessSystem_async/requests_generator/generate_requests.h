@@ -2,5 +2,51 @@
 #define GENERATE_REQUESTS_H
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include <time.h>
-#endif
\ No newline at end of file
+#include "../helper/order_file.h"
+
+/*****************************************************************************************
+ * 报单生成器: 多客户, 股票按Zipf分布选取, 每只股票的价格按随机游走变化并带有买卖价差
+ * 可配置市价单比例与撤单比例, 撤单引用同一数据块内之前的限价单
+ * 按固定大小的数据块并行生成, 每块使用由种子和块号确定的随机数, 结果与线程数无关
+ ****************************************************************************************/
+
+// 每个数据块的记录数
+#define GENERATOR_BLOCK_SIZE 65536
+// 价格最小变动单位
+#define GENERATOR_TICK 0.01
+#define GENERATOR_TICKS_PER_UNIT 100.0
+// 单只股票的起始代码, 只有一只股票时与原先固定的"600030"一致
+#define GENERATOR_FIRST_STOCK 600030
+
+// 生成参数
+struct GeneratorConfig{
+    std::string fileName;
+    uint64_t count=0;
+    uint64_t firstClientID=1;
+    uint64_t clients=1;
+    uint32_t symbols=1;
+    double zipfExponent=1.0;   // Zipf分布的指数, 0为均匀分布
+    double marketRatio=0;      // 市价单占新订单的比例
+    double cancelRatio=0;      // 撤单占全部记录的比例
+    uint64_t seed=1;
+    int threads=1;
+};
+
+// 文件名是否以.bin结尾
+bool isBinaryFileName(const std::string&);
+// 生成全部记录
+void generateRecords(const GeneratorConfig&, std::vector<OrderFileRecord>&);
+// 写入文本或二进制文件
+bool writeRecords(const GeneratorConfig&, const std::vector<OrderFileRecord>&);
+#endif
@@ -7,54 +7,79 @@ TaskNode::TaskNode(const uint64_t& orderID_){
     orderID=orderID_;
     next=this;
     prev=this;
+    slot=nullptr;
 }
 
 // 构造函数
-TaskList::TaskList(){
+template<typename LockPolicy>
+BasicTaskList<LockPolicy>::BasicTaskList(){
     // 初始化头节点
     head=new TaskNode(0);
-    // 索引置空
-    taskIndex.clear();
+    count=0;
 }
 
-void TaskList::addTask(const uint64_t& orderID){
-    // 创建节点
-    TaskNode* task=new TaskNode(orderID);
+template<typename LockPolicy>
+void BasicTaskList<LockPolicy>::addTask(const uint64_t& orderID, TaskNode*& slot, const uint64_t& timestamp){
+    std::unique_lock<SharedMutex> w(taskListMutex);
+    TaskNode* task=slot;
+    if(task!=nullptr){
+        // 已在链表中, 先摘下
+        task->next->prev=task->prev;
+        task->prev->next=task->next;
+    }else{
+        // 创建节点
+        task=new TaskNode(orderID);
+        task->slot=&slot;
+        slot=task;
+        ++count;
+    }
+    task->timestamp=timestamp>0?timestamp:getTimestamp();
     // 插入双链表末尾
-    std::unique_lock<std::shared_mutex> w(taskListMutex);
-    uint64_t ts=getTimestamp();
-    task->timestamp=ts;
     TaskNode* prev=head->prev;
     task->next=head;
     task->prev=prev;
     prev->next=task;
     head->prev=task;
-    // 添加至索引
-    taskIndex[orderID]=task;
 }
 
-void TaskList::delTask(const uint64_t& orderID){
-    // 删除指定的任务
-    std::unique_lock<std::shared_mutex> w(taskListMutex);
-    if(taskIndex.find(orderID)!=taskIndex.end()){
-        TaskNode* task=taskIndex[orderID];
-        task->next->prev=task->prev;
-        task->prev->next=task->next;
-        task->next=nullptr;
-        task->prev=nullptr;
-        // 删除任务节点
-        delete task;
-        // 从索引中删除
-        taskIndex.erase(orderID);
+template<typename LockPolicy>
+void BasicTaskList<LockPolicy>::delTask(TaskNode*& slot){
+    // 删除句柄指向的任务
+    std::unique_lock<SharedMutex> w(taskListMutex);
+    TaskNode* task=slot;
+    if(task==nullptr){
+        return;
+    }
+    task->next->prev=task->prev;
+    task->prev->next=task->next;
+    slot=nullptr;
+    --count;
+    // 删除任务节点
+    delete task;
+}
+
+template<typename LockPolicy>
+void BasicTaskList<LockPolicy>::getAllTasks(std::unordered_map<uint64_t, uint64_t>& tasks){
+    std::shared_lock<SharedMutex> r(taskListMutex);
+    tasks.reserve(count);
+    for(TaskNode* task=head->next;task!=head;task=task->next){
+        tasks[task->orderID]=task->timestamp;
     }
 }
 
-bool TaskList::checkFirstTask(){
+template<typename LockPolicy>
+size_t BasicTaskList<LockPolicy>::size(){
+    std::shared_lock<SharedMutex> r(taskListMutex);
+    return count;
+}
+
+template<typename LockPolicy>
+bool BasicTaskList<LockPolicy>::checkFirstTask(){
     // 任务的时间戳
     uint64_t task_ts=0;
     // 获取首节点
     {
-        std::shared_lock<std::shared_mutex> r(taskListMutex);
+        std::shared_lock<SharedMutex> r(taskListMutex);
         if(head->next==head){
             return false;
         }
@@ -70,11 +95,12 @@ bool TaskList::checkFirstTask(){
     return true;
 }
 
-bool TaskList::getFirstTask(uint64_t& orderID){
+template<typename LockPolicy>
+bool BasicTaskList<LockPolicy>::getFirstTask(uint64_t& orderID){
     // 任务
     TaskNode* task=nullptr;
     {
-        std::unique_lock<std::shared_mutex> w(taskListMutex);
+        std::unique_lock<SharedMutex> w(taskListMutex);
         if(head->next==head){
             return false;
         }
@@ -93,44 +119,75 @@ bool TaskList::getFirstTask(uint64_t& orderID){
         task->prev->next=task->next;
         // 获取订单ID
         orderID=task->orderID;
-        // 从索引中删除
-        taskIndex.erase(orderID);
+        // 清空订单中的句柄
+        *task->slot=nullptr;
+        --count;
     }
     // 删除任务节点
     delete task;
     return true;
 }
 
-Timer::Timer(){
-    taskList=new TaskList();
+template<typename LockPolicy>
+BasicTimer<LockPolicy>::BasicTimer(BasicMarketSystem<LockPolicy>* marketSystem_):marketSystem(marketSystem_), running(true){
+    taskList=new BasicTaskList<LockPolicy>();
 }
 
-void Timer::addTask(const uint64_t& orderID){
-    taskList->addTask(orderID);
+template<typename LockPolicy>
+void BasicTimer<LockPolicy>::addTask(const uint64_t& orderID, TaskNode*& slot){
+    taskList->addTask(orderID, slot);
+    Instrument::traceOrder(TRACE_TIMER_ARMED, orderID);
 }
 
-void Timer::delTask(const uint64_t& orderID){
-    taskList->delTask(orderID);
+template<typename LockPolicy>
+void BasicTimer<LockPolicy>::delTask(TaskNode*& slot){
+    taskList->delTask(slot);
 }
 
-void Timer::run(){
+template<typename LockPolicy>
+void BasicTimer<LockPolicy>::addTask(const uint64_t& orderID, TaskNode*& slot, const uint64_t& timestamp){
+    taskList->addTask(orderID, slot, timestamp);
+}
+
+template<typename LockPolicy>
+void BasicTimer<LockPolicy>::getAllTasks(std::unordered_map<uint64_t, uint64_t>& tasks){
+    taskList->getAllTasks(tasks);
+}
+
+template<typename LockPolicy>
+size_t BasicTimer<LockPolicy>::size(){
+    return taskList->size();
+}
+
+template<typename LockPolicy>
+void BasicTimer<LockPolicy>::start(){
+    running=true;
+}
+
+template<typename LockPolicy>
+void BasicTimer<LockPolicy>::stop(){
+    running=false;
+}
+
+template<typename LockPolicy>
+void BasicTimer<LockPolicy>::run(){
     // 节点指针
     TaskNode* task;
-    while(1){
-        while(!taskList->checkFirstTask()){
+    while(running){
+        while(running&&!taskList->checkFirstTask()){
             // 每隔100ms检查首结点
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
         uint64_t orderID;
-        while(taskList->getFirstTask(orderID)){
-            // 获取交易市场指针
-            MarketSystem* ms=MarketSystem::getInstance();
-            // 执行模拟撮合
-            if(ms->simulationMatch(orderID)){ // 
-                // 若还剩余订单，则继续更新并添加至计时器
-                addTask(orderID);
-            }
+        while(running&&taskList->getFirstTask(orderID)){
+            // 执行模拟撮合, 若还剩余订单, 由市场系统重新添加至计时器
+            marketSystem->simulationMatch(orderID);
         }
     }
 }
+
+template class BasicTaskList<ConcurrentLockPolicy>;
+template class BasicTaskList<SingleThreadLockPolicy>;
+template class BasicTimer<ConcurrentLockPolicy>;
+template class BasicTimer<SingleThreadLockPolicy>;
 #endif
\ No newline at end of file
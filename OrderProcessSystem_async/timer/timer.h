@@ -8,9 +8,12 @@
 #include <unordered_map>
 #include <mutex>
 #include <shared_mutex>
+#include <atomic>
 #include "../helper/helper.h"
+#include "../helper/lock_policy.h"
+#include "../helper/order_trace.h"
 #define DURATION 3000
-class MarketSystem;
+template<typename LockPolicy> class BasicMarketSystem;
 
 // 任务节点
 struct TaskNode{
@@ -21,44 +24,74 @@ struct TaskNode{
     uint64_t orderID;
     // 时间戳
     uint64_t timestamp;
+    // 订单中指向本节点的句柄, 节点移出链表时置空
+    TaskNode** slot;
     // 回调函数
     std::function<bool(const uint64_t&)> call;
     // 构造函数
     TaskNode(const uint64_t&);
 };
 
-// 任务双向循环链表
-class TaskList{
+// 任务双向循环链表, 锁策略见lock_policy.h
+// 任务由订单中的句柄直接定位, 增删都是常数时间, 不再维护订单ID到节点的索引
+template<typename LockPolicy>
+class BasicTaskList{
 public:
     // 构造函数
-    TaskList();
-    // 添加删除任务
-    void addTask(const uint64_t&);
-    void delTask(const uint64_t&);
+    BasicTaskList();
+    // 添加任务, slot为订单中的任务句柄; 任务已存在时移到链表末尾并更新时间戳
+    // timestamp为0时使用当前时间(从快照恢复时需按时间戳顺序调用)
+    void addTask(const uint64_t&, TaskNode*&, const uint64_t& timestamp=0);
+    // 删除句柄指向的任务, 句柄为空时不做任何事
+    void delTask(TaskNode*&);
+    // 获取所有任务的时间戳
+    void getAllTasks(std::unordered_map<uint64_t, uint64_t>&);
+    // 任务数
+    size_t size();
     // 检测首节点
     bool checkFirstTask();
     // 获取首节点
     bool getFirstTask(uint64_t&);
 private:
     TaskNode* head;
-    // OrderID到结点指针的映射
-    std::unordered_map<uint64_t, TaskNode*> taskIndex;
+    // 任务数
+    size_t count;
     // 链表的读写锁
-    std::shared_mutex taskListMutex;
+    typedef typename LockPolicy::SharedMutex SharedMutex;
+    SharedMutex taskListMutex{"TaskList::taskListMutex"};
 };
 
 // 计时器
-class Timer{
+template<typename LockPolicy>
+class BasicTimer{
 public:
-    // 构造函数
-    Timer();
-    // 添加任务
-    void addTask(const uint64_t&);
+    // 构造函数, 到期任务交给所属的市场系统撮合
+    explicit BasicTimer(BasicMarketSystem<LockPolicy>*);
+    // 添加任务, 已存在时重新计时
+    void addTask(const uint64_t&, TaskNode*&);
     // 删除任务
-    void delTask(const uint64_t&);
-    // 运行计时器
+    void delTask(TaskNode*&);
+    // 以指定时间戳添加任务
+    void addTask(const uint64_t&, TaskNode*&, const uint64_t&);
+    // 获取所有任务的时间戳
+    void getAllTasks(std::unordered_map<uint64_t, uint64_t>&);
+    // 任务数
+    size_t size();
+    // 运行计时器, 直到stop()被调用
     void run();
+    // 允许运行与停止计时器
+    void start();
+    void stop();
 private:
-    TaskList* taskList;
+    typedef typename LockPolicy::Instrument Instrument;
+    BasicTaskList<LockPolicy>* taskList;
+    // 所属的市场系统
+    BasicMarketSystem<LockPolicy>* marketSystem;
+    // 运行标志
+    std::atomic<bool> running;
 };
+
+// 多线程引擎使用的任务链表与计时器
+typedef BasicTaskList<ConcurrentLockPolicy> TaskList;
+typedef BasicTimer<ConcurrentLockPolicy> Timer;
 # endif
\ No newline at end of file